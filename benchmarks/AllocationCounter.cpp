@@ -0,0 +1,87 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstddef>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define BENCHMARK_ADDRESS_SANITIZER
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define BENCHMARK_ADDRESS_SANITIZER
+#endif
+
+#if defined(__GLIBC__) && !defined(BENCHMARK_ADDRESS_SANITIZER)
+#define BENCHMARK_COUNT_ALLOCATIONS
+#endif
+
+namespace {
+
+std::atomic<bool> s_counting{false};
+std::atomic<quint64> s_allocations{0};
+
+} // namespace
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+
+// The real ones, glibc exports them for exactly this
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+namespace {
+
+inline void countAllocation()
+{
+    if (s_counting.load(std::memory_order_relaxed)) {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+#endif // BENCHMARK_COUNT_ALLOCATIONS
+
+namespace benchmark {
+
+bool canCountAllocations()
+{
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void startCountingAllocations()
+{
+    s_allocations.store(0, std::memory_order_relaxed);
+    s_counting.store(true, std::memory_order_release);
+}
+
+quint64 stopCountingAllocations()
+{
+    s_counting.store(false, std::memory_order_release);
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace benchmark
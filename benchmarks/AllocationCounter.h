@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QtGlobal>
+
+namespace benchmark {
+
+// Counts calls to malloc, calloc and realloc (and so new, and everything Qt
+// allocates) while it is running, in all threads.
+//
+// Works by overriding malloc and friends with ones that forward to glibc, so
+// it's only available there, and not with the address sanitizer (which wants
+// to do the same thing).
+bool canCountAllocations();
+
+void startCountingAllocations();
+
+// Returns how many there were since startCountingAllocations()
+quint64 stopCountingAllocations();
+
+} // namespace benchmark
@@ -0,0 +1,408 @@
+#include "AllocationCounter.h"
+#include "logging.h"
+#include "utils.h"
+#include "mousr/MousrHandler.h"
+#include "simulator/MousrSimulator.h"
+#include "simulator/SpheroSimulator.h"
+#include "sphero/SensorStream.h"
+#include "sphero/SpheroHandler.h"
+#include "sphero/v1/ResponsePackets.h"
+#include "sphero/v2/Framing.h"
+#include "sphero/v2/Packets.h"
+#include "transport/ReplayTransport.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTest>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <functional>
+
+namespace benchmark {
+
+namespace {
+
+// Timed one by one, the clock itself takes some tens of nanoseconds
+static constexpr int latencyFrames = 20000;
+
+static constexpr int captureTime = 1000; // ms
+
+// Sits between a handler and a simulator or a replay, and keeps everything
+// the handler gets so we can feed it again afterwards as fast as we can.
+class CaptureTransport : public transport::Transport
+{
+public:
+    explicit CaptureTransport(transport::Transport *upstream) :
+        transport::Transport(nullptr),
+        m_upstream(upstream)
+    {
+        m_upstream->setParent(this);
+
+        connect(m_upstream, &transport::Transport::connected, this, &transport::Transport::connected);
+        connect(m_upstream, &transport::Transport::disconnected, this, &transport::Transport::disconnected);
+        connect(m_upstream, &transport::Transport::written, this, &transport::Transport::written);
+        connect(m_upstream, &transport::Transport::connectionIntervalChanged, this, &transport::Transport::connectionIntervalChanged);
+        connect(m_upstream, &transport::Transport::received, this, [this](const QByteArray &data) {
+            m_frames.append(data);
+            emit received(data);
+        });
+    }
+
+    QString name() const override { return m_upstream->name(); }
+    bool isConnected() const override { return m_upstream->isConnected(); }
+
+    bool write(const QByteArray &data) override {
+        // Whatever the handler has to say to what we feed it is swallowed,
+        // we're only interested in the parsing
+        if (!m_capturing) {
+            return true;
+        }
+        return m_upstream->write(data);
+    }
+
+    void stopCapturing() {
+        m_capturing = false;
+        m_upstream->blockSignals(true);
+    }
+
+    const QVector<QByteArray> &frames() const { return m_frames; }
+
+    void feed(const QByteArray &data) { emit received(data); }
+
+    void connectToRobot() override { m_upstream->connectToRobot(); }
+    void disconnectFromRobot() override { m_upstream->disconnectFromRobot(); }
+
+private:
+    transport::Transport *m_upstream;
+    QVector<QByteArray> m_frames;
+    bool m_capturing = true;
+};
+
+// The parsers complain about e. g. responses to requests they never sent
+// (which is all of them when we feed the same thing again), and printing that
+// is way slower than the parsing itself.
+class QuietLogging
+{
+public:
+    QuietLogging() { QLoggingCategory::setFilterRules(QStringLiteral("robot.*=false\ndefault.warning=false")); }
+    ~QuietLogging() { QLoggingCategory::setFilterRules(QString()); }
+};
+
+void runFor(const int milliseconds)
+{
+    QEventLoop loop;
+    QTimer::singleShot(milliseconds, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+// Same as the DeviceDiscoverer does it
+QObject *createHandler(transport::Transport *transport)
+{
+    const QString name = transport->name();
+    if (sphero::typeFromName(name) != sphero::RobotType::Unknown) {
+        return new sphero::SpheroHandler(transport, nullptr);
+    }
+    if (name.contains(QLatin1String("Mousr"))) {
+        return new mousr::MousrHandler(transport, nullptr);
+    }
+
+    qCWarning(lcBenchmark) << " ! Don't know what" << name << "is";
+    return nullptr;
+}
+
+// QBENCHMARK takes care of the timing, this adds what it doesn't know about
+template<typename FEED>
+void measure(const QString &name, const QVector<QByteArray> &frames, FEED &&feed)
+{
+    if (frames.isEmpty()) {
+        QSKIP("Nothing to feed");
+    }
+
+    qint64 bytesPerRound = 0;
+    for (const QByteArray &frame : frames) {
+        bytesPerRound += frame.size();
+    }
+
+    QElapsedTimer timer;
+    quint64 allocations = 0;
+    QVector<qint64> latencies;
+    latencies.reserve(latencyFrames);
+
+    {
+        QuietLogging quiet;
+
+        // Lets the buffers grow to whatever size they usually have
+        for (const QByteArray &frame : frames) {
+            feed(frame);
+        }
+
+        startCountingAllocations();
+        for (const QByteArray &frame : frames) {
+            feed(frame);
+        }
+        allocations = stopCountingAllocations();
+
+        QBENCHMARK {
+            for (const QByteArray &frame : frames) {
+                feed(frame);
+            }
+        }
+
+        timer.start();
+        for (int i=0; i<latencyFrames; i++) {
+            const QByteArray &frame = frames[i % frames.count()];
+            const qint64 start = timer.nsecsElapsed();
+            feed(frame);
+            latencies.append(timer.nsecsElapsed() - start);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&latencies](const double fraction) {
+        return latencies[qMin(int(latencies.count() * fraction), latencies.count() - 1)];
+    };
+
+    QString allocationsPerFrame;
+    if (canCountAllocations()) {
+        allocationsPerFrame = QString::number(double(allocations) / frames.count()) + " allocations/frame, ";
+    }
+
+    qCDebug(lcBenchmark).nospace() << " - " << name << ": "
+        << frames.count() << " frames, " << bytesPerRound << " bytes per iteration, "
+        << qPrintable(allocationsPerFrame)
+        << "latency p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99) << " ns, max " << latencies.last() << " ns";
+}
+
+void prepareSimulator(simulator::Simulator *robot)
+{
+    // Still split at the MTU like the real thing, but as fast as it can
+    robot->setLatency(0);
+    robot->setConnectionInterval(1);
+}
+
+} // namespace
+
+// Captures what the simulated robots send, and everything in the recordings
+// (from --record, passed with --replay), and then feeds it through the
+// handlers and the sphero decoders. Prints allocations per frame and the
+// latency per frame along with the QBENCHMARK timings.
+class ParserBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ParserBenchmark(const QStringList &recordings) :
+        m_recordings(recordings)
+    {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void handlers_data();
+    void handlers();
+
+    // The sphero framing on its own, without anything the handler does with it
+    void spheroDecoders_data();
+    void spheroDecoders();
+
+private:
+    struct Stream {
+        QString description;
+        CaptureTransport *transport = nullptr;
+        QObject *handler = nullptr;
+    };
+
+    // Takes ownership of the upstream, capture runs the event loop until it
+    // has what it wants.
+    void captureStream(const QString &description, transport::Transport *upstream, const std::function<void(QObject *handler)> &capture);
+
+    void addStreamRows(const bool spheroOnly);
+
+    QStringList m_recordings;
+    QVector<Stream> m_streams;
+};
+
+void ParserBenchmark::initTestCase()
+{
+    if (!canCountAllocations()) {
+        qCDebug(lcBenchmark) << "Can't count allocations in this build, only timing";
+    }
+
+    simulator::MousrSimulator *mousr = new simulator::MousrSimulator(nullptr);
+    prepareSimulator(mousr);
+    mousr->setOrientationRate(400);
+    mousr->setBatteryInterval(10);
+    captureStream("Simulated Mousr", mousr, [](QObject *) {
+        runFor(captureTime);
+    });
+
+    simulator::SpheroSimulator *bb8 = new simulator::SpheroSimulator(simulator::SpheroSimulator::V1, nullptr);
+    prepareSimulator(bb8);
+    bb8->setPowerNotificationInterval(10);
+    captureStream("Simulated BB-8, streaming sensors", bb8, [](QObject *handler) {
+        runFor(100); // connect and set up
+
+        sphero::SensorStream *sensors = qobject_cast<sphero::SensorStream*>(static_cast<sphero::SpheroHandler*>(handler)->sensors());
+        QVERIFY(sensors);
+        sensors->setRate(400);
+        sensors->setEnabled(true);
+
+        runFor(captureTime);
+    });
+
+    // Only answers what we send, so keep it busy
+    simulator::SpheroSimulator *r2d2 = new simulator::SpheroSimulator(simulator::SpheroSimulator::V2, nullptr);
+    prepareSimulator(r2d2);
+    captureStream("Simulated R2-D2", r2d2, [](QObject *handler) {
+        runFor(100);
+
+        sphero::SpheroHandler *sphero = static_cast<sphero::SpheroHandler*>(handler);
+        int color = 0;
+        QTimer colorTimer;
+        QObject::connect(&colorTimer, &QTimer::timeout, [sphero, &color]() {
+            sphero->setColor(color++ % 256, 0, 0);
+        });
+        colorTimer.start(1);
+
+        runFor(captureTime);
+    });
+
+    for (const QString &path : m_recordings) {
+        transport::ReplayTransport *replay = new transport::ReplayTransport(path, nullptr);
+        if (!replay->isValid()) {
+            delete replay;
+            QFAIL(qPrintable("Invalid recording " + path));
+        }
+        replay->setSpeed(0);
+
+        captureStream(path, replay, [replay](QObject *) {
+            QEventLoop loop;
+            QObject::connect(replay, &transport::ReplayTransport::finished, &loop, &QEventLoop::quit);
+            QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+            loop.exec();
+        });
+    }
+}
+
+void ParserBenchmark::cleanupTestCase()
+{
+    for (const Stream &stream : m_streams) {
+        delete stream.handler;
+    }
+    m_streams.clear();
+}
+
+void ParserBenchmark::handlers_data()
+{
+    addStreamRows(false);
+}
+
+void ParserBenchmark::handlers()
+{
+    QFETCH(int, stream);
+    const Stream &captured = m_streams[stream];
+
+    CaptureTransport *transport = captured.transport;
+    measure(captured.handler->metaObject()->className(), transport->frames(), [transport](const QByteArray &frame) {
+        transport->feed(frame);
+    });
+}
+
+void ParserBenchmark::spheroDecoders_data()
+{
+    addStreamRows(true);
+}
+
+void ParserBenchmark::spheroDecoders()
+{
+    QFETCH(int, stream);
+    const QVector<QByteArray> &frames = m_streams[stream].transport->frames();
+    if (frames.isEmpty()) {
+        QSKIP("Nothing to feed");
+    }
+
+    if (frames.first().startsWith(sphero::v2::StartOfPacket)) {
+        sphero::v2::StreamDecoder decoder;
+        int packets = 0;
+        measure("v2::StreamDecoder", frames, [&](const QByteArray &frame) {
+            decoder.feed(frame.constData(), frame.size(), [&](const char *data, const int size) {
+                bool ok;
+                const sphero::v2::Packet packet = bytesToPacket<sphero::v2::Packet>(data, size, &ok);
+                packets += ok && packet.m_commandID;
+            });
+        });
+        qCDebug(lcBenchmark) << "   " << packets << "packets with a command id";
+        return;
+    }
+
+    // The v1 packets are split at the MTU, so this is mostly junk, but
+    // bytesToPacket doesn't care
+    int packetTypes = 0;
+    measure("bytesToPacket<v1::ResponsePacketHeader>", frames, [&](const QByteArray &frame) {
+        bool ok;
+        const sphero::v1::ResponsePacketHeader header = bytesToPacket<sphero::v1::ResponsePacketHeader>(frame.constData(), frame.size(), &ok);
+        packetTypes += ok && header.packetType;
+    });
+    qCDebug(lcBenchmark) << "   " << packetTypes << "headers with a packet type";
+}
+
+void ParserBenchmark::captureStream(const QString &description, transport::Transport *upstream, const std::function<void(QObject *handler)> &capture)
+{
+    CaptureTransport *transport = new CaptureTransport(upstream);
+    QObject *handler = createHandler(transport);
+    if (!handler) {
+        delete transport;
+        return;
+    }
+
+    capture(handler);
+    transport->stopCapturing();
+
+    const QVector<QByteArray> &frames = transport->frames();
+    qint64 bytes = 0;
+    for (const QByteArray &frame : frames) {
+        bytes += frame.size();
+    }
+    qCDebug(lcBenchmark) << " + " << description << ":" << frames.count() << "frames," << bytes << "bytes";
+
+    m_streams.append({description, transport, handler});
+}
+
+void ParserBenchmark::addStreamRows(const bool spheroOnly)
+{
+    QTest::addColumn<int>("stream");
+
+    for (int i=0; i<m_streams.count(); i++) {
+        if (spheroOnly && !qobject_cast<sphero::SpheroHandler*>(m_streams[i].handler)) {
+            continue;
+        }
+        QTest::newRow(qPrintable(m_streams[i].description)) << i;
+    }
+}
+
+} // namespace benchmark
+
+// Like QTEST_MAIN, but takes --replay like the app does
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments;
+    QStringList recordings;
+    const QStringList all = app.arguments();
+    for (int i=0; i<all.count(); i++) {
+        if (all[i] == QLatin1String("--replay") && i + 1 < all.count()) {
+            recordings.append(all[++i]);
+        } else {
+            arguments.append(all[i]);
+        }
+    }
+
+    benchmark::ParserBenchmark benchmark(recordings);
+    return QTest::qExec(&benchmark, arguments);
+}
+
+#include "ParserBenchmark.moc"
@@ -0,0 +1,61 @@
+# Separate from the app, so the malloc() override in AllocationCounter only
+# ends up in here. Run with --replay <file> to include recordings.
+TARGET = parser-benchmark
+TEMPLATE = app
+
+CONFIG += c++2a console testcase no_testcase_installs
+CONFIG -= app_bundle
+
+QT += testlib bluetooth
+
+INCLUDEPATH += ../src
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    AllocationCounter.cpp \
+    ParserBenchmark.cpp \
+    ../src/gattcache.cpp \
+    ../src/logging.cpp \
+    ../src/mousr/AutoplayConfig.cpp \
+    ../src/mousr/MousrHandler.cpp \
+    ../src/mousr/PoseEstimator.cpp \
+    ../src/sphero/CommandStatistics.cpp \
+    ../src/sphero/SensorStream.cpp \
+    ../src/sphero/SpheroHandler.cpp \
+    ../src/sphero/v1/SampleConversion.cpp \
+    ../src/simulator/MousrSimulator.cpp \
+    ../src/simulator/Simulator.cpp \
+    ../src/simulator/SpheroSimulator.cpp \
+    ../src/transport/Recorder.cpp \
+    ../src/transport/ReplayTransport.cpp \
+
+
+HEADERS += \
+    AllocationCounter.h \
+    ../src/BasicTypes.h \
+    ../src/gattcache.h \
+    ../src/logging.h \
+    ../src/mousr/MousrHandler.h \
+    ../src/mousr/AutoplayConfig.h \
+    ../src/mousr/PoseEstimator.h \
+    ../src/sphero/v1/CommandPackets.h \
+    ../src/sphero/v1/PendingRequests.h \
+    ../src/sphero/v1/ResponsePackets.h \
+    ../src/sphero/v1/SampleConversion.h \
+    ../src/sphero/v1/SensorStream.h \
+    ../src/sphero/v2/Constants.h \
+    ../src/sphero/v2/Framing.h \
+    ../src/sphero/v2/Packets.h \
+    ../src/sphero/CommandStatistics.h \
+    ../src/sphero/SensorStream.h \
+    ../src/sphero/SpheroHandler.h \
+    ../src/sphero/Uuids.h \
+    ../src/simulator/MousrSimulator.h \
+    ../src/simulator/Simulator.h \
+    ../src/simulator/SpheroSimulator.h \
+    ../src/transport/Capture.h \
+    ../src/transport/Recorder.h \
+    ../src/transport/ReplayTransport.h \
+    ../src/transport/Transport.h \
+    ../src/utils.h
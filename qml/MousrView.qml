@@ -9,10 +9,15 @@ import "." as Lol
 
 Rectangle {
     id: robotView
-    property MousrHandler device
+    property QtObject device // a PropertyMirror of a MousrHandler
     readonly property int margins: 10
     anchors.fill: parent
 
+    OrientationInterpolator {
+        id: orientation
+        targetRotation: device.rotation
+    }
+
     Column {
         id: orientationView
         visible: !device.isCharging
@@ -28,11 +33,7 @@ Rectangle {
             height: robotView.height / 3
             fillMode: Image.PreserveAspectFit
 
-            RotationAnimation on rotation {
-                direction: RotationAnimation.Shortest
-                running: topImage.rotation != device.zRotation
-                to: device.zRotation
-            }
+            rotation: orientation.zRotation
         }
 
         Image {
@@ -43,11 +44,7 @@ Rectangle {
             height: robotView.height / 3
             fillMode: Image.PreserveAspectFit
 
-            RotationAnimation on rotation {
-                direction: RotationAnimation.Shortest
-                running: frontImage.rotation != device.xRotation
-                to: device.xRotation
-            }
+            rotation: orientation.xRotation
         }
 
         Item {
@@ -76,11 +73,7 @@ Rectangle {
                 fillMode: Image.PreserveAspectFit
             }
 
-            RotationAnimation on rotation {
-                direction: RotationAnimation.Shortest
-                running: sideImage.rotation != device.yRotation
-                to: device.yRotation
-            }
+            rotation: orientation.yRotation
         }
     }
 
@@ -186,6 +179,72 @@ Rectangle {
             text: qsTr("Pause time: ") + device.autoplayPauseTime
             opacity: 0.25
         }
+
+        // Where we think it has been, with the robot in the middle
+        Rectangle {
+            id: mapView
+            width: statusColumn.width
+            height: width
+            border.width: 1
+            clip: true
+
+            readonly property QtObject pose: device.pose
+            readonly property real pixelsPerCm: 2
+
+            Canvas {
+                id: trajectoryCanvas
+                anchors.fill: parent
+
+                readonly property point position: mapView.pose.position
+                onPositionChanged: requestPaint()
+
+                onPaint: {
+                    var context = getContext("2d");
+                    context.reset();
+
+                    var points = mapView.pose.trajectory;
+                    if (!points || points.length < 1) {
+                        return;
+                    }
+
+                    context.strokeStyle = "gray";
+                    context.lineWidth = 1;
+                    context.beginPath();
+                    for (var i = 0; i < points.length; i++) {
+                        var x = width / 2 + (points[i].x - position.x) * mapView.pixelsPerCm;
+                        var y = height / 2 + (points[i].y - position.y) * mapView.pixelsPerCm;
+                        if (i === 0) {
+                            context.moveTo(x, y);
+                        } else {
+                            context.lineTo(x, y);
+                        }
+                    }
+                    context.lineTo(width / 2, height / 2);
+                    context.stroke();
+                }
+            }
+
+            Image {
+                anchors.centerIn: parent
+                source: "qrc:images/top.png"
+                width: 24
+                height: 24
+                fillMode: Image.PreserveAspectFit
+                rotation: mapView.pose.heading
+            }
+
+            MouseArea {
+                anchors.fill: parent
+                onDoubleClicked: mapView.pose.invoke("reset")
+            }
+        }
+
+        Text {
+            width: statusColumn.width
+            horizontalAlignment: Text.AlignHCenter
+            text: qsTr("Position: %1, %2 cm").arg(mapView.pose.position.x.toFixed(0)).arg(mapView.pose.position.y.toFixed(0))
+            opacity: 0.25
+        }
     }
 
     Column {
@@ -216,7 +275,7 @@ Rectangle {
 
         Button {
             id: chirpButton
-            onClicked: device.chirp()
+            onClicked: device.invoke("chirp")
             text: qsTr("Chirp")
         }
 
@@ -246,7 +305,7 @@ Rectangle {
                 }
 
                 ComboBox {
-                    model: device.autoplayGameModeNames()
+                    model: device.autoplayGameModeNames
                     currentIndex: device.autoplayGameMode
                     width: parent.width
                     onActivated: {
@@ -258,7 +317,7 @@ Rectangle {
                 }
 
                 ComboBox {
-                    model: device.autoplayDrivingModeNames()
+                    model: device.autoplayDrivingModeNames
                     currentIndex: device.autoplayDrivingMode
                     width: parent.width
                     onActivated: {
@@ -279,10 +338,10 @@ Rectangle {
     focus: true
 
     Keys.onLeftPressed: {
-        device.rotate(MousrHandler.Left);
+        device.invoke("rotate", MousrHandler.Left);
     }
     Keys.onRightPressed: {
-        device.rotate(MousrHandler.Right);
+        device.invoke("rotate", MousrHandler.Right);
     }
     Keys.onPressed: {
         if (event.key === Qt.Key_Up) {
@@ -308,11 +367,11 @@ Rectangle {
 
         if (event.key === Qt.Key_Up || event.key === Qt.Key_Down) {
             device.speed = 0;
-            device.stop()
+            device.invoke("stop")
         } else if (event.key === Qt.Key_Return) {
-            device.flickTail();
+            device.invoke("flickTail");
         } else if (event.key === Qt.Key_Space) {
-            device.flip();
+            device.invoke("flip");
         }
     }
 }
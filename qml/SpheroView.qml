@@ -3,6 +3,7 @@ import QtQuick.Window 2.12
 import com.iskrembilen 1.0
 
 import QtGraphicalEffects 1.12
+import QtQuick.Controls 1.4
 
 // I don't understand qml anymore...
 import "." as Lol
@@ -11,11 +12,11 @@ Rectangle {
     id: robotView
     anchors.fill: parent
 
-    property SpheroHandler device
+    property QtObject device // a PropertyMirror of a SpheroHandler
 
     Connections {
         target: device
-        function onConnectedChanged() {
+        function onIsConnectedChanged() {
             console.log(" Connected changed! " + device.isConnected)
         }
     }
@@ -31,7 +32,7 @@ Rectangle {
         id: disconnectButton
         visible: device.isConnected
         text: "Disconnect"
-        onClicked: device.disconnectFromRobot();
+        onClicked: device.invoke("disconnectFromRobot");
     }
 
     Text {
@@ -143,6 +144,68 @@ Rectangle {
         text: "Signal strength: " + Math.ceil(device.signalStrength * 100) + "%"
     }
 
+    Text {
+        id: latency
+        anchors {
+            horizontalCenter: parent.horizontalCenter
+            bottom: signalStrength.top
+        }
+        visible: device.isConnected && device.commandStatistics.count > 0
+        opacity: 0.5
+        text: "Response time: " + device.commandStatistics.p50.toFixed(1) + " ms (p99 " + device.commandStatistics.p99.toFixed(1) + " ms)"
+    }
+
+    // The raw sensor stream, not on by default because it eats bandwidth
+    Column {
+        id: sensorView
+        anchors {
+            left: parent.left
+            bottom: parent.bottom
+            margins: 10
+        }
+        visible: device.isConnected
+
+        readonly property QtObject sensors: device.sensors
+
+        CheckBox {
+            text: qsTr("Stream sensors")
+            checked: sensorView.sensors.enabled
+            onCheckedStateChanged: {
+                sensorView.sensors.enabled = checkedState === Qt.Checked
+            }
+        }
+
+        Text {
+            visible: sensorView.sensors.enabled
+            opacity: 0.5
+            text: qsTr("Pitch %1, roll %2, yaw %3")
+                .arg(sensorView.sensors.orientation.x.toFixed(0))
+                .arg(sensorView.sensors.orientation.y.toFixed(0))
+                .arg(sensorView.sensors.orientation.z.toFixed(0))
+        }
+
+        Text {
+            visible: sensorView.sensors.enabled
+            opacity: 0.5
+            text: qsTr("Acceleration %1, %2, %3 G")
+                .arg(sensorView.sensors.accelerometer.x.toFixed(2))
+                .arg(sensorView.sensors.accelerometer.y.toFixed(2))
+                .arg(sensorView.sensors.accelerometer.z.toFixed(2))
+        }
+
+        Text {
+            visible: sensorView.sensors.enabled
+            opacity: 0.5
+            text: qsTr("Odometer %1, %2 cm").arg(sensorView.sensors.odometer.x.toFixed(0)).arg(sensorView.sensors.odometer.y.toFixed(0))
+        }
+
+        Text {
+            visible: sensorView.sensors.enabled
+            opacity: 0.5
+            text: qsTr("%1 Hz, %2 invalid packets").arg(sensorView.sensors.measuredRate.toFixed(0)).arg(sensorView.sensors.invalidPackets)
+        }
+    }
+
     Component.onCompleted: forceActiveFocus()
 
     focus: true
@@ -15,6 +15,9 @@ Window {
     width: 1024
     height: 768
 
+    // Showing the list of robots to connect to while we're already connected to some
+    property bool addingDevice: false
+
     MouseArea {
         anchors.fill: parent
 
@@ -107,7 +110,7 @@ Window {
         id: deviceDiscovery
         anchors.fill: parent
 
-        visible: !robotLoader.sourceComponent
+        visible: !robotLoader.sourceComponent || window.addingDevice
         opacity: 0.75
 
         BorderImage {
@@ -151,33 +154,16 @@ Window {
 
                 clip: true
 
-                visible: !DeviceDiscoverer.device
                 model: DeviceDiscoverer.availableDevices
 
                 delegate: Lol.Button {
-                    color: DeviceDiscoverer.displayColor(modelData)
-
-                    function updateText(strength) {
-                        text = DeviceDiscoverer.displayName(modelData) + " (" + Math.floor(strength * 100) + "%)";
-
-                        active = strength > 0
-                    }
-
-                    Component.onCompleted: {
-                        updateText(DeviceDiscoverer.signalStrength(modelData))
-                    }
-
-                    Connections {
-                        target: DeviceDiscoverer
-                        function onSignalStrengthChanged(deviceName, strength) {
-                            if (deviceName === modelData) {
-                                updateText(strength)
-                            }
-                        }
-                    }
+                    color: model.color
+                    text: model.name + " (" + Math.floor(model.signalStrength * 100) + "%)"
+                    active: model.signalStrength > 0
 
                     onClicked: {
-                        DeviceDiscoverer.connectDevice(modelData)
+                        window.addingDevice = false
+                        DeviceDiscoverer.connectDevice(model.address)
                     }
                 }
             }
@@ -239,4 +225,41 @@ Window {
             return undefined;
         }
     }
+
+    // Switching between the robots we're connected to
+    Row {
+        id: sessionBar
+        anchors {
+            top: parent.top
+            right: parent.right
+            margins: 10
+        }
+        spacing: 5
+        visible: DeviceDiscoverer.devices.length > 0
+
+        Repeater {
+            model: DeviceDiscoverer.devices
+
+            delegate: Lol.Button {
+                width: 150
+                height: 40
+                text: modelData.name
+                active: modelData === DeviceDiscoverer.device && !window.addingDevice
+                onClicked: {
+                    DeviceDiscoverer.device = modelData
+                    window.addingDevice = false
+                }
+            }
+        }
+
+        Lol.Button {
+            width: 40
+            height: 40
+            text: "+"
+            active: window.addingDevice
+            onClicked: {
+                window.addingDevice = !window.addingDevice
+            }
+        }
+    }
 }
@@ -0,0 +1,151 @@
+#ifndef ADDRESSTABLE_H
+#define ADDRESSTABLE_H
+
+#include <QVector>
+#include <QtGlobal>
+
+#include <utility>
+
+// Small hash table keyed by Bluetooth addresses (QBluetoothAddress::toUInt64()),
+// so we don't have to format and hash strings for every advertisement we see.
+//
+// Everything is in one flat array with linear probing, and removing something
+// shifts the ones after it back instead of leaving tombstones around.
+// 0 isn't a valid address, so that marks the empty slots.
+template<typename T>
+class AddressTable
+{
+public:
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+
+    bool contains(const quint64 key) const { return indexOf(key) >= 0; }
+
+    // nullptr if we don't have it, invalidated by insert() and remove()
+    T *find(const quint64 key) {
+        const int index = indexOf(key);
+        return index >= 0 ? &m_slots[index].value : nullptr;
+    }
+    const T *find(const quint64 key) const {
+        const int index = indexOf(key);
+        return index >= 0 ? &m_slots[index].value : nullptr;
+    }
+
+    T value(const quint64 key, const T &defaultValue = T()) const {
+        const T *found = find(key);
+        return found ? *found : defaultValue;
+    }
+
+    void insert(const quint64 key, const T &value) {
+        Q_ASSERT(key);
+
+        if ((m_count + 1) * 2 > m_slots.count()) {
+            rehash(qMax(minCapacity, m_slots.count() * 2));
+        }
+
+        const int mask = m_slots.count() - 1;
+        for (int i = bucket(key);; i = (i + 1) & mask) {
+            Slot &slot = m_slots[i];
+            if (slot.key == key) {
+                slot.value = value;
+                return;
+            }
+            if (!slot.key) {
+                slot.key = key;
+                slot.value = value;
+                m_count++;
+                return;
+            }
+        }
+    }
+
+    bool remove(const quint64 key) {
+        int hole = indexOf(key);
+        if (hole < 0) {
+            return false;
+        }
+
+        // Move back everything that would have ended up in the hole if it
+        // had been empty when it was inserted, so lookups don't stop early.
+        const int mask = m_slots.count() - 1;
+        for (int i = (hole + 1) & mask; m_slots[i].key; i = (i + 1) & mask) {
+            const int home = bucket(m_slots[i].key);
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                m_slots[hole] = std::move(m_slots[i]);
+                hole = i;
+            }
+        }
+        m_slots[hole] = Slot();
+        m_count--;
+        return true;
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_count = 0;
+        m_shift = 64;
+    }
+
+    // FUNC is called with (quint64 key, const T &value), in no particular order
+    template<typename FUNC>
+    void forEach(FUNC func) const {
+        for (const Slot &slot : m_slots) {
+            if (slot.key) {
+                func(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    static constexpr int minCapacity = 16;
+
+    struct Slot {
+        quint64 key = 0;
+        T value{};
+    };
+
+    // Fibonacci hashing, the low bits of the addresses aren't always that random
+    int bucket(const quint64 key) const {
+        return int((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    int indexOf(const quint64 key) const {
+        if (!key || !m_count) {
+            return -1;
+        }
+        const int mask = m_slots.count() - 1;
+        for (int i = bucket(key);; i = (i + 1) & mask) {
+            if (m_slots[i].key == key) {
+                return i;
+            }
+            if (!m_slots[i].key) {
+                return -1;
+            }
+        }
+    }
+
+    void rehash(const int capacity) {
+        Q_ASSERT((capacity & (capacity - 1)) == 0);
+
+        QVector<Slot> old(capacity);
+        old.swap(m_slots);
+
+        m_shift = 64;
+        for (int size = capacity; size > 1; size >>= 1) {
+            m_shift--;
+        }
+
+        m_count = 0;
+        for (Slot &slot : old) {
+            if (slot.key) {
+                insert(slot.key, std::move(slot.value));
+            }
+        }
+    }
+
+    QVector<Slot> m_slots; // always a power of two
+    int m_count = 0;
+    int m_shift = 64;
+};
+
+#endif // ADDRESSTABLE_H
@@ -1,16 +1,34 @@
 #include "devicediscoverer.h"
 
+#include "devicelistmodel.h"
+#include "logging.h"
+#include "propertymirror.h"
+#include "sessionmanager.h"
+#include "workerpool.h"
 #include "mousr/MousrHandler.h"
 #include "sphero/SpheroHandler.h"
+#include "transport/Recorder.h"
+#include "transport/Transport.h"
 
 #include <QBluetoothDeviceDiscoveryAgent>
 #include <QDebug>
 #include <QQmlEngine>
+#include <QSettings>
+#include <QtEndian>
+#include <cstring>
+#include <type_traits>
 
 DeviceDiscoverer::DeviceDiscoverer(QObject *parent) :
     QObject(parent),
     m_scanning(false)
 {
+    m_workers = new WorkerPool(this);
+    m_availableDevices = new DeviceListModel(this);
+    connect(m_availableDevices, &DeviceListModel::countChanged, this, &DeviceDiscoverer::statusStringChanged);
+    m_sessions = new SessionManager(this);
+    connect(m_sessions, &SessionManager::sessionsChanged, this, &DeviceDiscoverer::devicesChanged);
+    connect(m_sessions, &SessionManager::sessionRemoved, this, &DeviceDiscoverer::onDeviceDisconnected);
+
     QMetaObject::invokeMethod(this, &DeviceDiscoverer::init);
 }
 
@@ -20,7 +38,6 @@ void DeviceDiscoverer::init()
     m_adapter->setHostMode(QBluetoothLocalDevice::HostPoweredOff); // we need to do this because bluez is crap
 
     connect(m_adapter, &QBluetoothLocalDevice::error, this, &DeviceDiscoverer::onAdapterError);
-    connect(this, &DeviceDiscoverer::availableDevicesChanged, this, &DeviceDiscoverer::statusStringChanged);
 
     // I hate these overload things..
     m_discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
@@ -30,6 +47,18 @@ void DeviceDiscoverer::init()
 
     m_discoveryAgent->setLowEnergyDiscoveryTimeout(0);
 
+    // So we get back to where we were as fast as possible when restarted
+    QSettings settings;
+    settings.beginGroup("discovery");
+    m_autoReconnect = settings.value("autoReconnect", true).toBool();
+    const quint64 lastRobot = QBluetoothAddress(settings.value("lastRobot").toString()).toUInt64();
+    m_reconnectClock.start();
+    if (m_autoReconnect && lastRobot) {
+        Reconnect reconnect;
+        reconnect.pending = true;
+        m_reconnects.insert(lastRobot, reconnect);
+    }
+
     if (m_adapter->hostMode() == QBluetoothLocalDevice::HostPoweredOff) {
         connect(m_adapter, &QBluetoothLocalDevice::hostModeStateChanged, this, &DeviceDiscoverer::startScanning);
         m_adapter->powerOn();
@@ -41,9 +70,10 @@ void DeviceDiscoverer::init()
 DeviceDiscoverer::~DeviceDiscoverer()
 {
     stopScanning();
-    if (m_device) {
-        m_device->deleteLater();
-    }
+    delete m_sessions;
+
+    // After the sessions, so the handlers get deleted in their threads
+    delete m_workers;
 }
 
 QObject *DeviceDiscoverer::device()
@@ -51,6 +81,68 @@ QObject *DeviceDiscoverer::device()
     return m_device.data();
 }
 
+void DeviceDiscoverer::setDevice(QObject *device)
+{
+    if (device == m_device) {
+        return;
+    }
+    if (device && m_sessions->id(device).isEmpty()) {
+        qCWarning(lcDiscovery) << "Not one of our devices" << device;
+        return;
+    }
+    m_device = device;
+    emit deviceChanged();
+}
+
+QList<QObject*> DeviceDiscoverer::devices() const
+{
+    return m_sessions->sessions();
+}
+
+void DeviceDiscoverer::setWorkerThreads(const int count)
+{
+    m_workers->setThreadCount(count);
+}
+
+void DeviceDiscoverer::setRecordingDirectory(const QString &directory)
+{
+    m_recordingDirectory = directory;
+}
+
+void DeviceDiscoverer::setDeviceTimeout(const int seconds)
+{
+    m_availableDevices->setTimeout(seconds * 1000);
+}
+
+template<typename HANDLER>
+void DeviceDiscoverer::addSession(const QString &id, const QString &robotName, HANDLER *handler)
+{
+    // Has to be created in the same thread as the handler
+    if (!m_recordingDirectory.isEmpty()) {
+        const QString path = transport::Recorder::filePath(m_recordingDirectory, robotName);
+        QMetaObject::invokeMethod(handler, [handler, path, robotName]() {
+            handler->setRecorder(new transport::Recorder(path, robotName, nullptr));
+        });
+    }
+
+    // So we know whether it failed to connect or dropped out later
+    connect(handler, &HANDLER::connectionEstablished, this, [this, id]() {
+        m_establishedSessions.insert(id);
+    });
+
+    // Only the Spheros can be disconnected from the UI
+    if constexpr (std::is_same_v<HANDLER, sphero::SpheroHandler>) {
+        connect(handler, &sphero::SpheroHandler::disconnectRequested, this, [this, id]() {
+            m_disconnectRequested.insert(id);
+        });
+    }
+
+    // QML only ever sees the mirror, so it doesn't matter which thread the handler is in
+    PropertyMirror *mirror = new PropertyMirror(handler, nullptr);
+    m_sessions->add(id, handler, mirror);
+    setDevice(mirror);
+}
+
 QString DeviceDiscoverer::statusString()
 {
     if (m_lastDeviceStatusTimer.isValid() && m_lastDeviceStatusTimer.elapsed() < 5000) {
@@ -81,7 +173,7 @@ QString DeviceDiscoverer::statusString()
         return tr("Searching error: %1").arg(m_discoveryAgent->errorString());
     }
 
-    if (!m_availableDevices.isEmpty()) {
+    if (m_availableDevices->count() > 0) {
         return tr("Found devices");
     }
 
@@ -92,66 +184,108 @@ QString DeviceDiscoverer::statusString()
     return QString();
 }
 
-QStringList DeviceDiscoverer::availableDevices() const
+QAbstractItemModel *DeviceDiscoverer::availableDevices() const
 {
-    return m_availableDevices.keys();
+    return m_availableDevices;
 }
 
 void DeviceDiscoverer::connectDevice(const QString &name)
 {
-    if (m_device) {
-        qWarning() << "already have device, not connecting to" << name;
+    if (m_sessions->contains(name)) {
+        qCWarning(lcDiscovery) << "already connected to" << name;
         return;
     }
 
-    if (!m_availableDevices.contains(name)) {
-        qWarning() << "We don't know" << name;
+    const int row = m_availableDevices->row(name);
+    if (row < 0) {
+        qCWarning(lcDiscovery) << "We don't know" << name;
         return;
     }
+    m_displayNames[name] = m_availableDevices->name(row);
 
-    stopScanning();
+    // We keep scanning in the background, so more robots can be added
+    const QBluetoothDeviceInfo device = m_availableDevices->take(row);
 
-    const QBluetoothDeviceInfo &device = m_availableDevices[name];
+    if (device.address().toUInt64()) {
+        QSettings settings;
+        settings.beginGroup("discovery");
+        settings.setValue("lastRobot", name);
+    }
 
-    const RobotType type = robotType(device);
+    // Might be someone connecting by hand while we're waiting to reconnect
+    Reconnect *reconnect = m_reconnects.find(DeviceListModel::key(device));
+    if (reconnect) {
+        reconnect->pending = false;
+    }
+
+    const RobotType type = classify(device, false);
+    QThread *thread = m_workers->assignThread();
     if (type == Mousr) {
-        mousr::MousrHandler *handler = new mousr::MousrHandler(device, this);
-        connect(handler, &mousr::MousrHandler::disconnected, this, &DeviceDiscoverer::onDeviceDisconnected);
+        mousr::MousrHandler *handler = m_workers->create<mousr::MousrHandler>(thread, [device]() {
+            return new mousr::MousrHandler(device, nullptr);
+        });
 //        connect(handler, &mousr::MousrHandler::connectedChanged, this, &DeviceDiscoverer::onRobotStatusChanged); todo
-        m_device = handler;
+        addSession(name, device.name(), handler);
     } else if (type == Sphero) {
-        qDebug() << "Found BB8";
+        qCDebug(lcDiscovery) << "Found BB8";
 
-        sphero::SpheroHandler *handler = new sphero::SpheroHandler(device, this);
-        connect(handler, &sphero::SpheroHandler::disconnected, this, &DeviceDiscoverer::onDeviceDisconnected);
+        sphero::SpheroHandler *handler = m_workers->create<sphero::SpheroHandler>(thread, [device]() {
+            return new sphero::SpheroHandler(device, nullptr);
+        });
         connect(handler, &sphero::SpheroHandler::statusMessageChanged, this, &DeviceDiscoverer::onRobotStatusChanged);
-        m_device = handler;
+        addSession(name, device.name(), handler);
     } else {
-        qWarning() << "unknown device!" << device.name();
+        qCWarning(lcDiscovery) << "unknown device!" << device.name();
         Q_ASSERT(false);
         return;
     }
+}
 
-    QQmlEngine::setObjectOwnership(m_device, QQmlEngine::CppOwnership);
-    emit deviceChanged();
+void DeviceDiscoverer::connectTransport(transport::Transport *transport)
+{
+    const QString name = transport->name();
+    const QString id = m_sessions->uniqueId(name);
+
+    const bool isSphero = sphero::typeFromName(name) != sphero::RobotType::Unknown;
+    if (!isSphero && !name.contains(QLatin1String("Mousr"))) {
+        qCWarning(lcDiscovery) << "unknown device!" << name;
+        transport->deleteLater();
+        return;
+    }
 
-    m_availableDevices.clear();
-    m_displayNames.clear();
-    emit availableDevicesChanged();
+    // Has to live in the same thread as the handler that owns it
+    QThread *thread = m_workers->assignThread();
+    if (thread) {
+        transport->setParent(nullptr);
+        transport->moveToThread(thread);
+    }
 
+    // Same as for real devices without any manufacturer data
+    if (isSphero) {
+        sphero::SpheroHandler *handler = m_workers->create<sphero::SpheroHandler>(thread, [transport]() {
+            return new sphero::SpheroHandler(transport, nullptr);
+        });
+        connect(handler, &sphero::SpheroHandler::statusMessageChanged, this, &DeviceDiscoverer::onRobotStatusChanged);
+        addSession(id, name, handler);
+    } else {
+        mousr::MousrHandler *handler = m_workers->create<mousr::MousrHandler>(thread, [transport]() {
+            return new mousr::MousrHandler(transport, nullptr);
+        });
+        addSession(id, name, handler);
+    }
 }
 
 void DeviceDiscoverer::startScanning()
 {
     if (m_scanning) {
-        qDebug() << "Already scanning";
+        qCDebug(lcDiscovery) << "Already scanning";
         return;
     }
 
     m_scanning = true;
     disconnect(m_adapter, &QBluetoothLocalDevice::hostModeStateChanged, this, &DeviceDiscoverer::startScanning);
 
-    qDebug() << "Starting scan";
+    qCDebug(lcDiscovery) << "Starting scan";
     // This might immediately lead to the other things getting called, just fyi
     m_discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
 
@@ -160,19 +294,19 @@ void DeviceDiscoverer::startScanning()
 
 void DeviceDiscoverer::stopScanning()
 {
-    qDebug() << "Stopping scan";
+    qCDebug(lcDiscovery) << "Stopping scan";
 
     m_scanning = false;
     m_discoveryAgent->stop();
     emit statusStringChanged();
 }
 
-inline void debugVisibleDevices(const QBluetoothDeviceInfo &device)
+inline void debugVisibleDevices(const QBluetoothDeviceInfo &device, const DeviceDiscoverer::RobotType type)
 {
 //    if (device.manufacturerIds().isEmpty()) {
 //        return;
 //    }
-    if (DeviceDiscoverer::robotType(device) != DeviceDiscoverer::Unknown) {
+    if (type != DeviceDiscoverer::Unknown) {
         return;
     }
 
@@ -203,86 +337,135 @@ inline void debugVisibleDevices(const QBluetoothDeviceInfo &device)
         if (knownIds.contains(mfgid)) {
             return;
         }
-        qDebug() << "discovered" << device.name() << device.address().toString() << device.manufacturerIds() << device.minorDeviceClass() << device.majorDeviceClass() << device.manufacturerData() << device.serviceClasses() << device.rssi();
+        qCDebug(lcDiscovery) << "discovered" << device.name() << device.address().toString() << device.manufacturerIds() << device.minorDeviceClass() << device.majorDeviceClass() << device.manufacturerData() << device.serviceClasses() << device.rssi();
     }
 }
 
 void DeviceDiscoverer::onDeviceDiscovered(const QBluetoothDeviceInfo &device)
 {
-    if (m_device) {
-        qWarning() << "already have device, not checkking" << device.name();
+    // Might have been discovered before with something else in the advertisement
+    const RobotType robot = classify(device, true);
+    if (robot == Unknown) {
         return;
     }
 
-    QString deviceName = device.name();
-    const QString deviceAddress = device.address().toString();
+    // Only the ones we're not connected to are in the list, so only look for
+    // a session (which needs the address as a string) if it's new
+    if (!m_availableDevices->contains(DeviceListModel::key(device)) && m_sessions->contains(DeviceListModel::address(device))) {
+        return;
+    }
 
+    QString deviceName = device.name();
 
-    switch(DeviceDiscoverer::robotType(device)) {
+    QString type;
+    switch(robot) {
     case Sphero:
         deviceName = sphero::displayName(deviceName);
+        type = sphero::SpheroHandler::deviceType();
         break;
     case Mousr:
         // TODO: figure out how to get the Real™ name
+        type = mousr::MousrHandler::deviceType();
         break;
     case Unknown:
         return;
     }
 
-    if (m_displayNames.value(deviceAddress) == deviceName) {
-        return;
-    }
-
-    m_displayNames[deviceAddress] = deviceName;
-
-    m_availableDevices[deviceAddress] = device;
-    emit availableDevicesChanged();
+    // Only emits anything for what actually changed
+    m_availableDevices->update(device, deviceName, type);
 
-    emit signalStrengthChanged(deviceAddress, rssiToStrength(device.rssi()));
+    reconnectIfWanted(device);
 
 #ifndef NDEBUG
-    debugVisibleDevices(device);
+    debugVisibleDevices(device, robot);
 #endif
 }
 
 void DeviceDiscoverer::onDeviceUpdated(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields fields)
 {
+    // Mostly RSSI updates, which don't change what it is
+    const RobotType robot = classify(device, fields.testFlag(QBluetoothDeviceInfo::Field::ManufacturerData));
+
 #ifndef NDEBUG
     if (!(fields & QBluetoothDeviceInfo::Field::RSSI)) {
-        debugVisibleDevices(device);
+        debugVisibleDevices(device, robot);
     }
 #endif
 
-    if (DeviceDiscoverer::robotType(device) == DeviceDiscoverer::Unknown) {
+    if (robot == DeviceDiscoverer::Unknown) {
+        return;
+    }
+    // There are lots of these, and the list shows them anyways
+    if (fields.testFlag(QBluetoothDeviceInfo::Field::ManufacturerData)) {
+        qCDebug(lcDiscovery) << "device updated" << device.name() << device.address().toString() << device.rssi() << fields;
+    }
+
+    // The agent doesn't tell us it's discovered again when it comes back
+    // after we removed it for being gone too long
+    const quint64 key = DeviceListModel::key(device);
+    if (!m_availableDevices->contains(key)) {
+        onDeviceDiscovered(device);
         return;
     }
-    qDebug() << "device updated" << device.name() << device.address().toString() << device.rssi() << fields;
 
     if (fields & QBluetoothDeviceInfo::Field::RSSI) {
-        emit signalStrengthChanged(device.address().toString(), rssiToStrength(device.rssi()));
+        m_availableDevices->updateRssi(key, device.rssi());
     }
+
+    // Might have been waiting for the backoff when we first saw it again
+    reconnectIfWanted(device);
 }
 
-void DeviceDiscoverer::onDeviceDisconnected()
+void DeviceDiscoverer::onDeviceDisconnected(const QString &id)
 {
-    qDebug() << "device disconnected";
+    qCDebug(lcDiscovery) << "device disconnected" << id;
 
-    if (m_device) {
-        m_device->deleteLater();
-        disconnect(m_device, nullptr, this, nullptr);
-        m_device = nullptr;
+    // The session manager already got rid of it, so show one of the others if we have any
+    if (m_device && m_sessions->id(m_device).isEmpty()) {
+        const QList<QObject*> remaining = m_sessions->sessions();
+        m_device = remaining.isEmpty() ? nullptr : remaining.last();
         emit deviceChanged();
-    } else {
-        qWarning() << "device disconnected, but is not set?";
     }
 
-    m_availableDevices.clear();
-    emit availableDevicesChanged();
-
     if (m_lastDeviceStatus.isEmpty() || !m_lastDeviceStatusTimer.isValid() || m_lastDeviceStatusTimer.elapsed() > 20000) {
-        m_lastDeviceStatus = tr("Unexpected disconnect from device");
+        m_lastDeviceStatus = tr("Unexpected disconnect from %1").arg(displayName(id));
         m_lastDeviceStatusTimer.restart();
     }
+
+    // It shows up in the list again when we see it
+    m_displayNames.remove(id);
+
+    const bool requested = m_disconnectRequested.remove(id);
+    const bool established = m_establishedSessions.remove(id);
+
+    // Simulators and replays don't have addresses
+    const quint64 address = QBluetoothAddress(id).toUInt64();
+    if (address && requested) {
+        qCDebug(lcDiscovery) << "Disconnected from" << id << "on purpose, not reconnecting";
+        m_reconnects.remove(address);
+
+        // Or when we're started again
+        QSettings settings;
+        settings.beginGroup("discovery");
+        if (settings.value("lastRobot").toString() == id) {
+            settings.remove("lastRobot");
+        }
+    } else if (address && m_autoReconnect) {
+        Reconnect reconnect = m_reconnects.value(address);
+        reconnect.failures = established ? 0 : reconnect.failures + 1;
+
+        if (reconnect.failures > maxReconnectFailures) {
+            qCWarning(lcDiscovery) << "Giving up on reconnecting to" << id << "after" << maxReconnectFailures << "failed attempts";
+            m_reconnects.remove(address);
+        } else {
+            // Right away when it dropped out, but back off if it keeps failing to connect
+            const qint64 delay = reconnect.failures ? qMin(1000LL << reconnect.failures, 60000LL) : 0;
+            reconnect.notBefore = m_reconnectClock.elapsed() + delay;
+            reconnect.pending = true;
+            m_reconnects.insert(address, reconnect);
+            qCDebug(lcDiscovery) << "Will reconnect to" << id << "when we see it, in at least" << delay << "ms";
+        }
+    }
     emit statusStringChanged();
 
     QMetaObject::invokeMethod(this, &DeviceDiscoverer::startScanning); // otherwise we might loop, because qbluetooth-crap caches
@@ -290,10 +473,10 @@ void DeviceDiscoverer::onDeviceDisconnected()
 
 void DeviceDiscoverer::onAgentError()
 {
-    qDebug() << "agent error" << m_discoveryAgent->errorString();
+    qCDebug(lcDiscovery) << "agent error" << m_discoveryAgent->errorString();
 
     if (m_discoveryAgent->error() == QBluetoothDeviceDiscoveryAgent::PoweredOffError && m_adapterError != QBluetoothLocalDevice::NoError) {
-        qDebug() << "Device powered off, trying to power on";
+        qCDebug(lcDiscovery) << "Device powered off, trying to power on";
         m_adapter->powerOn();
     }
 
@@ -302,7 +485,7 @@ void DeviceDiscoverer::onAgentError()
 
 void DeviceDiscoverer::onAdapterError(const QBluetoothLocalDevice::Error error)
 {
-    qWarning() << "adapter error" << error;
+    qCWarning(lcDiscovery) << "adapter error" << error;
     m_adapterError = error;
     emit statusStringChanged();
 }
@@ -313,51 +496,76 @@ void DeviceDiscoverer::onRobotStatusChanged(const QString &message)
     m_lastDeviceStatusTimer.restart();
 }
 
-float DeviceDiscoverer::signalStrength(const QString &name)
+QString DeviceDiscoverer::displayName(const QString &name)
 {
-    if (!m_availableDevices.contains(name)) {
-        qWarning() << "Unknown device" << name;
-        return 0;
+    if (!m_displayNames.contains(name)) {
+        return name;
     }
-    return rssiToStrength(m_availableDevices[name].rssi());
+    return m_displayNames[name];
 }
 
-QColor DeviceDiscoverer::displayColor(const QString &name)
+void DeviceDiscoverer::reconnectIfWanted(const QBluetoothDeviceInfo &device)
 {
-    return QColor::fromHsv(qHash(name) % 360, 255, 255, 32);
+    Reconnect *reconnect = m_reconnects.find(DeviceListModel::key(device));
+    if (!reconnect || !reconnect->pending || m_reconnectClock.elapsed() < reconnect->notBefore) {
+        return;
+    }
+
+    qCDebug(lcDiscovery) << "Reconnecting to" << device.name() << "failed attempts so far:" << reconnect->failures;
+    connectDevice(DeviceListModel::address(device));
 }
 
-QString DeviceDiscoverer::displayName(const QString &name)
+DeviceDiscoverer::RobotType DeviceDiscoverer::classify(const QBluetoothDeviceInfo &device, const bool refresh)
 {
-    if (!m_displayNames.contains(name)) {
-        return name;
+    // Not available everywhere (e. g. macOS), then we just don't cache
+    const quint64 address = device.address().toUInt64();
+    if (!address) {
+        return robotType(device);
     }
-    return m_displayNames[name];
+
+    if (!refresh) {
+        const RobotType *cached = m_robotTypes.find(address);
+        if (cached) {
+            return *cached;
+        }
+    }
+
+    // Lots of things use random addresses that change all the time, so don't grow forever
+    if (m_robotTypes.count() >= maxCachedRobotTypes) {
+        qCDebug(lcDiscovery) << "Clearing cached robot types";
+        m_robotTypes.clear();
+    }
+
+    const RobotType type = robotType(device);
+    m_robotTypes.insert(address, type);
+    return type;
 }
 
 DeviceDiscoverer::RobotType DeviceDiscoverer::robotType(const QBluetoothDeviceInfo &device)
 {
     const QVector<quint16> manufacturerIds = device.manufacturerIds();
     if (manufacturerIds.count() > 1) {
-        qDebug() << "Unexpected amount of manufacturer IDs" << device.name() << manufacturerIds;
+        qCDebug(lcDiscovery) << "Unexpected amount of manufacturer IDs" << device.name() << manufacturerIds;
     }
 
     if (manufacturerIds.contains(mousr::manufacturerID)) {
         // It _seems_ like the manufacturer data is the reversed of most of the address, except the last part which is 0xFC in the address and 0x3C in the manufacturer data
-        QByteArray deviceAddress = QByteArray::fromHex(device.address().toString().toLatin1());
-        if (deviceAddress.isEmpty()) {
-            qDebug() << "No device address?";
+        const quint64 address = device.address().toUInt64();
+        if (!address) {
+            qCDebug(lcDiscovery) << "No device address?";
             return Unknown;
         }
         const QByteArray data = device.manufacturerData(mousr::manufacturerID);
         if (data.length() != 6) {
-            qWarning() << "Invalid data length" << data.toHex(':') << deviceAddress.toHex(':');
+            qCWarning(lcDiscovery) << "Invalid data length" << data.toHex(':') << device.address();
             return Unknown;
         }
-//        qDebug() << "dbg" << data.toHex(':') << deviceAddress.toHex(':');
-        std::reverse(deviceAddress.begin(), deviceAddress.end());
-        if (!deviceAddress.startsWith(data.left(5))) {
-            qDebug() << "Invalid manufacturer data" << data.toHex(':') << deviceAddress.toHex(':');
+//        qCDebug(lcDiscovery) << "dbg" << data.toHex(':') << device.address();
+        // Little endian is the address reversed
+        uchar reversedAddress[sizeof(address)];
+        qToLittleEndian(address, reversedAddress);
+        if (memcmp(reversedAddress, data.constData(), 5) != 0) {
+            qCDebug(lcDiscovery) << "Invalid manufacturer data" << data.toHex(':') << device.address();
             return Unknown;
         }
 
@@ -378,12 +586,12 @@ DeviceDiscoverer::RobotType DeviceDiscoverer::robotType(const QBluetoothDeviceIn
 
     if (name.contains(QLatin1String("Mousr"))) {
         if (!manufacturerIds.isEmpty()) {
-            qDebug() << "unexpected manufacturer ID for mousr:" << manufacturerIds;
+            qCDebug(lcDiscovery) << "unexpected manufacturer ID for mousr:" << manufacturerIds;
         }
         return Mousr;
     } else if (name.startsWith(QLatin1String("BB-"))) {
         if (!manufacturerIds.isEmpty()) {
-            qDebug() << "unexpeced manufacturer ID for Sphero:" << manufacturerIds;
+            qCDebug(lcDiscovery) << "unexpeced manufacturer ID for Sphero:" << manufacturerIds;
         }
         return Sphero;
     }
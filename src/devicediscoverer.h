@@ -1,10 +1,13 @@
 #ifndef DEVICEDISCOVERER_H
 #define DEVICEDISCOVERER_H
 
+#include "addresstable.h"
+
 #include <QObject>
 #include <QBluetoothLocalDevice>
 #include <QBluetoothDeviceInfo>
 #include <QPointer>
+#include <QSet>
 #include <QTimer>
 #include <QElapsedTimer>
 #include <QColor>
@@ -13,6 +16,16 @@ namespace mousr {
 class MousrHandler;
 }
 
+namespace transport {
+class Transport;
+}
+
+class DeviceListModel;
+class SessionManager;
+class WorkerPool;
+
+class QAbstractItemModel;
+
 class QBluetoothDeviceDiscoveryAgent;
 class QBluetoothDeviceInfo;
 
@@ -22,10 +35,11 @@ class DeviceDiscoverer : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(QString statusString READ statusString NOTIFY statusStringChanged)
-    Q_PROPERTY(QObject* device READ device NOTIFY deviceChanged)
+    Q_PROPERTY(QObject* device READ device WRITE setDevice NOTIFY deviceChanged) // the one being shown
+    Q_PROPERTY(QList<QObject*> devices READ devices NOTIFY devicesChanged) // everything we're connected to
     Q_PROPERTY(bool isError READ isError NOTIFY statusStringChanged) // yeye
     Q_PROPERTY(bool isScanning READ isScanning NOTIFY statusStringChanged) // yeye
-    Q_PROPERTY(QStringList availableDevices READ availableDevices NOTIFY availableDevicesChanged)
+    Q_PROPERTY(QAbstractItemModel* availableDevices READ availableDevices CONSTANT) // a DeviceListModel
 
 
 public:
@@ -38,28 +52,40 @@ public:
     ~DeviceDiscoverer();
 
     QObject *device();
+    void setDevice(QObject *device);
+
+    QList<QObject*> devices() const;
 
     QString statusString();
 
     bool isError() const { return m_adapterError != QBluetoothLocalDevice::NoError || QBluetoothLocalDevice::allDevices().isEmpty(); }
 
-    QStringList availableDevices() const;
+    QAbstractItemModel *availableDevices() const;
 
     bool isScanning() const { return m_scanning; }
 
     static RobotType robotType(const QBluetoothDeviceInfo &device);
 
+    // For robots that aren't over BLE, like the simulators. Takes ownership.
+    void connectTransport(transport::Transport *transport);
+
+    // How many threads the robot handlers get spread over, 0 is the GUI thread
+    void setWorkerThreads(const int count);
+
+    // Records all traffic to and from every robot we connect to, empty to not record
+    void setRecordingDirectory(const QString &directory);
+
+    // How long robots stay in the list after we last heard from them, 0 to keep them
+    void setDeviceTimeout(const int seconds);
+
 public slots:
     void connectDevice(const QString &name);
-    float signalStrength(const QString &name);
     QString displayName(const QString &name);
-    QColor displayColor(const QString &name);
 
 signals:
     void statusStringChanged();
     void deviceChanged();
-    void availableDevicesChanged();
-    void signalStrengthChanged(const QString &deviceName, float strength);
+    void devicesChanged();
 
 private slots:
     void init();
@@ -69,7 +95,7 @@ private slots:
 
     void onDeviceDiscovered(const QBluetoothDeviceInfo &device);
     void onDeviceUpdated(const QBluetoothDeviceInfo &device, QBluetoothDeviceInfo::Fields fields);
-    void onDeviceDisconnected();
+    void onDeviceDisconnected(const QString &id);
 
     void onAgentError();
     void onAdapterError(const QBluetoothLocalDevice::Error error);
@@ -77,7 +103,19 @@ private slots:
     void onRobotStatusChanged(const QString &message);
 
 private:
+    template<typename HANDLER>
+    void addSession(const QString &id, const QString &robotName, HANDLER *handler);
+
+    // robotType(), but cached by address. Refresh when the advertisement changed.
+    RobotType classify(const QBluetoothDeviceInfo &device, const bool refresh);
+
+    // Connects to it if it dropped out (or was the last one) and it's time to try again
+    void reconnectIfWanted(const QBluetoothDeviceInfo &device);
+
     QPointer<QObject> m_device;
+    SessionManager *m_sessions = nullptr;
+    WorkerPool *m_workers = nullptr;
+    QString m_recordingDirectory;
 
     QPointer<QBluetoothDeviceDiscoveryAgent> m_discoveryAgent;
     QPointer<QBluetoothLocalDevice> m_adapter;
@@ -86,8 +124,26 @@ private:
     bool m_attemptingScan = false;
     bool m_hasDevices = false;
     bool m_scanning = false;
-    QHash<QString, QBluetoothDeviceInfo> m_availableDevices;
-    QHash<QString, QString> m_displayNames;
+    DeviceListModel *m_availableDevices = nullptr;
+    QHash<QString, QString> m_displayNames; // by session id, the available ones have their names in m_availableDevices
+
+    static constexpr int maxCachedRobotTypes = 4096;
+    AddressTable<RobotType> m_robotTypes;
+
+    // Robots to connect to as soon as we see them, after dropping out or from last time
+    struct Reconnect {
+        int failures = 0; // handshakes in a row that didn't finish
+        qint64 notBefore = 0; // ms, on m_reconnectClock
+        bool pending = false;
+    };
+    static constexpr int maxReconnectFailures = 5;
+    AddressTable<Reconnect> m_reconnects;
+    QElapsedTimer m_reconnectClock;
+    bool m_autoReconnect = true;
+
+    // By session id, so we know why they went away
+    QSet<QString> m_establishedSessions;
+    QSet<QString> m_disconnectRequested;
 
     QString m_lastDeviceStatus;
     QElapsedTimer m_lastDeviceStatusTimer;
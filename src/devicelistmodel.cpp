@@ -0,0 +1,336 @@
+#include "devicelistmodel.h"
+
+#include "BasicTypes.h"
+#include "logging.h"
+
+namespace {
+
+// How much each new RSSI value counts, they jump around a lot
+static constexpr float rssiSmoothing = 0.25f;
+
+// Or it keeps flipping between two values when it is right between them
+static constexpr float rssiHysteresis = 3.f; // dB
+
+// How often QML gets told about new RSSI values, all at once
+static constexpr int rssiInterval = 250; // ms
+
+// How often we look for robots that have gone away, and how many ticks the
+// wheel has before it wraps around. Ones that expire later than one turn
+// of the wheel are just put back when we get to them.
+static constexpr int wheelResolution = 1000; // ms
+static constexpr int wheelSize = 64;
+
+} // namespace
+
+DeviceListModel::DeviceListModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+    m_clock.start();
+
+    m_rssiTimer.setSingleShot(true);
+    m_rssiTimer.setInterval(rssiInterval);
+    connect(&m_rssiTimer, &QTimer::timeout, this, &DeviceListModel::emitRssiChanges);
+
+    m_wheel.resize(wheelSize);
+    m_evictionTimer.setInterval(wheelResolution);
+    connect(&m_evictionTimer, &QTimer::timeout, this, &DeviceListModel::evictStale);
+}
+
+quint64 DeviceListModel::key(const QBluetoothDeviceInfo &device)
+{
+    const quint64 address = device.address().toUInt64();
+    if (address) {
+        return address;
+    }
+
+    // Addresses are only 48 bits, so these can't collide with them
+    return (quint64(1) << 48) | qHash(static_cast<const QUuid&>(device.deviceUuid()));
+}
+
+QString DeviceListModel::address(const QBluetoothDeviceInfo &device)
+{
+    if (device.address().toUInt64()) {
+        return device.address().toString();
+    }
+    return device.deviceUuid().toString();
+}
+
+int DeviceListModel::row(const QString &address) const
+{
+    for (int i=0; i<m_devices.count(); i++) {
+        if (m_devices[i].address == address) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int DeviceListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_devices.count();
+}
+
+QVariant DeviceListModel::data(const QModelIndex &index, int role) const
+{
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid | CheckIndexOption::ParentIsInvalid)) {
+        return QVariant();
+    }
+
+    const Device &device = m_devices[index.row()];
+    switch(role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return device.name;
+    case AddressRole:
+        return device.address;
+    case TypeRole:
+        return device.type;
+    case RssiRole:
+        return device.rssi;
+    case SignalStrengthRole:
+        return rssiToStrength(device.rssi);
+    case ColorRole:
+        return device.color;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> DeviceListModel::roleNames() const
+{
+    return {
+        { AddressRole, "address" },
+        { NameRole, "name" },
+        { TypeRole, "type" },
+        { RssiRole, "rssi" },
+        { SignalStrengthRole, "signalStrength" },
+        { ColorRole, "color" },
+    };
+}
+
+void DeviceListModel::update(const QBluetoothDeviceInfo &info, const QString &name, const QString &type)
+{
+    const quint64 key = DeviceListModel::key(info);
+
+    const int row = m_rows.value(key, -1);
+    if (row < 0) {
+        Device device;
+        device.key = key;
+        device.address = address(info);
+        device.name = name;
+        device.type = type;
+        filterRssi(&device, info.rssi());
+        device.color = QColor::fromHsv(qHash(key) % 360, 255, 255, 32);
+        device.lastSeen = m_clock.elapsed();
+        device.info = info;
+
+        if (m_timeout > 0) {
+            scheduleEviction(&device);
+        }
+
+        beginInsertRows(QModelIndex(), m_devices.count(), m_devices.count());
+        m_rows.insert(key, m_devices.count());
+        m_devices.append(device);
+        endInsertRows();
+
+        emit countChanged();
+        return;
+    }
+
+    Device &device = m_devices[row];
+    device.info = info;
+    device.lastSeen = m_clock.elapsed();
+
+    QVector<int> roles;
+    if (device.name != name) {
+        device.name = name;
+        roles << NameRole << Qt::DisplayRole;
+    }
+    if (device.type != type) {
+        device.type = type;
+        roles << TypeRole;
+    }
+    if (filterRssi(&device, info.rssi())) {
+        markRssiChanged(row);
+    }
+
+    if (!roles.isEmpty()) {
+        const QModelIndex changed = index(row);
+        emit dataChanged(changed, changed, roles);
+    }
+}
+
+void DeviceListModel::updateRssi(const quint64 key, const qint16 rssi)
+{
+    const int row = m_rows.value(key, -1);
+    if (row < 0) {
+        return;
+    }
+
+    Device &device = m_devices[row];
+    device.lastSeen = m_clock.elapsed();
+    device.info.setRssi(rssi);
+
+    if (filterRssi(&device, rssi)) {
+        markRssiChanged(row);
+    }
+}
+
+bool DeviceListModel::filterRssi(Device *device, const qint16 rssi)
+{
+    if (rssi == 0) { // means we don't know, see rssiToStrength()
+        return false;
+    }
+
+    if (device->rssi == 0) {
+        device->smoothedRssi = rssi;
+        device->rssi = rssi;
+        return true;
+    }
+
+    device->smoothedRssi += rssiSmoothing * (rssi - device->smoothedRssi);
+    if (qAbs(device->smoothedRssi - device->rssi) < rssiHysteresis) {
+        return false;
+    }
+
+    device->rssi = qint16(qRound(device->smoothedRssi));
+    return true;
+}
+
+void DeviceListModel::markRssiChanged(const int row)
+{
+    m_firstRssiChange = m_firstRssiChange < 0 ? row : qMin(m_firstRssiChange, row);
+    m_lastRssiChange = qMax(m_lastRssiChange, row);
+
+    if (!m_rssiTimer.isActive()) {
+        m_rssiTimer.start();
+    }
+}
+
+void DeviceListModel::emitRssiChanges()
+{
+    if (m_firstRssiChange < 0) {
+        return;
+    }
+
+    // One signal for all of them, even if it includes some that didn't change
+    const QModelIndex first = index(m_firstRssiChange);
+    const QModelIndex last = index(m_lastRssiChange);
+    m_firstRssiChange = m_lastRssiChange = -1;
+
+    emit dataChanged(first, last, { RssiRole, SignalStrengthRole });
+}
+
+QBluetoothDeviceInfo DeviceListModel::take(const int row)
+{
+    Q_ASSERT(row >= 0 && row < m_devices.count());
+
+    beginRemoveRows(QModelIndex(), row, row);
+    const Device device = m_devices.takeAt(row);
+    m_rows.remove(device.key);
+    for (int i=row; i<m_devices.count(); i++) {
+        *m_rows.find(m_devices[i].key) = i;
+    }
+    endRemoveRows();
+
+    // Everything after it moved up one
+    if (m_firstRssiChange > row) {
+        m_firstRssiChange--;
+    }
+    if (m_lastRssiChange >= row) {
+        m_lastRssiChange--;
+    }
+    if (m_lastRssiChange < m_firstRssiChange) {
+        m_firstRssiChange = m_lastRssiChange = -1;
+    }
+
+    if (m_devices.isEmpty()) {
+        m_evictionTimer.stop();
+    }
+
+    emit countChanged();
+
+    return device.info;
+}
+
+void DeviceListModel::setTimeout(const int milliseconds)
+{
+    if (milliseconds == m_timeout) {
+        return;
+    }
+    m_timeout = qMax(milliseconds, 0);
+
+    for (QVector<quint64> &slot : m_wheel) {
+        slot.clear();
+    }
+    m_evictionTimer.stop();
+
+    if (m_timeout == 0) {
+        return;
+    }
+    for (Device &device : m_devices) {
+        scheduleEviction(&device);
+    }
+}
+
+void DeviceListModel::scheduleEviction(Device *device)
+{
+    if (!m_evictionTimer.isActive()) {
+        // Don't need to catch up on the time where we didn't have anything
+        m_wheelTick = qMax(m_wheelTick, m_clock.elapsed() / wheelResolution);
+        m_evictionTimer.start();
+    }
+
+    // Rounded up, so it has expired when we get to it
+    const qint64 expires = device->lastSeen + m_timeout;
+    device->evictionTick = qMax((expires + wheelResolution - 1) / wheelResolution, m_wheelTick);
+    m_wheel[device->evictionTick % wheelSize].append(device->key);
+}
+
+void DeviceListModel::evictStale()
+{
+    const qint64 now = m_clock.elapsed();
+
+    // Normally only one, but the timer might be late (e. g. after a suspend)
+    for (int ticks = 0; ticks < wheelSize && m_wheelTick * wheelResolution <= now; ticks++) {
+        const qint64 tick = m_wheelTick++;
+        const int slot = int(tick % wheelSize);
+
+        QVector<quint64> keys;
+        keys.swap(m_wheel[slot]);
+
+        for (const quint64 key : keys) {
+            const int row = m_rows.value(key, -1);
+            if (row < 0) { // connected to, or already gone
+                continue;
+            }
+
+            Device &device = m_devices[row];
+            if (device.evictionTick % wheelSize != slot) { // left over from before it was removed and added again
+                continue;
+            }
+            if (device.evictionTick > tick) { // next time around
+                m_wheel[slot].append(key);
+                continue;
+            }
+
+            if (device.lastSeen + m_timeout > now) {
+                scheduleEviction(&device);
+                continue;
+            }
+
+            qCDebug(lcDiscovery) << "Haven't seen" << device.name << "in" << (now - device.lastSeen) << "ms, removing";
+            take(row);
+        }
+    }
+
+    // Everything has been checked at least once if we were that late
+    m_wheelTick = qMax(m_wheelTick, now / wheelResolution);
+
+    if (m_devices.isEmpty()) {
+        m_evictionTimer.stop();
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef DEVICELISTMODEL_H
+#define DEVICELISTMODEL_H
+
+#include "addresstable.h"
+
+#include <QAbstractListModel>
+#include <QBluetoothDeviceInfo>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+
+// The robots we can see but aren't connected to, for the list in QML.
+//
+// Only the rows (and roles) that actually change get updated, so the whole
+// list isn't rebuilt every time we get a new RSSI for one of them.
+// Looked up by key() so the updates don't need to format any addresses, the
+// address strings are only made once for QML.
+//
+// The RSSI is smoothed and only shown when it has moved a few dB, and the
+// changes for all of them are collected and sent out a few times a second
+// at most, so lots of robots nearby don't keep QML busy redrawing the list.
+//
+// Robots we haven't heard from in a while are removed again. They're kept in
+// a timer wheel, so every check only looks at the ones that might have
+// expired, and they only get moved when they are checked, not every time we
+// see them.
+class DeviceListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum Roles {
+        AddressRole = Qt::UserRole + 1,
+        NameRole,
+        TypeRole, // "Mousr" or "Sphero", like the handlers' deviceType
+        RssiRole, // dBm, smoothed
+        SignalStrengthRole, // 0 - 1
+        ColorRole
+    };
+    Q_ENUM(Roles)
+
+    explicit DeviceListModel(QObject *parent);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // The address as a number, or something made from the UUID where we
+    // don't get addresses (e. g. macOS)
+    static quint64 key(const QBluetoothDeviceInfo &device);
+    // Same, but for QML and as session id
+    static QString address(const QBluetoothDeviceInfo &device);
+
+    int count() const { return m_devices.count(); }
+    bool contains(const quint64 key) const { return m_rows.contains(key); }
+
+    // -1 if we don't have it, only for when QML gives us back the address
+    int row(const QString &address) const;
+    QString name(const int row) const { return m_devices[row].name; }
+
+    // Adds it if we don't have it already
+    void update(const QBluetoothDeviceInfo &device, const QString &name, const QString &type);
+    void updateRssi(const quint64 key, const qint16 rssi);
+
+    // Removes it from the list
+    QBluetoothDeviceInfo take(const int row);
+
+    // How long they stay after we last saw them, 0 keeps them forever
+    int timeout() const { return m_timeout; }
+    void setTimeout(const int milliseconds);
+
+signals:
+    void countChanged();
+
+private slots:
+    void emitRssiChanges();
+    void evictStale();
+
+private:
+    struct Device {
+        quint64 key = 0;
+        QString address;
+        QString name;
+        QString type;
+        qint16 rssi = 0; // what we show, 0 until we get one
+        float smoothedRssi = 0.f;
+        QColor color;
+        qint64 lastSeen = 0; // ms, on m_clock
+        qint64 evictionTick = -1; // where it is in m_wheel
+        QBluetoothDeviceInfo info;
+    };
+
+    QVector<Device> m_devices;
+    AddressTable<int> m_rows; // key -> index in m_devices
+
+    // Returns true if the RSSI we show changed
+    static bool filterRssi(Device *device, const qint16 rssi);
+    void markRssiChanged(const int row);
+
+    // Rows with RSSI changes that haven't been sent yet, -1 if none
+    int m_firstRssiChange = -1;
+    int m_lastRssiChange = -1;
+    QTimer m_rssiTimer;
+
+    // Puts it in the wheel slot for when it might expire
+    void scheduleEviction(Device *device);
+
+    int m_timeout = 60000; // ms
+    QVector<QVector<quint64>> m_wheel; // keys, by tick
+    qint64 m_wheelTick = 0; // the next one to check
+    QTimer m_evictionTimer;
+
+    QElapsedTimer m_clock;
+};
+
+#endif // DEVICELISTMODEL_H
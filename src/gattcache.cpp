@@ -0,0 +1,80 @@
+#include "gattcache.h"
+
+#include "logging.h"
+
+#include <QSettings>
+
+namespace {
+
+QString settingsKey(const QBluetoothAddress &address)
+{
+    // The string versions have colons, which QSettings doesn't like in keys
+    return QString::number(address.toUInt64(), 16);
+}
+
+} // namespace
+
+bool GattCache::Entry::hasServices(const QList<QBluetoothUuid> &wanted) const
+{
+    for (const QBluetoothUuid &service : wanted) {
+        if (!services.contains(service)) {
+            return false;
+        }
+    }
+    return isValid();
+}
+
+GattCache::Entry GattCache::load(const QBluetoothAddress &address, const QString &type)
+{
+    if (address.isNull()) {
+        return Entry();
+    }
+
+    QSettings settings;
+    settings.beginGroup("gattCache");
+    settings.beginGroup(settingsKey(address));
+
+    Entry entry;
+    entry.type = settings.value("type").toString();
+    for (const QString &uuid : settings.value("services").toStringList()) {
+        entry.services.append(QBluetoothUuid(uuid));
+    }
+
+    // Something else got the address, or we changed what we store
+    if (entry.type != type) {
+        return Entry();
+    }
+
+    return entry;
+}
+
+void GattCache::store(const QBluetoothAddress &address, const Entry &entry)
+{
+    if (address.isNull() || !entry.isValid()) {
+        return;
+    }
+
+    QStringList services;
+    for (const QBluetoothUuid &service : entry.services) {
+        services.append(service.toString());
+    }
+
+    QSettings settings;
+    settings.beginGroup("gattCache");
+    settings.beginGroup(settingsKey(address));
+    settings.setValue("type", entry.type);
+    settings.setValue("services", services);
+}
+
+void GattCache::forget(const QBluetoothAddress &address)
+{
+    if (address.isNull()) {
+        return;
+    }
+
+    qCDebug(lcDiscovery) << "Forgetting cached services for" << address.toString();
+
+    QSettings settings;
+    settings.beginGroup("gattCache");
+    settings.remove(settingsKey(address));
+}
@@ -0,0 +1,37 @@
+#ifndef GATTCACHE_H
+#define GATTCACHE_H
+
+#include <QBluetoothAddress>
+#include <QBluetoothUuid>
+#include <QList>
+#include <QString>
+
+// What we found on the robots we've connected to before, so we can get going
+// faster the next time.
+//
+// QtBluetooth doesn't let us use the handles directly, it always wants to
+// discover the services itself. But when we know which ones it has we can
+// start setting them up as soon as they show up, instead of waiting for the
+// discovery of everything else to finish.
+//
+// Stored with QSettings, so it's fine to use from the handler threads.
+class GattCache
+{
+public:
+    struct Entry {
+        QString type; // the handlers' deviceType(), so we don't use it for the wrong kind of robot
+        QList<QBluetoothUuid> services;
+
+        bool isValid() const { return !type.isEmpty(); }
+        bool hasServices(const QList<QBluetoothUuid> &wanted) const;
+    };
+
+    // Invalid if we haven't connected to it before, or don't get addresses (e. g. macOS)
+    static Entry load(const QBluetoothAddress &address, const QString &type);
+    static void store(const QBluetoothAddress &address, const Entry &entry);
+
+    // When connecting with what we had didn't work
+    static void forget(const QBluetoothAddress &address);
+};
+
+#endif // GATTCACHE_H
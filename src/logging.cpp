@@ -0,0 +1,10 @@
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(lcDiscovery, "robot.discovery")
+Q_LOGGING_CATEGORY(lcSessions, "robot.sessions")
+Q_LOGGING_CATEGORY(lcMousr, "robot.mousr")
+Q_LOGGING_CATEGORY(lcMousrProtocol, "robot.mousr.protocol", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcSphero, "robot.sphero")
+Q_LOGGING_CATEGORY(lcSpheroProtocol, "robot.sphero.protocol", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcSimulator, "robot.simulator")
+Q_LOGGING_CATEGORY(lcBenchmark, "robot.benchmark")
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QLoggingCategory>
+
+// Enable with e. g. QT_LOGGING_RULES="robot.mousr.protocol.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcDiscovery)
+Q_DECLARE_LOGGING_CATEGORY(lcSessions)
+Q_DECLARE_LOGGING_CATEGORY(lcMousr)
+Q_DECLARE_LOGGING_CATEGORY(lcMousrProtocol)
+Q_DECLARE_LOGGING_CATEGORY(lcSphero)
+Q_DECLARE_LOGGING_CATEGORY(lcSpheroProtocol)
+Q_DECLARE_LOGGING_CATEGORY(lcSimulator)
+Q_DECLARE_LOGGING_CATEGORY(lcBenchmark)
+
+// For dumping every packet, which is way too slow to always have around
+// (formatting the hex is slower than the actual write).
+// Gone completely in release builds unless PROTOCOL_TRACE_ENABLED is defined,
+// the arguments aren't even evaluated. Otherwise it's just qCDebug, and the
+// protocol categories are off by default.
+#if defined(QT_NO_DEBUG) && !defined(PROTOCOL_TRACE_ENABLED)
+#define PROTOCOL_TRACE(category) while (false) QMessageLogger().noDebug()
+#else
+#define PROTOCOL_TRACE(category) qCDebug(category)
+#endif
@@ -1,20 +1,87 @@
 #include "devicediscoverer.h"
+#include "orientationinterpolator.h"
 #include "mousr/MousrHandler.h"
 #include "sphero/SpheroHandler.h"
+#include "sphero/v1/SampleConversion.h"
+#include "simulator/Simulator.h"
+#include "transport/ReplayTransport.h"
 
+#include <QCommandLineParser>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QThread>
 
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption benchmarkSensorsOption("benchmark-sensor-decoding", "Time the sensor stream conversion and exit.");
+    parser.addOption(benchmarkSensorsOption);
+    const QCommandLineOption simulateOption("simulate", "Connect to simulated robots, can be repeated or comma separated (" + simulator::Simulator::robots().join(", ") + ").", "robot");
+    parser.addOption(simulateOption);
+    const QCommandLineOption latencyOption("simulate-latency", "Latency of the simulated connection.", "milliseconds", "10");
+    parser.addOption(latencyOption);
+    const QCommandLineOption lossOption("simulate-loss", "Chance of losing every simulated write or notification.", "0-1", "0");
+    parser.addOption(lossOption);
+    const QCommandLineOption workersOption("worker-threads", "How many threads to spread the robots over, 0 runs them in the GUI thread.", "count", QString::number(qBound(1, QThread::idealThreadCount() - 1, 4)));
+    parser.addOption(workersOption);
+    const QCommandLineOption recordOption("record", "Record all traffic with the robots to files in this directory.", "directory");
+    parser.addOption(recordOption);
+    const QCommandLineOption deviceTimeoutOption("device-timeout", "How long robots stay in the list after we last heard from them, 0 keeps them forever.", "seconds", "60");
+    parser.addOption(deviceTimeoutOption);
+    const QCommandLineOption replayOption("replay", "Replay a recording as if it was a connected robot, can be repeated.", "file");
+    parser.addOption(replayOption);
+    const QCommandLineOption replaySpeedOption("replay-speed", "How fast to replay, 1 is real time and 0 is as fast as possible.", "factor", "1");
+    parser.addOption(replaySpeedOption);
+    parser.process(app);
+
+    if (parser.isSet(benchmarkSensorsOption)) {
+        sphero::v1::benchmarkSampleConversion();
+        return 0;
+    }
+
+    QList<transport::Transport*> transports;
+    for (const QString &robot : parser.values(simulateOption).join(',').split(',', Qt::SkipEmptyParts)) {
+        simulator::Simulator *simulator = simulator::Simulator::create(robot.trimmed(), nullptr);
+        if (!simulator) {
+            qDeleteAll(transports);
+            return 1;
+        }
+        simulator->setLatency(parser.value(latencyOption).toInt());
+        simulator->setLossRate(parser.value(lossOption).toDouble());
+        transports.append(simulator);
+    }
+    for (const QString &path : parser.values(replayOption)) {
+        transport::ReplayTransport *replay = new transport::ReplayTransport(path, nullptr);
+        if (!replay->isValid()) {
+            delete replay;
+            qDeleteAll(transports);
+            return 1;
+        }
+        replay->setSpeed(parser.value(replaySpeedOption).toDouble());
+        transports.append(replay);
+    }
+
     qmlRegisterUncreatableType<mousr::MousrHandler>("com.iskrembilen", 1, 0, "MousrHandler", "Only valid when discovered");
     qmlRegisterUncreatableType<mousr::AutoplayConfig>("com.iskrembilen", 1, 0, "AutoplayConfig", "Only for enums and stuff");
     qmlRegisterUncreatableType<sphero::SpheroHandler>("com.iskrembilen", 1, 0, "SpheroHandler", "Only valid when discovered");
+    qmlRegisterType<OrientationInterpolator>("com.iskrembilen", 1, 0, "OrientationInterpolator");
+
+    const int workerThreads = parser.value(workersOption).toInt();
+    const QString recordingDirectory = parser.value(recordOption);
+    const int deviceTimeout = parser.value(deviceTimeoutOption).toInt();
 
-    qmlRegisterSingletonType<DeviceDiscoverer>("com.iskrembilen", 1, 0, "DeviceDiscoverer", [](QQmlEngine *, QJSEngine*) -> QObject* {
-        return new DeviceDiscoverer;
+    qmlRegisterSingletonType<DeviceDiscoverer>("com.iskrembilen", 1, 0, "DeviceDiscoverer", [transports, workerThreads, recordingDirectory, deviceTimeout](QQmlEngine *, QJSEngine*) -> QObject* {
+        DeviceDiscoverer *discoverer = new DeviceDiscoverer;
+        discoverer->setWorkerThreads(workerThreads);
+        discoverer->setRecordingDirectory(recordingDirectory);
+        discoverer->setDeviceTimeout(deviceTimeout);
+        for (transport::Transport *transport : transports) {
+            discoverer->connectTransport(transport);
+        }
+        return discoverer;
     });
 
     QQmlApplicationEngine engine(":qml/main.qml");
@@ -1,5 +1,7 @@
 #include "AutoplayConfig.h"
 
+#include "logging.h"
+
 #include <QtEndian>
 
 static constexpr uint8_t defaultModes[12][9] = {
@@ -25,7 +27,7 @@ AutoplayConfig AutoplayConfig::createConfig(AutoplayConfig::StandardGameModes ga
     AutoplayConfig config;
     const size_t index = size_t(gamemode);
     if (index >= sizeof(defaultModes)) {
-        qWarning() << gamemode << "out of range";
+        qCWarning(lcMousr) << gamemode << "out of range";
         return config;
     }
 
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <QObject>
+#include "logging.h"
+
 #include <QDebug>
 
 namespace mousr {
@@ -115,7 +117,7 @@ public:
         case AutoplayConfig::Stationary:
             return pauseTimeOrConfined;
         default:
-            qWarning() << "unhandled game mode" << m_gameMode;
+            qCWarning(lcMousr) << "unhandled game mode" << m_gameMode;
             return pauseTimeOrConfined;
         }
     }
@@ -130,14 +132,14 @@ public:
             pauseTimeOrConfined = time;
             break;
         default:
-            qWarning() << "unhandled game mode" << m_gameMode;
+            qCWarning(lcMousr) << "unhandled game mode" << m_gameMode;
             pauseTimeOrConfined = time;
         }
     }
 
     void setConfineArea(bool isConfined) {
         if (m_gameMode != WallHugger) {
-            qWarning() << "Confined is only used in WallHugger mode, not" << m_gameMode;
+            qCWarning(lcMousr) << "Confined is only used in WallHugger mode, not" << m_gameMode;
         }
         pauseTimeOrConfined = isConfined;
     }
@@ -145,7 +147,7 @@ public:
     bool backUp() const { return pauseLengthOrBackUp; }
     void setBackUp(bool isBackUp) {
         if (m_gameMode != GameMode::Stationary) {
-            qWarning() << "BackUp only used in Stationary, not in" << m_gameMode;
+            qCWarning(lcMousr) << "BackUp only used in Stationary, not in" << m_gameMode;
         }
         pauseLengthOrBackUp = isBackUp;
     }
@@ -157,7 +159,7 @@ public:
             m_drivingMode = DrivingMode(mode);
             break;
         default:
-            qWarning() << "Driving mode not used in game mode" << m_gameMode;
+            qCWarning(lcMousr) << "Driving mode not used in game mode" << m_gameMode;
             break;
         }
 
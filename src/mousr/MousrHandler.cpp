@@ -2,7 +2,11 @@
 #include <QDebug>
 
 #include "MousrHandler.h"
+#include "PoseEstimator.h"
 #include "utils.h"
+#include "logging.h"
+#include "transport/Recorder.h"
+#include "transport/Transport.h"
 
 #include <QLowEnergyController>
 #include <QLowEnergyConnectionParameters>
@@ -11,30 +15,127 @@
 #include <QtEndian>
 #include <QQmlEngine>
 #include <QSettings>
+#include <QtMath>
 
 namespace mousr {
 
+// Only the latest one of these matters
+static bool isCoalescable(const CommandType command)
+{
+    switch(command) {
+    case CommandType::Move:
+    case CommandType::ConfigAutoMode:
+    case CommandType::ConfigDriverAssist:
+    case CommandType::SoundVolume:
+        return true;
+    default:
+        return false;
+    }
+}
+
 bool MousrHandler::sendCommandPacket(const CommandPacket &packet)
 {
-    qDebug() << " + Sending packet" << packet.m_command;
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Queueing packet" << packet.m_command;
     if (!isConnected()) {
-        qWarning() << "trying to send when unconnected";
+        qCWarning(lcMousr) << "trying to send when unconnected";
         return false;
     }
     QByteArray buffer(sizeof(CommandPacket), Qt::Uninitialized);
     qToLittleEndian<char>(&packet, sizeof(CommandPacket), buffer.data());
 
-    qDebug() << "  - Writing" << buffer.toHex(':');
-    m_service->writeCharacteristic(m_writeCharacteristic, buffer);
+    if (packet.m_command == CommandType::Stop) {
+        // Stop trumps everything, and makes any pending movement pointless
+        for (int i=m_commandQueue.count() - 1; i>=0; i--) {
+            if (m_commandQueue[i].command == CommandType::Move) {
+                m_commandQueue.removeAt(i);
+            }
+        }
+        if (m_commandQueue.isEmpty() || m_commandQueue.first().command != CommandType::Stop) {
+            m_commandQueue.prepend({packet.m_command, buffer});
+        }
+    } else if (isCoalescable(packet.m_command)) {
+        // Only replace it in place if that doesn't move it in front of
+        // something that was queued after it, otherwise send it last
+        int existing = -1;
+        bool hasLaterCommands = false;
+        for (int i=m_commandQueue.count() - 1; i>=0; i--) {
+            if (m_commandQueue[i].command == packet.m_command) {
+                existing = i;
+                break;
+            }
+            if (!isCoalescable(m_commandQueue[i].command)) {
+                hasLaterCommands = true;
+            }
+        }
+
+        if (existing >= 0 && !hasLaterCommands) {
+            PROTOCOL_TRACE(lcMousrProtocol) << "  - Replacing unsent" << packet.m_command;
+            m_commandQueue[existing].data = buffer;
+        } else {
+            if (existing >= 0) {
+                PROTOCOL_TRACE(lcMousrProtocol) << "  - Moving unsent" << packet.m_command << "to the end";
+                m_commandQueue.removeAt(existing);
+            }
+            m_commandQueue.append({packet.m_command, buffer});
+        }
+    } else {
+        m_commandQueue.append({packet.m_command, buffer});
+    }
+
+    sendQueuedCommand();
 
     return true;
 }
 
+void MousrHandler::sendQueuedCommand()
+{
+    if (m_writeInFlight || m_commandQueue.isEmpty()) {
+        return;
+    }
+    if (!isConnected()) {
+        qCWarning(lcMousr) << "Not connected, dropping" << m_commandQueue.count() << "queued commands";
+        m_commandQueue.clear();
+        return;
+    }
+
+    const QueuedCommand command = m_commandQueue.takeFirst();
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Sending packet" << command.command;
+    PROTOCOL_TRACE(lcMousrProtocol) << "  - Writing" << command.data.toHex(':');
+
+    // Wait for the write to be acked before sending the next, so we go at the speed of the link
+    m_writeInFlight = true;
+    m_writeTimeoutTimer.start();
+    if (m_recorder) {
+        m_recorder->record(transport::Recorder::Sent, m_writeCharacteristic.uuid(), command.data, true);
+    }
+    if (m_transport) {
+        m_transport->write(command.data);
+    } else {
+        m_service->writeCharacteristic(m_writeCharacteristic, command.data);
+    }
+}
+
+void MousrHandler::onCharacteristicWritten(const QLowEnergyCharacteristic &characteristic)
+{
+    if (characteristic != m_writeCharacteristic) {
+        return;
+    }
+
+    onCommandWritten();
+}
+
+void MousrHandler::onCommandWritten()
+{
+    m_writeTimeoutTimer.stop();
+    m_writeInFlight = false;
+    sendQueuedCommand();
+}
+
 bool MousrHandler::sendCommand(const CommandType command, const float arg1, const float arg2, const float arg3)
 {
-    qDebug() << " + Sending command with float args" << command;
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Sending command with float args" << command;
     if (!isConnected()) {
-        qWarning() << "trying to send when unconnected";
+        qCWarning(lcMousr) << "trying to send when unconnected";
         return false;
     }
     CommandPacket packet(command);
@@ -49,9 +150,9 @@ bool MousrHandler::sendCommand(const CommandType command, const float arg1, cons
 
 bool MousrHandler::sendCommand(const CommandType command, const uint32_t arg1, const uint32_t arg2)
 {
-    qDebug() << " + Sending command with int args" << command;
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Sending command with int args" << command;
     if (!isConnected()) {
-        qWarning() << "trying to send when unconnected";
+        qCWarning(lcMousr) << "trying to send when unconnected";
         return false;
     }
 
@@ -65,9 +166,9 @@ bool MousrHandler::sendCommand(const CommandType command, const uint32_t arg1, c
 
 bool MousrHandler::sendCommand(const CommandType command)
 {
-    qDebug() << " + Sending" << command;
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Sending" << command;
     if (!isConnected()) {
-        qWarning() << "trying to send when unconnected";
+        qCWarning(lcMousr) << "trying to send when unconnected";
         return false;
     }
 
@@ -106,7 +207,7 @@ void MousrHandler::rotate(const LeftOrRight direction)
     setAngle(angle() + rotation);
 }
 
-void MousrHandler::sendInput()
+void MousrHandler::sendInput(const bool force)
 {
     // Extremely inefficient way to do it
     while (m_newInput.angle < 0) {
@@ -114,31 +215,48 @@ void MousrHandler::sendInput()
     }
     m_newInput.angle = int(qRound(m_newInput.angle)) % 360;
 
-    const bool angleChanged = !qFuzzyCompare(m_currentInput.angle, m_newInput.angle);
-    const bool speedChanged = !qFuzzyCompare(m_currentInput.speed, m_newInput.speed);
+    // Skip changes too small for the robot to actually do anything different,
+    // but always send when it should stop
+    float angleDelta = qAbs(m_currentInput.angle - m_newInput.angle);
+    if (angleDelta > 180.f) {
+        angleDelta = 360.f - angleDelta;
+    }
+    const bool stopping = qFuzzyIsNull(m_newInput.speed) && !qFuzzyIsNull(m_currentInput.speed);
+    const bool angleChanged = angleDelta >= m_inputAngleThreshold;
+    const bool speedChanged = stopping || qAbs(m_currentInput.speed - m_newInput.speed) >= m_inputSpeedThreshold;
     const bool heldChanged = !qFuzzyCompare(m_currentInput.held, m_newInput.held);
-    if (!angleChanged && !speedChanged && !heldChanged) {
-        qDebug() << " ! Nothing in the input changed";
+    if (!force && !angleChanged && !speedChanged && !heldChanged) {
+        PROTOCOL_TRACE(lcMousrProtocol) << " ! Nothing in the input changed";
+
+        // So the robot ends up where the input stopped, even if it got there in small steps
+        const bool anythingChanged = angleDelta > 0.f ||
+            m_currentInput.speed != m_newInput.speed ||
+            m_currentInput.held != m_newInput.held;
+        if (anythingChanged) {
+            m_trailingInputTimer.start();
+        }
         return;
     }
+    m_trailingInputTimer.stop();
 
-    if (1) {
-        qDebug() << " + Sending updated input";
-        qDebug() << "  - Previous:";
-        if (angleChanged) qDebug() << "   - angle:" << m_currentInput.angle;
-        if (speedChanged) qDebug() << "   - speed:" << m_currentInput.speed;
-        if (heldChanged) qDebug() << "   - held:" << m_currentInput.held;
+    PROTOCOL_TRACE(lcMousrProtocol) << " + Sending updated input";
+    PROTOCOL_TRACE(lcMousrProtocol) << "  - Previous:";
+    if (angleChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - angle:" << m_currentInput.angle;
+    if (speedChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - speed:" << m_currentInput.speed;
+    if (heldChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - held:" << m_currentInput.held;
 
-        qDebug() << "  - New:";
-        if (angleChanged) qDebug() << "   - angle:" << m_newInput.angle;
-        if (speedChanged) qDebug() << "   - speed:" << m_newInput.speed;
-        if (heldChanged) qDebug() << "   - held:" << m_newInput.held;
-    }
+    PROTOCOL_TRACE(lcMousrProtocol) << "  - New:";
+    if (angleChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - angle:" << m_newInput.angle;
+    if (speedChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - speed:" << m_newInput.speed;
+    if (heldChanged) PROTOCOL_TRACE(lcMousrProtocol) << "   - held:" << m_newInput.held;
 
     CommandPacket packet(CommandType::Move);
     packet.input = m_newInput;
     m_currentInput = m_newInput;
     sendCommandPacket(packet);
+
+    m_pose->setTargetHeading(m_currentInput.angle);
+    m_pose->setSpeed(qFuzzyIsNull(m_currentInput.held) ? 0.f : m_currentInput.speed);
 }
 
 void MousrHandler::sendAutoplay()
@@ -158,8 +276,10 @@ void MousrHandler::sendDriverAssistConfig()
 void MousrHandler::resetHeading()
 {
     m_sendInputTimer.stop();
+    m_trailingInputTimer.stop();
     m_currentInput.reset();
     m_newInput.reset();
+    m_pose->setSpeed(0.f);
 
     CommandPacket packet(CommandType::ResetHeading);
     packet.input = m_newInput;
@@ -169,6 +289,7 @@ void MousrHandler::resetHeading()
 void MousrHandler::stop()
 {
     m_sendInputTimer.stop();
+    m_trailingInputTimer.stop();
 
     m_newInput.speed = 0.f;
 
@@ -178,6 +299,8 @@ void MousrHandler::stop()
     packet.input = m_newInput;
     sendCommandPacket(packet);
 
+    m_pose->setSpeed(0.f);
+
     emit inputChanged();
 }
 
@@ -185,7 +308,7 @@ void MousrHandler::onInitComplete()
 {
     // We can't read this from the device, so make sure we are in sync by always settings it
     if (!sendCommand(CommandType::SoundVolume, m_volume)) {
-        qWarning() << "Failed to set sound volume";
+        qCWarning(lcMousr) << "Failed to set sound volume";
     }
 }
 
@@ -208,8 +331,10 @@ void MousrHandler::flip()
 void MousrHandler::flickTail()
 {
     m_sendInputTimer.stop();
+    m_trailingInputTimer.stop();
     m_currentInput.reset();
     m_newInput.reset();
+    m_pose->setSpeed(0.f);
 
     CommandPacket packet(CommandType::FlickSignal);
     packet.flick = AutoplayConfig::ChaseTail;
@@ -219,73 +344,147 @@ void MousrHandler::flickTail()
 MousrHandler::MousrHandler(const QBluetoothDeviceInfo &deviceInfo, QObject *parent) :
     QObject(parent),
     m_name(deviceInfo.name())
+{
+    initialize();
+
+    m_deviceController = QLowEnergyController::createCentral(deviceInfo, this);
+
+    connect(m_deviceController, &QLowEnergyController::connected, m_deviceController, &QLowEnergyController::discoverServices);
+    connect(m_deviceController, &QLowEnergyController::serviceDiscovered, this, &MousrHandler::onServiceDiscovered);
+
+    connect(m_deviceController, &QLowEnergyController::connectionUpdated, this, &MousrHandler::onConnectionUpdated);
+    connect(m_deviceController, &QLowEnergyController::connected, this, []() {
+            qCDebug(lcMousr) << " - controller connected";
+            });
+    connect(m_deviceController, &QLowEnergyController::disconnected, this, []() {
+            qCDebug(lcMousr) << " - controller disconnected";
+            });
+    connect(m_deviceController, &QLowEnergyController::discoveryFinished, this, []() {
+            qCDebug(lcMousr) << " - controller discovery finished";
+            });
+    connect(m_deviceController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::error), this, &MousrHandler::onControllerError);
+
+    connect(m_deviceController, &QLowEnergyController::stateChanged, this, &MousrHandler::onControllerStateChanged);
+
+    m_deviceController->connectToDevice();
+
+    if (m_deviceController->error() != QLowEnergyController::NoError) {
+        qCDebug(lcMousr) << "controller error when starting:" << m_deviceController->error() << m_deviceController->errorString();
+    }
+}
+
+MousrHandler::MousrHandler(transport::Transport *transport, QObject *parent) :
+    QObject(parent),
+    m_transport(transport),
+    m_name(transport->name())
+{
+    initialize();
+
+    m_transport->setParent(this);
+
+    connect(m_transport, &transport::Transport::connected, this, &MousrHandler::startSession);
+    connect(m_transport, &transport::Transport::disconnected, this, &MousrHandler::disconnected);
+    connect(m_transport, &transport::Transport::disconnected, this, &MousrHandler::connectedChanged);
+    connect(m_transport, &transport::Transport::received, this, &MousrHandler::handleData);
+    connect(m_transport, &transport::Transport::written, this, &MousrHandler::onCommandWritten);
+    connect(m_transport, &transport::Transport::connectionIntervalChanged, this, &MousrHandler::setConnectionInterval);
+
+    m_transport->connectToRobot();
+}
+
+void MousrHandler::initialize()
 {
     QSettings settings;
     settings.beginGroup("mousr");
     m_volume = settings.value("volume", 25).toInt();
 
+    // Don't send faster than this even if the connection allows it, adjusted to the connection interval when we know it
+    m_minInputInterval = settings.value("minInputInterval", 10).toInt();
+    m_inputAngleThreshold = settings.value("inputAngleThreshold", 1.).toFloat();
+    m_inputSpeedThreshold = settings.value("inputSpeedThreshold", 0.02).toFloat();
+
+    m_pose = new PoseEstimator(this);
+
     m_newAutoConfig = AutoplayConfig::createConfig(AutoplayConfig::OpenWanderAggressive);
-    qDebug() << m_newAutoConfig;
+    qCDebug(lcMousr) << m_newAutoConfig;
     // In case the UI asks us to update more than 100 times a second
-    m_sendInputTimer.setInterval(10);
+    m_sendInputTimer.setInterval(m_minInputInterval);
     m_sendInputTimer.setSingleShot(true);
     connect(this, &MousrHandler::inputChanged, &m_sendInputTimer, [this]() {
         if (!m_sendInputTimer.isActive()) {
             m_sendInputTimer.start();
         }
     });
-    connect(&m_sendInputTimer, &QTimer::timeout, this, &MousrHandler::sendInput);
-
-    connect(this, &MousrHandler::driverAssistChanged, this, &MousrHandler::sendDriverAssistConfig);
+    connect(&m_sendInputTimer, &QTimer::timeout, this, [this]() {
+        sendInput();
+    });
 
-    m_deviceController = QLowEnergyController::createCentral(deviceInfo, this);
+    m_trailingInputTimer.setInterval(100);
+    m_trailingInputTimer.setSingleShot(true);
+    connect(&m_trailingInputTimer, &QTimer::timeout, this, [this]() {
+        sendInput(true);
+    });
 
-    connect(m_deviceController, &QLowEnergyController::connected, m_deviceController, &QLowEnergyController::discoverServices);
-    connect(m_deviceController, &QLowEnergyController::serviceDiscovered, this, &MousrHandler::onServiceDiscovered);
+    connect(this, &MousrHandler::driverAssistChanged, this, &MousrHandler::sendDriverAssistConfig);
 
-    connect(m_deviceController, &QLowEnergyController::connectionUpdated, this, [](const QLowEnergyConnectionParameters &parms) {
-            qDebug() << " - controller connection updated, latency" << parms.latency() << "maxinterval:" << parms.maximumInterval() << "mininterval:" << parms.minimumInterval() << "supervision timeout" << parms.supervisionTimeout();
-            });
-    connect(m_deviceController, &QLowEnergyController::connected, this, []() {
-            qDebug() << " - controller connected";
-            });
-    connect(m_deviceController, &QLowEnergyController::disconnected, this, []() {
-            qDebug() << " - controller disconnected";
-            });
-    connect(m_deviceController, &QLowEnergyController::discoveryFinished, this, []() {
-            qDebug() << " - controller discovery finished";
-            });
-    connect(m_deviceController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::error), this, &MousrHandler::onControllerError);
+    // In case we never get the write ack
+    m_writeTimeoutTimer.setInterval(500);
+    m_writeTimeoutTimer.setSingleShot(true);
+    connect(&m_writeTimeoutTimer, &QTimer::timeout, this, [this]() {
+        qCWarning(lcMousr) << "Timed out waiting for write, sending next";
+        m_writeInFlight = false;
+        sendQueuedCommand();
+    });
 
-    connect(m_deviceController, &QLowEnergyController::stateChanged, this, &MousrHandler::onControllerStateChanged);
     connect(this, &MousrHandler::initComplete, this, &MousrHandler::resetHeading);
     connect(this, &MousrHandler::initComplete, this, &MousrHandler::sendDriverAssistConfig);
     connect(this, &MousrHandler::initComplete, this, &MousrHandler::resetTail);
     connect(this, &MousrHandler::initComplete, this, &MousrHandler::onInitComplete);
+}
 
-    m_deviceController->connectToDevice();
-
-    if (m_deviceController->error() != QLowEnergyController::NoError) {
-        qDebug() << "controller error when starting:" << m_deviceController->error() << m_deviceController->errorString();
+void MousrHandler::setRecorder(transport::Recorder *recorder)
+{
+    if (m_recorder) {
+        m_recorder->deleteLater();
+    }
+    m_recorder = recorder;
+    if (m_recorder) {
+        m_recorder->setParent(this);
     }
 }
 
 MousrHandler::~MousrHandler()
 {
-    qDebug() << "mousr handler dead";
+    qCDebug(lcMousr) << "mousr handler dead";
     if (!m_isAutoActive && isConnected()) {
+        // Make sure the stop goes out right away
+        m_commandQueue.clear();
+        m_writeInFlight = false;
         stop();
     }
 
-    if (m_deviceController) {
+    if (m_transport) {
+        // We're going away, so don't care about it telling us
+        disconnect(m_transport, nullptr, this, nullptr);
+        m_transport->disconnectFromRobot();
+    } else if (m_deviceController) {
         m_deviceController->disconnectFromDevice();
     } else {
-        qWarning() << "no controller";
+        qCWarning(lcMousr) << "no controller";
     }
 }
 
+QObject *MousrHandler::pose() const
+{
+    return m_pose;
+}
+
 bool MousrHandler::isConnected()
 {
+    if (m_transport) {
+        return m_transport->isConnected();
+    }
+
     return m_deviceController && m_deviceController->state() != QLowEnergyController::UnconnectedState &&
             m_service && m_writeCharacteristic.isValid() && m_readCharacteristic.isValid();
 
@@ -311,31 +510,35 @@ void MousrHandler::onServiceDiscovered(const QBluetoothUuid &newService)
     static const QBluetoothUuid serviceUuid        = QUuid("{6e400001-b5a3-f393-e0a9-e50e24dcca9e}");
 
     if (newService == genericServiceUuid) {
-        qDebug() << "Got generic service uuid, for when services change, should probably connect to this to update our connections or something" << newService;
+        qCDebug(lcMousr) << "Got generic service uuid, for when services change, should probably connect to this to update our connections or something" << newService;
         return;
     }
 
     if (newService == dfuServiceUuid) {
         // Read:         8ec90001-f315-4f60-9fb8-838830daea50
         // Write:        8ec90002-f315-4f60-9fb8-838830daea50
-        qDebug() << "TODO: firmware update mode";
+        qCDebug(lcMousr) << "TODO: firmware update mode";
         return;
     }
 
     if (newService != serviceUuid) {
-        qWarning() << "discovered unhandled service" << newService << "expected" << serviceUuid;
+        qCWarning(lcMousr) << "discovered unhandled service" << newService << "expected" << serviceUuid;
         return;
     }
 
-    //qDebug() << "Found correct service";
+    //qCDebug(lcMousr) << "Found correct service";
     if (m_service) {
         m_service->deleteLater();
     }
 
     m_service = m_deviceController->createServiceObject(newService, this);
-    //qDebug() << "got service:"  << m_service->serviceName() << m_service->serviceUuid();
+    //qCDebug(lcMousr) << "got service:"  << m_service->serviceName() << m_service->serviceUuid();
+
+    m_commandQueue.clear();
+    m_writeInFlight = false;
 
     connect(m_service, &QLowEnergyService::characteristicChanged, this, &MousrHandler::onCharacteristicChanged);
+    connect(m_service, &QLowEnergyService::characteristicWritten, this, &MousrHandler::onCharacteristicWritten);
 
     connect(m_service, QOverload<QLowEnergyService::ServiceError>::of(&QLowEnergyService::error), this, &MousrHandler::onServiceError);
     connect(m_service, &QLowEnergyService::stateChanged, this, &MousrHandler::onServiceStateChanged);
@@ -349,7 +552,7 @@ void MousrHandler::onServiceStateChanged(QLowEnergyService::ServiceState newStat
     static const QUuid readUuid  = "{6e400003-b5a3-f393-e0a9-e50e24dcca9e}";
 
     if (newState == QLowEnergyService::InvalidService) {
-        qWarning() << "Got invalid service";
+        qCWarning(lcMousr) << "Got invalid service";
         emit disconnected();
         return;
     }
@@ -360,12 +563,12 @@ void MousrHandler::onServiceStateChanged(QLowEnergyService::ServiceState newStat
 
 
     if (newState != QLowEnergyService::ServiceDiscovered) {
-        qDebug() << "unhandled service state changed:" << newState;
+        qCDebug(lcMousr) << "unhandled service state changed:" << newState;
         return;
     }
 
 //    for (const QLowEnergyCharacteristic &c : m_service->characteristics()) {
-//        qDebug() << "characteristic available:" << c.name() << c.uuid() << c.properties();
+//        qCDebug(lcMousr) << "characteristic available:" << c.name() << c.uuid() << c.properties();
 //    }
 
     m_readCharacteristic = m_service->characteristic(readUuid);
@@ -373,23 +576,32 @@ void MousrHandler::onServiceStateChanged(QLowEnergyService::ServiceState newStat
     if (!m_readCharacteristic.descriptors().isEmpty()) {
         m_readDescriptor = m_readCharacteristic.descriptors().first();
     } else {
-        qWarning() << "No read characteristic";
+        qCWarning(lcMousr) << "No read characteristic";
     }
 
     if (!isConnected()) {
-        qDebug() << "Finished scanning, but not valid";
+        qCDebug(lcMousr) << "Finished scanning, but not valid";
         emit disconnected();
         return;
     }
 
-    qDebug() << "Successfully connected";
+    qCDebug(lcMousr) << "Successfully connected";
 
     // Who the _fuck_ designed this API, requiring me to write magic bytes to a
     // fucking read descriptor to get characteristicChanged to work?
     m_service->writeDescriptor(m_readDescriptor, QByteArray::fromHex("0100"));
 
+    emit connectionEstablished();
+    startSession();
+}
+
+void MousrHandler::startSession()
+{
+    m_commandQueue.clear();
+    m_writeInFlight = false;
+
     if (!sendCommand(CommandType::InitializeDevice, mbApiVersion, quint32(QDateTime::currentSecsSinceEpoch()))) {
-        qWarning() << "Failed to send init command";
+        qCWarning(lcMousr) << "Failed to send init command";
     }
 
     emit connectedChanged();
@@ -399,29 +611,29 @@ void MousrHandler::chirp()
 {
     const int soundClip = 6; // todo: discover if there are more clips stored
     if (!sendCommand(CommandType::Chirp, 0, soundClip)) {
-        qWarning() << "Failed to request chirp";
+        qCWarning(lcMousr) << "Failed to request chirp";
     }
 }
 
 void MousrHandler::pause()
 {
     if (!sendCommandPacket(CommandPacket(CommandType::Stop))) {
-        qWarning() << "Failed to request stop";
+        qCWarning(lcMousr) << "Failed to request stop";
     }
 }
 
 void MousrHandler::setSoundVolume(const int volumePercent)
 {
     if (volumePercent < 0 || volumePercent > 100) {
-        qWarning() << "Invalid volume";
+        qCWarning(lcMousr) << "Invalid volume";
         return;
     }
 
     if (volumePercent == m_volume) {
-        qDebug() << "Tryingto set same value" << volumePercent;
+        qCDebug(lcMousr) << "Tryingto set same value" << volumePercent;
         return;
     }
-    qDebug() << "Setting value to" << volumePercent;
+    qCDebug(lcMousr) << "Setting value to" << volumePercent;
 
     if (sendCommand(CommandType::SoundVolume, volumePercent)) {
         m_volume = volumePercent;
@@ -436,7 +648,7 @@ void MousrHandler::setSoundVolume(const int volumePercent)
 void MousrHandler::setAutoPlay(const bool enabled)
 {
     if (enabled == m_isAutoActive) {
-        qWarning() << "already same state!" << enabled << m_currentAutoConfig << m_isAutoActive;
+        qCWarning(lcMousr) << "already same state!" << enabled << m_currentAutoConfig << m_isAutoActive;
     }
     m_newAutoConfig.enabled = enabled ? 1 : 0;
     sendAutoplay();
@@ -445,19 +657,34 @@ void MousrHandler::setAutoPlay(const bool enabled)
 void MousrHandler::onControllerStateChanged(QLowEnergyController::ControllerState state)
 {
     if (state == QLowEnergyController::UnconnectedState) {
-        qWarning() << "Disconnected";
+        qCWarning(lcMousr) << "Disconnected";
         emit disconnected();
     }
 
-    qWarning() << " ! controller state changed" << state;
+    qCWarning(lcMousr) << " ! controller state changed" << state;
     emit connectedChanged();
 }
 
+void MousrHandler::onConnectionUpdated(const QLowEnergyConnectionParameters &parms)
+{
+    qCDebug(lcMousr) << " - controller connection updated, latency" << parms.latency() << "maxinterval:" << parms.maximumInterval() << "mininterval:" << parms.minimumInterval() << "supervision timeout" << parms.supervisionTimeout();
+
+    setConnectionInterval(qCeil(parms.maximumInterval()));
+}
+
+void MousrHandler::setConnectionInterval(const int milliseconds)
+{
+    // Anything faster than the connection interval just piles up in BlueZ
+    const int interval = qBound(m_minInputInterval, milliseconds, 100);
+    qCDebug(lcMousr) << " - sending input every" << interval << "ms";
+    m_sendInputTimer.setInterval(interval);
+}
+
 void MousrHandler::onControllerError(QLowEnergyController::Error newError)
 {
-    qWarning() << " - controller error:" << newError << m_deviceController->errorString();
+    qCWarning(lcMousr) << " - controller error:" << newError << m_deviceController->errorString();
     if (newError == QLowEnergyController::UnknownError) {
-        qWarning() << "Probably 'Operation already in progress' because qtbluetooth doesn't understand why it can't get answers over dbus when a connection attempt hangs";
+        qCWarning(lcMousr) << "Probably 'Operation already in progress' because qtbluetooth doesn't understand why it can't get answers over dbus when a connection attempt hangs";
     }
     connect(m_deviceController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::error), this, &MousrHandler::onControllerError);
 }
@@ -465,203 +692,288 @@ void MousrHandler::onControllerError(QLowEnergyController::Error newError)
 
 void MousrHandler::onServiceError(QLowEnergyService::ServiceError error)
 {
-    qWarning() << "Service error:" << error;
+    qCWarning(lcMousr) << "Service error:" << error;
     if (error == QLowEnergyService::NoError) {
         return;
     }
 
+    // We won't get a characteristicWritten for it, so don't wait for the timeout
+    if (error == QLowEnergyService::CharacteristicWriteError) {
+        onCommandWritten();
+        return;
+    }
+
     emit disconnected();
 }
 
 void MousrHandler::onCharacteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &data)
 {
     if (characteristic != m_readCharacteristic) {
-        qWarning() << "changed from unexpected characteristic" << characteristic.uuid() << data;
+        if (m_recorder) {
+            m_recorder->record(transport::Recorder::Received, characteristic.uuid(), data, false);
+        }
+        qCWarning(lcMousr) << "changed from unexpected characteristic" << characteristic.uuid() << data;
         return;
     }
 
+    handleData(data);
+}
+
+void MousrHandler::handleData(const QByteArray &data)
+{
+    // Null UUID if we're talking through a transport
+    if (m_recorder) {
+        m_recorder->record(transport::Recorder::Received, m_readCharacteristic.uuid(), data, true);
+    }
+
     if (data.size() != sizeof(ResponsePacket)) {
-        qWarning() << "invalid packet size" << data.size() << "expected" << sizeof(ResponsePacket);
+        qCWarning(lcMousr) << "invalid packet size" << data.size() << "expected" << sizeof(ResponsePacket);
         return;
     }
 
 
     ResponsePacket response;
-    qFromLittleEndian<ResponsePacket>(data.data(), 1, &response);
+    qFromLittleEndian<ResponsePacket>(data.constData(), 1, &response);
 
-    const QString responseName = EnumHelper::toString(ResponseType(response.type));
+    const ResponseDispatch &dispatch = s_responseDispatch[response.type];
+    if (!dispatch.valid) {
+        PROTOCOL_TRACE(lcMousrProtocol) << "Unknown command";
+        PROTOCOL_TRACE(lcMousrProtocol) << response.type << data;
+        return;
+    }
+    PROTOCOL_TRACE(lcMousrProtocol) << "Got response" << ResponseType(response.type);
 
-    if (responseName.isEmpty()) {
-        qDebug() << "Unknown command";
-        qDebug() << response.type << data;
+    if (!dispatch.handler) {
+        qCWarning(lcMousr) << "Unhandled response" << response.type << data.toHex(':');
         return;
     }
-    //qDebug() << "Got response" << ResponseType(response.type);
 
+    (this->*dispatch.handler)(response, data);
+}
 
-    switch(response.type){
-    case DeviceOrientation: {
-        for (int i=0; i<4; i++) {
-            if (response.orientation.padding[i]) {
-                qDebug() << "orientation padding" << i << int(response.orientation.padding[i]);
-            }
-        }
-        m_waitingForOrientationChange = false;
-        if (!fuzzyVectorsEqual(response.orientation.rotation, m_rotation) || m_tailRotation != response.orientation.tailRotation) {
-            //qDebug() << " + Orientation change:";
-            //qDebug() << "   - x:" << m_rotation.x << "y:" << m_rotation.y << "z:" << m_rotation.z;
-            m_rotation = response.orientation.rotation;
-            m_tailRotation = response.orientation.tailRotation;
-            emit orientationChanged();
-        }
-        if (response.orientation.isFlipped != m_isFlipped) {
-            m_isFlipped = response.orientation.isFlipped;
-            emit orientationChanged();
-        }
+constexpr std::array<MousrHandler::ResponseDispatch, 256> MousrHandler::createResponseDispatch()
+{
+    std::array<ResponseDispatch, 256> table{};
+    auto add = [&table](const ResponseType type, const ResponseHandler handler) {
+        table[type] = { handler, true };
+    };
 
-        break;
-    }
-    case BatteryVoltage:{
-        if (response.battery.isAutoMode != m_isAutoActive) {
-            qDebug() << " + Auto status changed:";
-            qDebug() << "  - New:" << response.battery.isAutoMode;
-            m_isAutoActive = response.battery.isAutoMode;
-            emit autoRunningChanged();
-        }
+    add(AutoModeChanged, &MousrHandler::handleAutoModeChanged);
+
+    add(FirmwareVersion, &MousrHandler::handleFirmwareVersion);
+    add(HardwareVersion, nullptr);
+    add(InitDone, &MousrHandler::handleInitDone);
+
+    add(DeviceOrientation, &MousrHandler::handleDeviceOrientation);
+    add(AutoAckReport, nullptr);
+    add(TailStateUpdated, &MousrHandler::handleTailStateUpdated);
+
+    add(SensorDirty, &MousrHandler::handleSensorDirty);
+
+    add(AnalyticsBegin, &MousrHandler::handleAnalyticsBegin);
+
+    ///////////////// ANALYTICS: Who Gives A Shit™ ///////////////////////
+    // Analytics: fragmented packages, single byte header in each, and CRC at the end of all I think
+    // That's how it looks at least, and a readable ascii string for what it is
+    add(AnalyticsData, &MousrHandler::ignoreResponse);
+    add(AnalyticsEntry, &MousrHandler::ignoreResponse); // TODO: debug log text I think
+    add(AnalyticsEnd, &MousrHandler::ignoreResponse);
+
+    add(CrashLogFinished, &MousrHandler::handleCrashLogFinished);
+    add(CrashLogString, &MousrHandler::handleCrashLogString);
+    add(DebugInfo, nullptr);
+
+    add(BatteryVoltage, &MousrHandler::handleBatteryVoltage);
+    add(RobotStopped, &MousrHandler::handleRobotStopped);
+    add(RcStuck, &MousrHandler::handleRcStuck);
+
+    add(CommandCompleted, &MousrHandler::handleCommandCompleted);
+
+    return table;
+}
 
-        const bool differentValues =
-                response.battery.voltage != m_voltage ||
-                response.battery.isBatteryLow != m_batteryLow ||
-                response.battery.isCharging != m_charging ||
-                response.battery.isFullyCharged != m_fullyCharged ||
-                response.battery.memory != m_memory;
-
-        if (differentValues) {
-            qDebug() << " + Battery changed";
-            qDebug() << "  - New:";
-            qDebug() << "    - voltage:" << response.battery.voltage;
-            qDebug() << "    - battery low:" << response.battery.isBatteryLow;
-            qDebug() << "    - isCharging:" << response.battery.isCharging;
-            qDebug() << "    - isFullyCharged:" << response.battery.isFullyCharged;
-            qDebug() << "    - memory:" << response.battery.memory;
-
-            // Voltage seems to be percent? wtf
-            m_voltage = response.battery.voltage;
-            m_batteryLow = response.battery.isBatteryLow;
-            m_charging = response.battery.isCharging;
-            m_fullyCharged = response.battery.isFullyCharged;
-            m_memory = response.battery.memory;
-            emit powerChanged();
+const std::array<MousrHandler::ResponseDispatch, 256> MousrHandler::s_responseDispatch = MousrHandler::createResponseDispatch();
 
+void MousrHandler::handleDeviceOrientation(const ResponsePacket &response, const QByteArray &)
+{
+    for (int i=0; i<4; i++) {
+        if (response.orientation.padding[i]) {
+            PROTOCOL_TRACE(lcMousrProtocol) << "orientation padding" << i << int(response.orientation.padding[i]);
         }
+    }
+    m_waitingForOrientationChange = false;
 
-        break;
+    // Even if it's the same, so it knows it stopped turning
+    m_pose->addHeading(response.orientation.rotation.z);
+
+    // Everything shares the same signal, so only emit it once per packet
+    bool changed = false;
+    if (!fuzzyVectorsEqual(response.orientation.rotation, m_rotation) || m_tailRotation != response.orientation.tailRotation) {
+        //qCDebug(lcMousr) << " + Orientation change:";
+        //qCDebug(lcMousr) << "   - x:" << m_rotation.x << "y:" << m_rotation.y << "z:" << m_rotation.z;
+        m_rotation = response.orientation.rotation;
+        m_tailRotation = response.orientation.tailRotation;
+        changed = true;
     }
-    case CrashLogString: {
-        const QString crashLog = response.crashString.message();
-        qDebug() << " + Crash log string:" << crashLog;
-        if (crashLog != "No crash log.") {
-            qDebug() << " Crash log string:" << crashLog;
-        }
-        break;
+    if (response.orientation.isFlipped != m_isFlipped) {
+        m_isFlipped = response.orientation.isFlipped;
+        changed = true;
     }
-    case CrashLogFinished:
-        qDebug() << response.type;
-        break;
-    case AnalyticsBegin: {
-        int numberOfEntries = response.analyticsBegin.numberOfEntries;
-        qDebug() << " + Number of analytics entries:" << numberOfEntries;
-        break;
+
+    if (changed) {
+        emit orientationChanged();
     }
-    case SensorDirty: {
-        m_sensorDirty = response.sensorDirty.isDirty;
-        emit sensorDirtyChanged();
-        break;
+}
+
+void MousrHandler::handleBatteryVoltage(const ResponsePacket &response, const QByteArray &)
+{
+    if (response.battery.isAutoMode != m_isAutoActive) {
+        qCDebug(lcMousr) << " + Auto status changed:";
+        qCDebug(lcMousr) << "  - New:" << response.battery.isAutoMode;
+        m_isAutoActive = response.battery.isAutoMode;
+        emit autoRunningChanged();
+    }
+
+    const bool differentValues =
+            response.battery.voltage != m_voltage ||
+            response.battery.isBatteryLow != m_batteryLow ||
+            response.battery.isCharging != m_charging ||
+            response.battery.isFullyCharged != m_fullyCharged ||
+            response.battery.memory != m_memory;
+
+    if (differentValues) {
+        qCDebug(lcMousr) << " + Battery changed";
+        qCDebug(lcMousr) << "  - New:";
+        qCDebug(lcMousr) << "    - voltage:" << response.battery.voltage;
+        qCDebug(lcMousr) << "    - battery low:" << response.battery.isBatteryLow;
+        qCDebug(lcMousr) << "    - isCharging:" << response.battery.isCharging;
+        qCDebug(lcMousr) << "    - isFullyCharged:" << response.battery.isFullyCharged;
+        qCDebug(lcMousr) << "    - memory:" << response.battery.memory;
+
+        // Voltage seems to be percent? wtf
+        m_voltage = response.battery.voltage;
+        m_batteryLow = response.battery.isBatteryLow;
+        m_charging = response.battery.isCharging;
+        m_fullyCharged = response.battery.isFullyCharged;
+        m_memory = response.battery.memory;
+        emit powerChanged();
+
     }
-    case RcStuck: {
-        m_isStuck = response.stuck.stuckType != 0 ? true : false;
-        emit stuckChanged();
-        qDebug() << " ! Device stuck";
-        qDebug() << "  - unknown stuckType:" << AnalyticsEvent(response.stuck.stuckType) << response.stuck.stuckType;
-        qDebug() << "  - data: " << response.type << data.mid(1).toHex(':');
-        break;
+}
+
+void MousrHandler::handleCrashLogString(const ResponsePacket &response, const QByteArray &)
+{
+    const QString crashLog = response.crashString.message();
+    qCDebug(lcMousr) << " + Crash log string:" << crashLog;
+    if (crashLog != "No crash log.") {
+        qCDebug(lcMousr) << " Crash log string:" << crashLog;
     }
-    case TailStateUpdated: {
-        if (response.tail.failState) {
-            emit tailFailed();
-        }
-        qDebug() << " + Tail state" << (response.tail.failState ? "Fail" : "OK");
-        break;
+}
+
+void MousrHandler::handleCrashLogFinished(const ResponsePacket &response, const QByteArray &)
+{
+    PROTOCOL_TRACE(lcMousrProtocol) << response.type;
+}
+
+void MousrHandler::handleAnalyticsBegin(const ResponsePacket &response, const QByteArray &)
+{
+    int numberOfEntries = response.analyticsBegin.numberOfEntries;
+    qCDebug(lcMousr) << " + Number of analytics entries:" << numberOfEntries;
+}
+
+void MousrHandler::handleSensorDirty(const ResponsePacket &response, const QByteArray &)
+{
+    if (response.sensorDirty.isDirty == m_sensorDirty) {
+        return;
     }
-    case RobotStopped: {
-        m_currentInput.speed = 0;
-        emit inputChanged();
-        break;
+    m_sensorDirty = response.sensorDirty.isDirty;
+    emit sensorDirtyChanged();
+}
+
+void MousrHandler::handleRcStuck(const ResponsePacket &response, const QByteArray &data)
+{
+    const bool isStuck = response.stuck.stuckType != 0 ? true : false;
+    if (isStuck != m_isStuck) {
+        m_isStuck = isStuck;
+        emit stuckChanged();
     }
-    case AutoModeChanged: {
-        qDebug() << " + Auto mode changed";
-        m_currentAutoConfig = std::move(response.autoPlay.config);
-        qDebug() << "   - " <<  m_currentAutoConfig;
-        emit autoPlayChanged();
-        break;
+    qCDebug(lcMousr) << " ! Device stuck";
+    qCDebug(lcMousr) << "  - unknown stuckType:" << AnalyticsEvent(response.stuck.stuckType) << response.stuck.stuckType;
+    qCDebug(lcMousr) << "  - data: " << response.type << data.mid(1).toHex(':');
+}
+
+void MousrHandler::handleTailStateUpdated(const ResponsePacket &response, const QByteArray &)
+{
+    if (response.tail.failState) {
+        emit tailFailed();
     }
+    qCDebug(lcMousr) << " + Tail state" << (response.tail.failState ? "Fail" : "OK");
+}
 
-        ///////////////// ANALYTICS: Who Gives A Shit™ ///////////////////////
-        // Analytics: fragmented packages, single byte header in each, and CRC at the end of all I think
-        // That's how it looks at least, and a readable ascii string for what it is
-    case AnalyticsData:
-    case AnalyticsEntry: // TODO: debug log text I think
-    case AnalyticsEnd:
-        break;
+void MousrHandler::handleRobotStopped(const ResponsePacket &, const QByteArray &)
+{
+    m_currentInput.speed = 0;
+    m_pose->setSpeed(0.f);
+    emit inputChanged();
+}
 
-    case InitDone:
-        qDebug() << "Init complete";
-        break;
+void MousrHandler::handleAutoModeChanged(const ResponsePacket &response, const QByteArray &)
+{
+    qCDebug(lcMousr) << " + Auto mode changed";
+    m_currentAutoConfig = response.autoPlay.config;
+    qCDebug(lcMousr) << "   - " <<  m_currentAutoConfig;
+    emit autoPlayChanged();
+}
+
+void MousrHandler::handleInitDone(const ResponsePacket &, const QByteArray &)
+{
+    qCDebug(lcMousr) << "Init complete";
+}
+
+void MousrHandler::handleFirmwareVersion(const ResponsePacket &response, const QByteArray &)
+{
+    m_version = response.firmwareVersion;
 
-    case FirmwareVersion: {
-        m_version = response.firmwareVersion;
+    qCDebug(lcMousr) << " + Firmware version response";
+    qCDebug(lcMousr) << "   - Firmware mode:" << m_version.firmwareType;
+    qCDebug(lcMousr).noquote() << "  - Version" << (QByteArray::number(m_version.major) + "." + QByteArray::number(m_version.minor) + "." + QByteArray::number(m_version.commitNumber) + "-" + QByteArray(m_version.commitHash, 4).toHex());
+    qCDebug(lcMousr) << "  - Mousr version" << m_version.mousrVersion << "hardware version" << m_version.hardwareVersion << "bootloader version" << m_version.bootloaderVersion;
+}
 
-        qDebug() << " + Firmware version response";
-        qDebug() << "   - Firmware mode:" << m_version.firmwareType;
-        qDebug().noquote() << "  - Version" << (QByteArray::number(m_version.major) + "." + QByteArray::number(m_version.minor) + "." + QByteArray::number(m_version.commitNumber) + "-" + QByteArray(m_version.commitHash, 4).toHex());
-        qDebug() << "  - Mousr version" << m_version.mousrVersion << "hardware version" << m_version.hardwareVersion << "bootloader version" << m_version.bootloaderVersion;
+void MousrHandler::handleCommandCompleted(const ResponsePacket &response, const QByteArray &data)
+{
+    PROTOCOL_TRACE(lcMousrProtocol) << sizeof(CommandResult) << data.size();
+    const CommandType command = response.commandResult.commandType;
+    const uint32_t currentApiVer = response.commandResult.currentApiVersion;
+    const uint32_t minApiVer = response.commandResult.minimumApiVersion;
+    const uint32_t maxApiVer = response.commandResult.maximumApiVersion;
+    switch(response.commandResult.commandType) {
+    case CommandType::InitializeDevice:
+        emit initComplete();
         break;
-    }
-    case CommandCompleted: {
-        qDebug() << sizeof(CommandResult) << data.size();
-        const CommandType command = response.commandResult.commandType;
-        const uint32_t currentApiVer = response.commandResult.currentApiVersion;
-        const uint32_t minApiVer = response.commandResult.minimumApiVersion;
-        const uint32_t maxApiVer = response.commandResult.maximumApiVersion;
-        switch(response.commandResult.commandType) {
-        case CommandType::InitializeDevice:
-            emit initComplete();
+    case CommandType::EraseAnalyticsRecords:
+        switch(response.commandResult.resultCode) {
+        case 0:
+            qCDebug(lcMousr) << "Analytics erase succeeded";
             break;
-        case CommandType::EraseAnalyticsRecords:
-            switch(response.commandResult.resultCode) {
-            case 0:
-                qDebug() << "Analytics erase succeeded";
-                break;
-            case -1:
-                qWarning() << "Analytics erase failed";
-                break;
-            default:
-                qWarning() << "unknown result code for erasing analytics" << response.commandResult.resultCode;
-            }
-
+        case -1:
+            qCWarning(lcMousr) << "Analytics erase failed";
             break;
         default:
-            qWarning() << "!! Got NACK for command" << command;
-            qDebug() << "unknown num:" << response.commandResult.resultCode;
-            qDebug() << "Api version current:" << currentApiVer << "min:" << minApiVer << "max:" << maxApiVer;
-            break;
+            qCWarning(lcMousr) << "unknown result code for erasing analytics" << response.commandResult.resultCode;
         }
 
         break;
-    }
     default:
-        qWarning() << "Unhandled response" << response.type << data.toHex(':');
+        qCWarning(lcMousr) << "!! Got NACK for command" << command;
+        qCDebug(lcMousr) << "unknown num:" << response.commandResult.resultCode;
+        qCDebug(lcMousr) << "Api version current:" << currentApiVer << "min:" << minApiVer << "max:" << maxApiVer;
+        break;
     }
 }
 
+void MousrHandler::ignoreResponse(const ResponsePacket &, const QByteArray &)
+{
+}
+
 } // namespace mousr
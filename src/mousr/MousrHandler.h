@@ -9,13 +9,24 @@
 #include <QLowEnergyController>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QVector3D>
+
+#include <array>
 
 class QLowEnergyController;
+class QLowEnergyConnectionParameters;
 class QBluetoothDeviceInfo;
 class QBluetoothUuid;
 
+namespace transport {
+class Recorder;
+class Transport;
+}
+
 namespace mousr {
 
+class PoseEstimator;
+
 static constexpr int manufacturerID = 1500;
 
 template<typename T>
@@ -87,10 +98,16 @@ class MousrHandler : public QObject
     Q_PROPERTY(mousr::AutoplayConfig::DrivingMode autoplayDrivingMode READ autoplayDrivingMode NOTIFY autoPlayChanged)
     Q_PROPERTY(mousr::AutoplayConfig::GameMode autoplayGameMode READ autoplayGameMode WRITE setAutoplayGameMode NOTIFY autoPlayChanged)
     Q_PROPERTY(int autoplayPauseTime READ autoplayPauseTime WRITE setAutoplayPauseTime NOTIFY autoPlayChanged)
+    // Properties instead of methods so the mirror has them, and QML doesn't have to call into the worker thread
+    Q_PROPERTY(QStringList autoplayGameModeNames READ autoplayGameModeNames CONSTANT)
+    Q_PROPERTY(QStringList autoplayDrivingModeNames READ autoplayDrivingModeNames CONSTANT)
 
     Q_PROPERTY(float xRotation READ xRotation NOTIFY orientationChanged)
     Q_PROPERTY(float yRotation READ yRotation NOTIFY orientationChanged)
     Q_PROPERTY(float zRotation READ zRotation NOTIFY orientationChanged)
+    // Same as the above, but the mirror sets the three separately, so bind to this
+    // if you want all of them at once
+    Q_PROPERTY(QVector3D rotation READ rotation NOTIFY orientationChanged)
     Q_PROPERTY(float tailRotation READ tailRotation NOTIFY orientationChanged)
     Q_PROPERTY(bool isFlipped READ isFlipped NOTIFY orientationChanged)
 
@@ -99,6 +116,8 @@ class MousrHandler : public QObject
 
     Q_PROPERTY(int soundVolume READ soundVolume WRITE setSoundVolume NOTIFY soundVolumeChanged)
 
+    Q_PROPERTY(QObject* pose READ pose CONSTANT)
+
 public:
     AutoplayConfig::Surface autoplaySurface() const { return m_currentAutoConfig.surface(); }
     AutoplayConfig::TailType autoplayTailType() const { return m_currentAutoConfig.tailType(); }
@@ -106,11 +125,11 @@ public:
 
     AutoplayConfig::GameMode autoplayGameMode() const { return m_currentAutoConfig.gameMode(); }
     void setAutoplayGameMode(const AutoplayConfig::GameMode mode) { m_newAutoConfig.setGameMode(mode); emit autoPlayChanged(); sendAutoplay(); }
-    Q_INVOKABLE QStringList autoplayGameModeNames() const { return AutoplayConfig::gameModeNames(); }
+    QStringList autoplayGameModeNames() const { return AutoplayConfig::gameModeNames(); }
 
     AutoplayConfig::DrivingMode autoplayDrivingMode() const { return m_currentAutoConfig.drivingMode(); }
     void setAutoplayDrivingMode(const AutoplayConfig::DrivingMode mode) { m_newAutoConfig.setDrivingMode(mode); emit autoPlayChanged(); sendAutoplay(); }
-    Q_INVOKABLE QStringList autoplayDrivingModeNames() const { return AutoplayConfig::drivingModeNames(); }
+    QStringList autoplayDrivingModeNames() const { return AutoplayConfig::drivingModeNames(); }
 
     void setAutoplaySurface(const AutoplayConfig::Surface surface) { m_newAutoConfig.setSurface(surface); emit autoPlayChanged(); sendAutoplay(); }
     void setAutoplayTailType(const AutoplayConfig::TailType tailType) { m_newAutoConfig.setTailType(tailType); emit autoPlayChanged(); sendAutoplay(); }
@@ -287,17 +306,26 @@ public:
     float xRotation() const { return m_rotation.x; }
     float yRotation() const { return m_rotation.y; }
     float zRotation() const { return m_rotation.z; }
+    QVector3D rotation() const { return QVector3D(m_rotation.x, m_rotation.y, m_rotation.z); }
     float tailRotation() const { return (360. * m_tailRotation) / 255.; }
     bool isFlipped() const { return m_isFlipped; }
 
     bool sensorDirty() const { return m_sensorDirty; }
     bool isStuck() const { return m_isStuck; }
 
+    QObject *pose() const;
+
     const uint32_t mbApiVersion = 3u;
 
     explicit MousrHandler(const QBluetoothDeviceInfo &deviceInfo, QObject *parent);
+
+    // Talks through the transport instead of BLE, takes ownership of it
+    explicit MousrHandler(transport::Transport *transport, QObject *parent);
     ~MousrHandler();
 
+    // Writes everything sent and received to a file, takes ownership of it
+    void setRecorder(transport::Recorder *recorder);
+
     bool isConnected();
 
     QString statusString();
@@ -309,6 +337,7 @@ public:
 signals:
     void connectedChanged();
     void disconnected(); // TODO
+    void connectionEstablished(); // all the way through the handshake
     void powerChanged();
     void autoRunningChanged();
     void orientationChanged();
@@ -334,19 +363,29 @@ public slots:
 private slots:
     void onControllerStateChanged(QLowEnergyController::ControllerState state);
     void onControllerError(QLowEnergyController::Error newError);
+    void onConnectionUpdated(const QLowEnergyConnectionParameters &parms);
 
     void onServiceDiscovered(const QBluetoothUuid &newService);
     void onServiceStateChanged(QLowEnergyService::ServiceState newState);
     void onServiceError(QLowEnergyService::ServiceError error);
 
     void onCharacteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &newValue);
+    void onCharacteristicWritten(const QLowEnergyCharacteristic &characteristic);
 
-    void sendInput();
+    void startSession();
+    void handleData(const QByteArray &data);
+    void onCommandWritten();
+    void setConnectionInterval(const int milliseconds);
+
+    // Force sends it even if the change is too small to matter
+    void sendInput(const bool force = false);
     void sendDriverAssistConfig();
 
     void onInitComplete();
 
 private:
+    void initialize();
+
     bool sendCommand(const CommandType command, float arg1, const float arg2, const float arg3);
     bool sendCommand(const CommandType command, const uint32_t arg1, const uint32_t arg2 = 0);
     bool sendCommand(const CommandType command);
@@ -512,6 +551,41 @@ private:
     #pragma pack(pop)
 
     bool sendCommandPacket(const CommandPacket &packet);
+    void sendQueuedCommand();
+
+    void handleDeviceOrientation(const ResponsePacket &response, const QByteArray &data);
+    void handleBatteryVoltage(const ResponsePacket &response, const QByteArray &data);
+    void handleCrashLogString(const ResponsePacket &response, const QByteArray &data);
+    void handleCrashLogFinished(const ResponsePacket &response, const QByteArray &data);
+    void handleAnalyticsBegin(const ResponsePacket &response, const QByteArray &data);
+    void handleSensorDirty(const ResponsePacket &response, const QByteArray &data);
+    void handleRcStuck(const ResponsePacket &response, const QByteArray &data);
+    void handleTailStateUpdated(const ResponsePacket &response, const QByteArray &data);
+    void handleRobotStopped(const ResponsePacket &response, const QByteArray &data);
+    void handleAutoModeChanged(const ResponsePacket &response, const QByteArray &data);
+    void handleInitDone(const ResponsePacket &response, const QByteArray &data);
+    void handleFirmwareVersion(const ResponsePacket &response, const QByteArray &data);
+    void handleCommandCompleted(const ResponsePacket &response, const QByteArray &data);
+    void ignoreResponse(const ResponsePacket &response, const QByteArray &data);
+
+    // Indexed by the response type byte, so we don't have to ask QMetaEnum
+    // whether it is valid for every orientation update.
+    // Valid ones without a handler are known but not handled.
+    using ResponseHandler = void (MousrHandler::*)(const ResponsePacket &response, const QByteArray &data);
+    struct ResponseDispatch {
+        ResponseHandler handler = nullptr;
+        bool valid = false;
+    };
+    static constexpr std::array<ResponseDispatch, 256> createResponseDispatch();
+    static const std::array<ResponseDispatch, 256> s_responseDispatch;
+
+    struct QueuedCommand {
+        CommandType command;
+        QByteArray data;
+    };
+    QList<QueuedCommand> m_commandQueue;
+    bool m_writeInFlight = false;
+    QTimer m_writeTimeoutTimer;
 
     QPointer<QLowEnergyController> m_deviceController;
 
@@ -521,6 +595,9 @@ private:
 
     QPointer<QLowEnergyService> m_service;
 
+    QPointer<transport::Transport> m_transport;
+    transport::Recorder *m_recorder = nullptr;
+
     int m_voltage = 0, m_memory = 0;
     int m_volume = 0;
     bool m_batteryLow = false, m_charging = false, m_fullyCharged = false;
@@ -535,6 +612,8 @@ private:
     bool m_sensorDirty = false;
     bool m_isStuck = false;
 
+    PoseEstimator *m_pose = nullptr;
+
     QString m_name;
 
     AutoplayConfig m_currentAutoConfig;
@@ -542,6 +621,10 @@ private:
     bool m_isAutoActive = false;
     Version m_version;
     QTimer m_sendInputTimer; // so we can batch up input updates
+    QTimer m_trailingInputTimer; // so small changes we skipped still get sent eventually
+    int m_minInputInterval = 10;
+    float m_inputAngleThreshold = 1.f;
+    float m_inputSpeedThreshold = 0.02f;
     DriverAssistMode m_driverAssistMode;
     QElapsedTimer m_lastRotationTimer;
     bool m_waitingForOrientationChange = true;
@@ -0,0 +1,187 @@
+#include "PoseEstimator.h"
+
+#include <QLineF>
+#include <QtMath>
+#include <cmath>
+
+namespace mousr {
+
+namespace {
+
+// Enough to draw, without growing forever
+static constexpr int maxTrajectoryPoints = 1000;
+static constexpr qreal trajectoryResolution = 1.; // cm
+
+// If the reports are further apart than this we don't trust the turn rate
+static constexpr qint64 maxReportInterval = 500; // ms
+
+// When turning towards the target before we have seen it turn
+static constexpr float minTargetTurnRate = 0.09f; // degrees per ms
+
+float normalizedAngle(const float degrees)
+{
+    return std::fmod(std::fmod(degrees, 360.f) + 360.f, 360.f);
+}
+
+// Shortest way around, -180 - 180
+float angleDifference(const float from, const float to)
+{
+    const float difference = normalizedAngle(to - from);
+    return difference > 180.f ? difference - 360.f : difference;
+}
+
+} // namespace
+
+PoseEstimator::PoseEstimator(QObject *parent) :
+    QObject(parent)
+{
+    m_clock.start();
+    m_trajectory.append(m_position);
+
+    // About once per frame, only running when it's moving
+    m_updateTimer.setInterval(16);
+    connect(&m_updateTimer, &QTimer::timeout, this, &PoseEstimator::update);
+}
+
+void PoseEstimator::setMaxSpeed(const float speed)
+{
+    if (qFuzzyCompare(m_maxSpeed, speed)) {
+        return;
+    }
+    if (advance()) {
+        emit poseChanged();
+    }
+    m_maxSpeed = qMax(speed, 0.f);
+    emit maxSpeedChanged();
+}
+
+void PoseEstimator::setSpeed(const float speed)
+{
+    // The distance so far is at the old speed
+    if (advance()) {
+        emit poseChanged();
+    }
+    m_speed = qBound(-1.f, speed, 1.f);
+    updateTimer();
+}
+
+void PoseEstimator::setTargetHeading(const float heading)
+{
+    // Up to now it turned towards the old one
+    if (advance()) {
+        emit poseChanged();
+    }
+    m_hasTargetHeading = true;
+    m_targetHeading = normalizedAngle(heading);
+    updateTimer();
+}
+
+void PoseEstimator::addHeading(float heading)
+{
+    heading = normalizedAngle(heading);
+
+    // Up to now it went where we thought it did
+    advance();
+
+    const qint64 now = m_clock.elapsed();
+    const qint64 interval = now - m_lastReport;
+    if (m_hasHeading && interval > 0 && interval <= maxReportInterval) {
+        m_turnRate = angleDifference(m_reportedHeading, heading) / interval;
+        m_reportInterval = interval;
+    } else {
+        m_turnRate = 0.f;
+        m_reportInterval = 0;
+    }
+
+    m_hasHeading = true;
+    m_reportedHeading = heading;
+    m_lastReport = now;
+
+    // Always emit, advance() might have moved it even if the heading is the same
+    m_heading = heading;
+    emit poseChanged();
+
+    updateTimer();
+}
+
+void PoseEstimator::reset()
+{
+    m_position = QPointF();
+    m_lastTrajectoryPoint = m_position;
+    m_trajectory = { m_position };
+    m_lastUpdate = m_clock.elapsed();
+
+    emit poseChanged();
+    emit trajectoryChanged();
+}
+
+void PoseEstimator::update()
+{
+    if (advance()) {
+        emit poseChanged();
+    }
+    updateTimer();
+}
+
+bool PoseEstimator::advance()
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 elapsed = now - m_lastUpdate;
+    m_lastUpdate = now;
+    if (elapsed <= 0) {
+        return false;
+    }
+
+    bool changed = false;
+
+    const float startHeading = m_heading;
+    if (m_hasTargetHeading && !qFuzzyIsNull(m_speed)) {
+        // Turns towards where we told it to go, as fast as we saw it turning
+        const float remaining = angleDifference(m_heading, m_targetHeading);
+        if (!qFuzzyIsNull(remaining)) {
+            const float maxTurn = qMax(qAbs(m_turnRate), minTargetTurnRate) * elapsed;
+            m_heading = normalizedAngle(m_heading + qBound(-maxTurn, remaining, maxTurn));
+            changed = true;
+        }
+    } else if (!qFuzzyIsNull(m_turnRate)) {
+        // Keep turning like it did, but only until the next report should be here
+        const qint64 turnEnd = m_lastReport + m_reportInterval;
+        const qint64 turning = qMin(now, turnEnd) - qMin(now - elapsed, turnEnd);
+        if (turning > 0) {
+            m_heading = normalizedAngle(m_heading + m_turnRate * turning);
+            changed = true;
+        }
+    }
+
+    if (qFuzzyIsNull(m_speed)) {
+        return changed;
+    }
+
+    // Halfway through the turn is close enough for a frame
+    const qreal radians = qDegreesToRadians(startHeading + angleDifference(startHeading, m_heading) / 2.f);
+    const qreal distance = m_speed * m_maxSpeed * elapsed / 1000.;
+    m_position += QPointF(distance * qSin(radians), -distance * qCos(radians));
+
+    if (QLineF(m_lastTrajectoryPoint, m_position).length() >= trajectoryResolution) {
+        m_trajectory.append(m_position);
+        if (m_trajectory.count() > maxTrajectoryPoints) {
+            m_trajectory.removeFirst();
+        }
+        m_lastTrajectoryPoint = m_position;
+        emit trajectoryChanged();
+    }
+
+    return true;
+}
+
+void PoseEstimator::updateTimer()
+{
+    const bool turning = !qFuzzyIsNull(m_turnRate) && m_clock.elapsed() < m_lastReport + m_reportInterval;
+    if (qFuzzyIsNull(m_speed) && !turning) {
+        m_updateTimer.stop();
+    } else if (!m_updateTimer.isActive()) {
+        m_updateTimer.start();
+    }
+}
+
+} // namespace mousr
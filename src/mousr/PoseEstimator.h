@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QPointF>
+#include <QTimer>
+#include <QVariantList>
+
+namespace mousr {
+
+// Guesses where the Mousr is, since it only tells us which way it's facing.
+//
+// Moves along the last reported heading at the speed we told it to go. While
+// driving it turns towards the angle we told it to go in, at the rate it was
+// turning between the two last orientation reports. Otherwise it keeps
+// turning at that rate (but not for longer than the time between them, so it
+// doesn't spin off forever if the reports stop). The reports come at ~10 Hz,
+// so the pose is updated about once per frame in between while it's moving.
+//
+// Positions are in cm from where it was when we started (or reset), with y
+// going down and 0 degrees pointing up, like in QML.
+class PoseEstimator : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QPointF position READ position NOTIFY poseChanged)
+    Q_PROPERTY(float heading READ heading NOTIFY poseChanged) // degrees
+    Q_PROPERTY(QVariantList trajectory READ trajectory NOTIFY trajectoryChanged) // QPointFs, oldest first
+    Q_PROPERTY(float maxSpeed READ maxSpeed WRITE setMaxSpeed NOTIFY maxSpeedChanged) // cm/s at full speed
+
+public:
+    explicit PoseEstimator(QObject *parent);
+
+    QPointF position() const { return m_position; }
+    float heading() const { return m_heading; }
+    QVariantList trajectory() const { return m_trajectory; }
+
+    float maxSpeed() const { return m_maxSpeed; }
+    void setMaxSpeed(const float speed);
+
+    // What we told it, 0 - 1
+    void setSpeed(const float speed);
+
+    // What we told it, degrees, same as the reported heading
+    void setTargetHeading(const float heading);
+
+    // From the DeviceOrientation reports, degrees
+    void addHeading(const float heading);
+
+public slots:
+    void reset();
+
+signals:
+    void poseChanged();
+    void trajectoryChanged();
+    void maxSpeedChanged();
+
+private slots:
+    void update();
+
+private:
+    // Moves everything forward to now, true if the pose changed
+    bool advance();
+    void updateTimer();
+
+    QPointF m_position;
+    float m_heading = 0.f;
+    QVariantList m_trajectory;
+    QPointF m_lastTrajectoryPoint;
+
+    float m_speed = 0.f;
+    float m_maxSpeed = 50.f;
+
+    bool m_hasTargetHeading = false;
+    float m_targetHeading = 0.f;
+
+    bool m_hasHeading = false;
+    float m_reportedHeading = 0.f;
+    float m_turnRate = 0.f; // degrees per ms
+    qint64 m_lastReport = 0; // ms, on m_clock
+    qint64 m_reportInterval = 0; // ms
+    qint64 m_lastUpdate = 0; // ms, on m_clock
+
+    QElapsedTimer m_clock;
+    QTimer m_updateTimer;
+};
+
+} // namespace mousr
@@ -0,0 +1,112 @@
+#include "orientationinterpolator.h"
+
+#include <QQuickWindow>
+#include <cmath>
+
+namespace {
+
+// Shorter and it's just jittery, longer and it lags too much behind
+static constexpr qint64 minDuration = 16; // ms
+static constexpr qint64 maxDuration = 250; // ms
+
+float interpolateAngle(const float from, const float to, const float progress)
+{
+    float difference = std::fmod(to - from, 360.f);
+    if (difference > 180.f) {
+        difference -= 360.f;
+    } else if (difference < -180.f) {
+        difference += 360.f;
+    }
+    // Keeps it from growing forever when it spins around, looks the same anyways
+    return std::fmod(from + difference * progress + 360.f, 360.f);
+}
+
+} // namespace
+
+OrientationInterpolator::OrientationInterpolator(QQuickItem *parent) :
+    QQuickItem(parent)
+{
+    m_clock.start();
+}
+
+void OrientationInterpolator::setTargetRotation(const QVector3D &rotation)
+{
+    if (m_hasTarget && rotation == m_target) {
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+
+    if (!m_hasTarget) {
+        // Nowhere to come from
+        m_hasTarget = true;
+        m_from = m_current = m_target = rotation;
+        m_lastTarget = now;
+        emit targetRotationChanged();
+        emit interpolatedChanged();
+        return;
+    }
+
+    m_duration = qBound(minDuration, now - m_lastTarget, maxDuration);
+    m_lastTarget = now;
+
+    m_from = m_current;
+    m_target = rotation;
+    m_start = now;
+    emit targetRotationChanged();
+
+    scheduleFrame();
+}
+
+void OrientationInterpolator::itemChange(ItemChange change, const ItemChangeData &value)
+{
+    if (change == ItemSceneChange) {
+        if (m_window) {
+            disconnect(m_window, &QQuickWindow::afterAnimating, this, &OrientationInterpolator::advance);
+        }
+        m_window = value.window;
+        if (m_window) {
+            connect(m_window, &QQuickWindow::afterAnimating, this, &OrientationInterpolator::advance);
+        }
+        scheduleFrame();
+    }
+
+    QQuickItem::itemChange(change, value);
+}
+
+void OrientationInterpolator::advance()
+{
+    if (m_current == m_target) {
+        return;
+    }
+
+    const float progress = qMin(float(m_clock.elapsed() - m_start) / m_duration, 1.f);
+    if (progress >= 1.f) {
+        m_current = m_target;
+    } else {
+        m_current = QVector3D(
+            interpolateAngle(m_from.x(), m_target.x(), progress),
+            interpolateAngle(m_from.y(), m_target.y(), progress),
+            interpolateAngle(m_from.z(), m_target.z(), progress)
+        );
+        scheduleFrame();
+    }
+
+    emit interpolatedChanged();
+}
+
+void OrientationInterpolator::scheduleFrame()
+{
+    if (m_current == m_target) {
+        return;
+    }
+
+    // Not shown anywhere, so no point in animating anything
+    if (!m_window) {
+        m_current = m_target;
+        emit interpolatedChanged();
+        return;
+    }
+
+    m_window->update();
+}
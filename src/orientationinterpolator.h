@@ -0,0 +1,65 @@
+#ifndef ORIENTATIONINTERPOLATOR_H
+#define ORIENTATIONINTERPOLATOR_H
+
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QQuickItem>
+#include <QVector3D>
+
+// Smooths out the orientation reports for QML, instead of restarting a
+// RotationAnimation for every one of them.
+//
+// Every new target is moved towards over about as long as it took for it to
+// arrive, so it keeps moving steadily as long as the reports keep coming.
+// Advances once per frame, in sync with the window it is in, and doesn't
+// do anything when it has caught up.
+//
+// Each axis is interpolated on its own the shortest way around, since the
+// views only show one rotation each anyways.
+class OrientationInterpolator : public QQuickItem
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QVector3D targetRotation READ targetRotation WRITE setTargetRotation NOTIFY targetRotationChanged) // degrees
+
+    Q_PROPERTY(float xRotation READ xRotation NOTIFY interpolatedChanged)
+    Q_PROPERTY(float yRotation READ yRotation NOTIFY interpolatedChanged)
+    Q_PROPERTY(float zRotation READ zRotation NOTIFY interpolatedChanged)
+
+public:
+    explicit OrientationInterpolator(QQuickItem *parent = nullptr);
+
+    QVector3D targetRotation() const { return m_target; }
+    void setTargetRotation(const QVector3D &rotation);
+
+    float xRotation() const { return m_current.x(); }
+    float yRotation() const { return m_current.y(); }
+    float zRotation() const { return m_current.z(); }
+
+signals:
+    void targetRotationChanged();
+    void interpolatedChanged();
+
+protected:
+    void itemChange(ItemChange change, const ItemChangeData &value) override;
+
+private slots:
+    void advance();
+
+private:
+    void scheduleFrame();
+
+    QVector3D m_from;
+    QVector3D m_target;
+    QVector3D m_current;
+    bool m_hasTarget = false;
+
+    qint64 m_start = 0; // ms, on m_clock
+    qint64 m_lastTarget = -1; // ms, on m_clock
+    qint64 m_duration = 100; // ms
+
+    QElapsedTimer m_clock;
+    QPointer<QQuickWindow> m_window;
+};
+
+#endif // ORIENTATIONINTERPOLATOR_H
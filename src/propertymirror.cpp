@@ -0,0 +1,304 @@
+#include "propertymirror.h"
+
+#include "logging.h"
+
+#include <QDebug>
+#include <QMetaMethod>
+#include <QMetaProperty>
+#include <QThread>
+
+namespace {
+
+// objectName and friends would collide with QQmlPropertyMap's own stuff,
+// and no one is interested in them anyways
+int firstPropertyIndex()
+{
+    return QObject::staticMetaObject.propertyCount();
+}
+
+int firstMethodIndex()
+{
+    return QObject::staticMetaObject.methodCount();
+}
+
+bool isEnum(const int type)
+{
+    return QMetaType::typeFlags(type) & QMetaType::IsEnumeration;
+}
+
+bool isObject(const int type)
+{
+    return QMetaType::typeFlags(type) & QMetaType::PointerToQObject;
+}
+
+QVariant callMethod(QObject *object, const QMetaMethod &method, QVariantList arguments)
+{
+    Q_ASSERT(arguments.count() <= 10);
+
+    const QList<QByteArray> typeNames = method.parameterTypes();
+    QGenericArgument genericArguments[10];
+    for (int i=0; i<arguments.count(); i++) {
+        QVariant &argument = arguments[i];
+        const int type = method.parameterType(i);
+        if (type == QMetaType::QVariant) {
+            genericArguments[i] = QGenericArgument("QVariant", &argument);
+            continue;
+        }
+
+        // QML only gives us plain numbers for enums
+        if (isEnum(type)) {
+            argument = argument.toInt();
+        } else if (!argument.convert(type)) {
+            qCWarning(lcSessions) << " ! Can't convert" << argument << "to" << typeNames[i] << "for" << method.name();
+            return QVariant();
+        }
+        genericArguments[i] = QGenericArgument(typeNames[i].constData(), argument.constData());
+    }
+
+    const int returnType = method.returnType();
+    QVariant ret;
+    QGenericReturnArgument returnArgument;
+    if (returnType == QMetaType::QVariant) {
+        returnArgument = QGenericReturnArgument("QVariant", &ret);
+    } else if (returnType != QMetaType::Void) {
+        ret = QVariant(returnType, nullptr);
+        returnArgument = QGenericReturnArgument(method.typeName(), ret.data());
+    }
+
+    const bool success = method.invoke(object, Qt::DirectConnection, returnArgument,
+            genericArguments[0], genericArguments[1], genericArguments[2], genericArguments[3], genericArguments[4],
+            genericArguments[5], genericArguments[6], genericArguments[7], genericArguments[8], genericArguments[9]
+        );
+    if (!success) {
+        qCWarning(lcSessions) << " ! Failed to call" << method.methodSignature();
+        return QVariant();
+    }
+
+    if (isEnum(returnType)) {
+        return ret.toInt();
+    }
+    return ret;
+}
+
+} // namespace
+
+PropertyCollector::PropertyCollector(QObject *source) :
+    QObject(source),
+    m_source(source)
+{
+    m_publishTimer.setSingleShot(true);
+    m_publishTimer.setInterval(16);
+    connect(&m_publishTimer, &QTimer::timeout, this, &PropertyCollector::publish);
+
+    const QMetaObject *sourceMetaObject = source->metaObject();
+    const int notifySlot = metaObject()->indexOfSlot("onNotify()");
+    Q_ASSERT(notifySlot >= 0);
+
+    for (int i=firstPropertyIndex(); i<sourceMetaObject->propertyCount(); i++) {
+        const QMetaProperty property = sourceMetaObject->property(i);
+        if (!property.hasNotifySignal()) {
+            continue;
+        }
+
+        // Lots of properties share the same signal
+        const int signal = property.notifySignalIndex();
+        if (!m_notifyProperties.contains(signal)) {
+            QMetaObject::connect(source, signal, this, notifySlot);
+        }
+        m_notifyProperties[signal].append(i);
+    }
+}
+
+QVariantHash PropertyCollector::snapshot() const
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    QVariantHash values;
+    const QMetaObject *sourceMetaObject = m_source->metaObject();
+    for (int i=firstPropertyIndex(); i<sourceMetaObject->propertyCount(); i++) {
+        const QMetaProperty property = sourceMetaObject->property(i);
+        if (!property.isReadable()) {
+            continue;
+        }
+        values.insert(QString::fromLatin1(property.name()), read(i));
+    }
+    return values;
+}
+
+void PropertyCollector::setPublishInterval(const int milliseconds)
+{
+    m_publishTimer.setInterval(qMax(milliseconds, 0));
+}
+
+void PropertyCollector::onNotify()
+{
+    for (const int index : m_notifyProperties.value(senderSignalIndex())) {
+        if (!m_dirty.contains(index)) {
+            m_dirty.append(index);
+        }
+    }
+
+    if (!m_publishTimer.isActive()) {
+        m_publishTimer.start();
+    }
+}
+
+void PropertyCollector::publish()
+{
+    if (m_dirty.isEmpty()) {
+        return;
+    }
+
+    const QMetaObject *sourceMetaObject = m_source->metaObject();
+
+    QVariantHash values;
+    for (const int index : m_dirty) {
+        const QMetaProperty property = sourceMetaObject->property(index);
+
+        // The mirrors for objects are made once up front
+        if (isObject(property.userType())) {
+            continue;
+        }
+        values.insert(QString::fromLatin1(property.name()), read(index));
+    }
+    m_dirty.clear();
+
+    emit changed(values);
+}
+
+QVariant PropertyCollector::read(const int propertyIndex) const
+{
+    const QMetaProperty property = m_source->metaObject()->property(propertyIndex);
+    const QVariant value = property.read(m_source);
+
+    // QML only understands plain numbers
+    if (property.isEnumType()) {
+        return value.toInt();
+    }
+    return value;
+}
+
+PropertyMirror::PropertyMirror(QObject *source, QObject *parent) :
+    QQmlPropertyMap(this, parent),
+    m_source(source),
+    m_sourceMetaObject(source->metaObject())
+{
+    QVariantHash initial;
+    auto setup = [this, source, &initial]() {
+        m_collector = new PropertyCollector(source);
+        connect(m_collector, &PropertyCollector::changed, this, &PropertyMirror::onChanged);
+        initial = m_collector->snapshot();
+    };
+
+    if (isSameThread()) {
+        setup();
+    } else {
+        QMetaObject::invokeMethod(source, setup, Qt::BlockingQueuedConnection);
+    }
+
+    for (QVariantHash::const_iterator it = initial.constBegin(); it != initial.constEnd(); it++) {
+        if (!isObject(it.value().userType())) {
+            insert(it.key(), it.value());
+            continue;
+        }
+
+        // E. g. the command statistics, they live in the same thread as the source
+        QObject *object = it.value().value<QObject*>();
+        insert(it.key(), QVariant::fromValue<QObject*>(object ? new PropertyMirror(object, this) : nullptr));
+    }
+}
+
+void PropertyMirror::setPublishInterval(const int milliseconds)
+{
+    if (!m_collector) {
+        return;
+    }
+    QMetaObject::invokeMethod(m_collector, [collector = m_collector.data(), milliseconds]() {
+        collector->setPublishInterval(milliseconds);
+    });
+}
+
+QVariant PropertyMirror::invoke(const QString &method, const QVariant &argument1, const QVariant &argument2, const QVariant &argument3, const QVariant &argument4)
+{
+    if (!m_source || !m_collector) {
+        qCWarning(lcSessions) << " ! Source is gone, can't call" << method;
+        return QVariant();
+    }
+
+    QVariantList arguments;
+    for (const QVariant &argument : {argument1, argument2, argument3, argument4}) {
+        if (!argument.isValid()) {
+            break;
+        }
+        arguments.append(argument);
+    }
+
+    const QByteArray name = method.toLatin1();
+    QMetaMethod metaMethod;
+    for (int i=firstMethodIndex(); i<m_sourceMetaObject->methodCount(); i++) {
+        const QMetaMethod candidate = m_sourceMetaObject->method(i);
+        if (candidate.methodType() == QMetaMethod::Signal || candidate.access() != QMetaMethod::Public) {
+            continue;
+        }
+        if (candidate.name() == name && candidate.parameterCount() == arguments.count()) {
+            metaMethod = candidate;
+            break;
+        }
+    }
+    if (!metaMethod.isValid()) {
+        qCWarning(lcSessions) << " ! No method" << method << "with" << arguments.count() << "arguments in" << m_sourceMetaObject->className();
+        return QVariant();
+    }
+
+    QObject *source = m_source.data();
+    if (metaMethod.returnType() == QMetaType::Void) {
+        QMetaObject::invokeMethod(m_collector, [source, metaMethod, arguments]() {
+            callMethod(source, metaMethod, arguments);
+        });
+        return QVariant();
+    }
+
+    if (isSameThread()) {
+        return callMethod(source, metaMethod, arguments);
+    }
+
+    QVariant ret;
+    QMetaObject::invokeMethod(m_collector, [&]() {
+        ret = callMethod(source, metaMethod, arguments);
+    }, Qt::BlockingQueuedConnection);
+    return ret;
+}
+
+QVariant PropertyMirror::updateValue(const QString &key, const QVariant &input)
+{
+    const int index = m_sourceMetaObject->indexOfProperty(key.toLatin1().constData());
+    if (index < 0 || !m_sourceMetaObject->property(index).isWritable()) {
+        qCWarning(lcSessions) << " ! Can't write" << key << "in" << m_sourceMetaObject->className();
+        return value(key);
+    }
+    if (!m_source || !m_collector) {
+        qCWarning(lcSessions) << " ! Source is gone, can't write" << key;
+        return value(key);
+    }
+
+    // We show the new value right away, the source sends the real one when it's done
+    const QMetaProperty property = m_sourceMetaObject->property(index);
+    QMetaObject::invokeMethod(m_collector, [source = m_source.data(), property, input]() {
+        if (!property.write(source, input)) {
+            qCWarning(lcSessions) << " ! Failed to write" << input << "to" << property.name();
+        }
+    });
+    return input;
+}
+
+void PropertyMirror::onChanged(const QVariantHash &values)
+{
+    for (QVariantHash::const_iterator it = values.constBegin(); it != values.constEnd(); it++) {
+        insert(it.key(), it.value());
+    }
+}
+
+bool PropertyMirror::isSameThread() const
+{
+    return m_source && m_source->thread() == thread();
+}
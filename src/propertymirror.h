@@ -0,0 +1,85 @@
+#ifndef PROPERTYMIRROR_H
+#define PROPERTYMIRROR_H
+
+#include <QQmlPropertyMap>
+#include <QPointer>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+// Lives in the same thread as the object it watches, and collects up the
+// properties that changed so they can be sent over in one go.
+class PropertyCollector : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PropertyCollector(QObject *source);
+
+    // Everything readable, has to be called from the thread we live in
+    QVariantHash snapshot() const;
+
+    void setPublishInterval(const int milliseconds);
+
+signals:
+    void changed(const QVariantHash &values);
+
+private slots:
+    void onNotify();
+    void publish();
+
+private:
+    QVariant read(const int propertyIndex) const;
+
+    QObject *m_source;
+
+    QHash<int, QVector<int>> m_notifyProperties; // notify signal index -> property indices
+    QVector<int> m_dirty; // property indices
+
+    QTimer m_publishTimer;
+};
+
+// What QML gets to see instead of a robot handler, so the handler can live
+// in a worker thread.
+//
+// All properties of the source are copied over when they change, but at most
+// once per publish interval, and then all of them at once in a single queued
+// call. Writing properties and calling methods get forwarded to the thread
+// the source lives in.
+//
+// Doesn't own the source.
+class PropertyMirror : public QQmlPropertyMap
+{
+    Q_OBJECT
+
+public:
+    PropertyMirror(QObject *source, QObject *parent);
+
+    QObject *source() const { return m_source.data(); }
+
+    // Defaults to about one frame
+    void setPublishInterval(const int milliseconds);
+
+    // Calls a method on the source, like device.invoke("rotate", MousrHandler.Left).
+    // Only blocks if the method returns something.
+    Q_INVOKABLE QVariant invoke(const QString &method,
+            const QVariant &argument1 = QVariant(),
+            const QVariant &argument2 = QVariant(),
+            const QVariant &argument3 = QVariant(),
+            const QVariant &argument4 = QVariant());
+
+protected:
+    QVariant updateValue(const QString &key, const QVariant &input) override;
+
+private slots:
+    void onChanged(const QVariantHash &values);
+
+private:
+    bool isSameThread() const;
+
+    QPointer<QObject> m_source;
+    QPointer<PropertyCollector> m_collector;
+    const QMetaObject *m_sourceMetaObject = nullptr;
+};
+
+#endif // PROPERTYMIRROR_H
@@ -0,0 +1,108 @@
+#include "sessionmanager.h"
+
+#include "logging.h"
+
+#include <QDebug>
+#include <QQmlEngine>
+
+SessionManager::SessionManager(QObject *parent) :
+    QObject(parent)
+{
+}
+
+SessionManager::~SessionManager()
+{
+    // Disconnect the handlers before they go away, so we don't get signals from half dead objects
+    for (const QPointer<QObject> &handler : m_handlers) {
+        if (!handler) {
+            continue;
+        }
+        disconnect(handler, nullptr, this, nullptr);
+
+        // The worker threads delete them when they stop
+        if (handler->thread() == thread()) {
+            delete handler;
+        } else {
+            handler->deleteLater();
+        }
+    }
+    qDeleteAll(sessions());
+}
+
+void SessionManager::insert(const QString &id, QObject *handler, QObject *published)
+{
+    if (m_sessions.contains(id)) {
+        qCWarning(lcSessions) << "Already have a session for" << id << ", replacing";
+        remove(id);
+    }
+
+    // Can't parent across threads
+    if (handler->thread() == thread()) {
+        handler->setParent(this);
+    }
+    published->setParent(this);
+    QQmlEngine::setObjectOwnership(published, QQmlEngine::CppOwnership);
+
+    m_handlers.insert(id, handler);
+    m_sessions.insert(id, published);
+    m_order.append(id);
+    qCDebug(lcSessions) << " + Added session" << id << "now have" << m_order.count();
+
+    emit sessionAdded(id);
+    emit sessionsChanged();
+}
+
+void SessionManager::remove(const QString &id)
+{
+    if (!m_sessions.contains(id)) {
+        qCWarning(lcSessions) << "No session for" << id;
+        return;
+    }
+
+    QPointer<QObject> session = m_sessions.take(id);
+    QPointer<QObject> handler = m_handlers.take(id);
+    m_order.removeAll(id);
+
+    if (handler) {
+        disconnect(handler, nullptr, this, nullptr);
+        handler->deleteLater();
+    }
+    if (session) {
+        session->deleteLater();
+    }
+    qCDebug(lcSessions) << " - Removed session" << id << "still have" << m_order.count();
+
+    emit sessionRemoved(id);
+    emit sessionsChanged();
+}
+
+QString SessionManager::id(const QObject *session) const
+{
+    for (auto it = m_sessions.constBegin(); it != m_sessions.constEnd(); ++it) {
+        if (it.value() == session) {
+            return it.key();
+        }
+    }
+    return QString();
+}
+
+QList<QObject*> SessionManager::sessions() const
+{
+    QList<QObject*> ret;
+    ret.reserve(m_order.count());
+    for (const QString &id : m_order) {
+        if (QObject *session = m_sessions.value(id)) {
+            ret.append(session);
+        }
+    }
+    return ret;
+}
+
+QString SessionManager::uniqueId(const QString &id) const
+{
+    QString ret = id;
+    for (int i=2; m_sessions.contains(ret); i++) {
+        ret = id + '#' + QString::number(i);
+    }
+    return ret;
+}
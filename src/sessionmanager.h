@@ -0,0 +1,60 @@
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
+
+// Keeps track of all the robots we're connected to at once, keyed by address
+// (or whatever the transport calls itself).
+//
+// Every handler has its own controller, services and send queue, so there's
+// nothing shared between them here except the bookkeeping.
+//
+// The handlers might live in worker threads, so what we hand out to QML is
+// whatever they're published as (a PropertyMirror).
+class SessionManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SessionManager(QObject *parent);
+    ~SessionManager();
+
+    // Takes ownership of both, and removes them again when it disconnects
+    template<typename HANDLER>
+    void add(const QString &id, HANDLER *handler, QObject *published) {
+        insert(id, handler, published);
+        connect(handler, &HANDLER::disconnected, this, [this, id]() {
+            remove(id);
+        });
+    }
+
+    void remove(const QString &id);
+
+    bool contains(const QString &id) const { return m_sessions.contains(id); }
+    QObject *session(const QString &id) const { return m_sessions.value(id).data(); }
+    QString id(const QObject *session) const;
+
+    QStringList ids() const { return m_order; }
+    QList<QObject*> sessions() const;
+    int count() const { return m_order.count(); }
+
+    // In case someone asks for the same one twice (e. g. simulated robots)
+    QString uniqueId(const QString &id) const;
+
+signals:
+    void sessionAdded(const QString &id);
+    void sessionRemoved(const QString &id);
+    void sessionsChanged();
+
+private:
+    void insert(const QString &id, QObject *handler, QObject *published);
+
+    QHash<QString, QPointer<QObject>> m_sessions; // what QML sees
+    QHash<QString, QPointer<QObject>> m_handlers;
+    QStringList m_order; // in the order they were connected
+};
+
+#endif // SESSIONMANAGER_H
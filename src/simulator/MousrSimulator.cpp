@@ -0,0 +1,202 @@
+#include "MousrSimulator.h"
+
+#include "logging.h"
+#include "mousr/MousrHandler.h"
+
+#include <QDebug>
+#include <QtEndian>
+#include <QtMath>
+#include <cstring>
+
+namespace simulator {
+
+using CommandType = mousr::MousrHandler::CommandType;
+using ResponseType = mousr::MousrHandler::ResponseType;
+
+namespace {
+// The 15 byte command packets: magic, 12 bytes of arguments, command
+static constexpr int commandSize = 15;
+static constexpr uint8_t commandMagic = 48;
+static constexpr int argumentsOffset = 1;
+static constexpr int commandOffset = 13;
+
+// The 20 byte responses: type and 19 bytes of whatever
+static constexpr int responseSize = 20;
+
+// Degrees per second at full speed
+static constexpr float turnRate = 360.f;
+
+// Same as the handler, we only run on little endian anyways
+float readFloat(const char *data)
+{
+    float value;
+    memcpy(&value, data, sizeof(float));
+    return value;
+}
+
+void writeFloat(const float value, char *out)
+{
+    memcpy(out, &value, sizeof(float));
+}
+} // namespace
+
+MousrSimulator::MousrSimulator(QObject *parent) :
+    Simulator(parent)
+{
+    setOrientationRate(20);
+    setBatteryInterval(5000);
+
+    // So they follow along if we're moved to a worker thread
+    m_orientationTimer.setParent(this);
+    m_batteryTimer.setParent(this);
+
+    connect(&m_orientationTimer, &QTimer::timeout, this, &MousrSimulator::sendOrientation);
+    connect(&m_batteryTimer, &QTimer::timeout, this, &MousrSimulator::sendBattery);
+}
+
+void MousrSimulator::setOrientationRate(const int hz)
+{
+    m_orientationTimer.setInterval(1000 / qBound(1, hz, 1000));
+}
+
+void MousrSimulator::setBatteryInterval(const int milliseconds)
+{
+    m_batteryTimer.setInterval(qMax(milliseconds, 1));
+}
+
+void MousrSimulator::onConnected()
+{
+    m_initialized = false;
+    m_movementTimer.start();
+}
+
+void MousrSimulator::onDisconnected()
+{
+    m_orientationTimer.stop();
+    m_batteryTimer.stop();
+}
+
+void MousrSimulator::handleWrite(const QByteArray &data)
+{
+    if (data.size() != commandSize || uint8_t(data[0]) != commandMagic) {
+        qCWarning(lcSimulator) << " ! Simulated Mousr got invalid command" << data.toHex(':');
+        return;
+    }
+
+    const char *arguments = data.constData() + argumentsOffset;
+    const uint16_t command = qFromLittleEndian<uint16_t>(data.constData() + commandOffset);
+
+    switch(CommandType(command)) {
+    case CommandType::InitializeDevice:
+        m_initialized = true;
+        sendCommandCompleted(command, 0);
+        sendOrientation();
+        sendBattery();
+        m_orientationTimer.start();
+        m_batteryTimer.start();
+        break;
+    case CommandType::Move:
+        sendOrientation(); // catch up on the movement so far before changing anything
+        m_speed = readFloat(arguments);
+        m_held = !qFuzzyIsNull(readFloat(arguments + 4));
+        m_targetHeading = readFloat(arguments + 8);
+        break;
+    case CommandType::Stop:
+        m_speed = 0.f;
+        sendResponse(ResponseType::RobotStopped);
+        break;
+    case CommandType::ResetHeading:
+        m_heading = 0.f;
+        m_targetHeading = 0.f;
+        break;
+    case CommandType::ConfigAutoMode:
+        m_autoMode = arguments[0] != 0;
+        // Echoes back the config
+        sendResponse(ResponseType::AutoModeChanged, QByteArray(arguments, sizeof(mousr::AutoplayConfig)));
+        break;
+    case CommandType::TailCalibSignal:
+        m_tailRotation = 0;
+        sendResponse(ResponseType::TailStateUpdated, QByteArray(1, '\0'));
+        break;
+    case CommandType::EraseAnalyticsRecords:
+        sendCommandCompleted(command, 0);
+        break;
+    default:
+        if (!m_initialized) {
+            qCWarning(lcSimulator) << " ! Simulated Mousr got" << CommandType(command) << "before init";
+            sendCommandCompleted(command, -1);
+        }
+        break;
+    }
+}
+
+void MousrSimulator::sendOrientation()
+{
+    // Turns towards the target at a rate depending on the speed
+    const float elapsed = m_movementTimer.restart() / 1000.f;
+    if (m_held && m_speed > 0.f) {
+        float delta = m_targetHeading - m_heading;
+        while (delta > 180.f) {
+            delta -= 360.f;
+        }
+        while (delta < -180.f) {
+            delta += 360.f;
+        }
+        const float maxTurn = turnRate * m_speed * elapsed;
+        m_heading += qBound(-maxTurn, delta, maxTurn);
+        m_heading = std::fmod(m_heading + 360.f, 360.f);
+        m_tailRotation += 3;
+    }
+
+    // x, y, z rotation, flipped, tail rotation, zeroOr255
+    QByteArray payload(19, '\0');
+    char *out = payload.data();
+    writeFloat(0.f, out);
+    writeFloat(0.f, out + 4);
+    writeFloat(m_heading, out + 8);
+    out[12] = 0;
+    out[13] = char(m_tailRotation);
+    out[14] = char(0xFF);
+    sendResponse(ResponseType::DeviceOrientation, payload);
+}
+
+void MousrSimulator::sendBattery()
+{
+    if (m_battery > 5 && m_speed > 0.f) {
+        m_battery--;
+    }
+
+    // voltage (percent, really), low, charging, fully charged, auto mode, memory
+    QByteArray payload(19, '\0');
+    char *out = payload.data();
+    out[0] = char(m_battery);
+    out[1] = m_battery < 15;
+    out[2] = false;
+    out[3] = false;
+    out[4] = m_autoMode;
+    qToLittleEndian<uint16_t>(4096, out + 5);
+    sendResponse(ResponseType::BatteryVoltage, payload);
+}
+
+void MousrSimulator::sendResponse(const uint8_t type, const QByteArray &payload)
+{
+    QByteArray response(responseSize, '\0');
+    response[0] = char(type);
+    memcpy(response.data() + 1, payload.constData(), qMin(payload.size(), responseSize - 1));
+    notify(response);
+}
+
+void MousrSimulator::sendCommandCompleted(const uint16_t command, const int8_t result)
+{
+    // command, result, current/minimum/maximum API version
+    QByteArray payload(19, '\0');
+    char *out = payload.data();
+    qToLittleEndian<uint16_t>(command, out);
+    out[2] = char(result);
+    qToLittleEndian<uint32_t>(3, out + 3);
+    qToLittleEndian<uint32_t>(1, out + 7);
+    qToLittleEndian<uint32_t>(3, out + 11);
+    sendResponse(ResponseType::CommandCompleted, payload);
+}
+
+} // namespace simulator
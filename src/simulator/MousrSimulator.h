@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Simulator.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+namespace simulator {
+
+// Speaks the Mousr protocol, 15 byte commands in and 20 byte responses out.
+// Turns towards whatever angle it is told to, reports its orientation and
+// battery periodically, and acks the init sequence.
+class MousrSimulator : public Simulator
+{
+    Q_OBJECT
+
+public:
+    explicit MousrSimulator(QObject *parent);
+
+    QString name() const override { return QStringLiteral("Mousr (simulated)"); }
+
+    void setOrientationRate(const int hz);
+    void setBatteryInterval(const int milliseconds);
+
+protected:
+    void handleWrite(const QByteArray &data) override;
+    void onConnected() override;
+    void onDisconnected() override;
+
+private slots:
+    void sendOrientation();
+    void sendBattery();
+
+private:
+    void sendResponse(const uint8_t type, const QByteArray &payload = QByteArray());
+    void sendCommandCompleted(const uint16_t command, const int8_t result);
+
+    QTimer m_orientationTimer;
+    QTimer m_batteryTimer;
+    QElapsedTimer m_movementTimer;
+
+    float m_heading = 0.f;
+    float m_targetHeading = 0.f;
+    float m_speed = 0.f;
+    bool m_held = false;
+    uint8_t m_tailRotation = 0;
+
+    uint8_t m_battery = 87;
+    bool m_autoMode = false;
+    bool m_initialized = false;
+};
+
+} // namespace simulator
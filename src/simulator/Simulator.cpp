@@ -0,0 +1,119 @@
+#include "Simulator.h"
+
+#include "logging.h"
+#include "MousrSimulator.h"
+#include "SpheroSimulator.h"
+
+#include <QDebug>
+#include <QTimer>
+
+namespace simulator {
+
+Simulator *Simulator::create(const QString &robot, QObject *parent)
+{
+    if (robot == QLatin1String("mousr")) {
+        return new MousrSimulator(parent);
+    }
+    if (robot == QLatin1String("bb8")) {
+        return new SpheroSimulator(SpheroSimulator::V1, parent);
+    }
+    if (robot == QLatin1String("r2d2")) {
+        return new SpheroSimulator(SpheroSimulator::V2, parent);
+    }
+
+    qCWarning(lcSimulator) << " ! Unknown robot to simulate:" << robot << "available:" << robots();
+    return nullptr;
+}
+
+QStringList Simulator::robots()
+{
+    return { "mousr", "bb8", "r2d2" };
+}
+
+Simulator::Simulator(QObject *parent) :
+    transport::Transport(parent),
+    m_random(1337)
+{
+}
+
+bool Simulator::write(const QByteArray &data)
+{
+    if (!m_connected) {
+        qCWarning(lcSimulator) << " ! Simulator not connected, can't write" << data.toHex(':');
+        return false;
+    }
+
+    // Like with a real write with response, if it gets lost we don't get an ack either
+    if (shouldDrop()) {
+        PROTOCOL_TRACE(lcSimulator) << " - Simulator dropping write" << data.toHex(':');
+        m_droppedWrites++;
+        return true;
+    }
+
+    QTimer::singleShot(m_latency, this, [this, data]() {
+        if (!m_connected) {
+            return;
+        }
+        handleWrite(data);
+        emit written();
+    });
+
+    return true;
+}
+
+void Simulator::connectToRobot()
+{
+    if (m_connected) {
+        qCDebug(lcSimulator) << "Simulator already connected";
+        return;
+    }
+
+    qCDebug(lcSimulator) << " + Connecting to simulated" << name();
+    QTimer::singleShot(m_latency, this, [this]() {
+        m_connected = true;
+        emit connected();
+        emit connectionIntervalChanged(m_connectionInterval);
+        onConnected();
+    });
+}
+
+void Simulator::disconnectFromRobot()
+{
+    if (!m_connected) {
+        return;
+    }
+    m_connected = false;
+    onDisconnected();
+
+    qCDebug(lcSimulator) << " - Simulated" << name() << "disconnected, dropped" << m_droppedWrites << "writes and" << m_droppedNotifications << "notifications";
+    emit disconnected();
+}
+
+void Simulator::notify(const QByteArray &data)
+{
+    if (!m_connected) {
+        return;
+    }
+
+    for (int offset=0; offset<data.size(); offset += m_mtu) {
+        if (shouldDrop()) {
+            m_droppedNotifications++;
+            continue;
+        }
+        const QByteArray chunk = data.mid(offset, m_mtu);
+
+        // Timers with the same timeout fire in the order they were started, so this keeps the order
+        QTimer::singleShot(m_latency, this, [this, chunk]() {
+            if (m_connected) {
+                emit received(chunk);
+            }
+        });
+    }
+}
+
+bool Simulator::shouldDrop()
+{
+    return m_lossRate > 0. && m_random.generateDouble() < m_lossRate;
+}
+
+} // namespace simulator
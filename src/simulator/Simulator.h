@@ -0,0 +1,75 @@
+#pragma once
+
+#include "transport/Transport.h"
+
+#include <QRandomGenerator>
+#include <QStringList>
+
+namespace simulator {
+
+// Pretends to be a robot on the other end of a BLE connection, so the
+// handlers can be run (and hammered) without any hardware.
+//
+// Everything in both directions is delayed by the latency, notifications are
+// split up at the MTU like the real thing, and every write or notification
+// chunk can get lost.
+class Simulator : public transport::Transport
+{
+    Q_OBJECT
+
+public:
+    // "mousr", "bb8" (Sphero v1) or "r2d2" (Sphero v2), null if unknown
+    static Simulator *create(const QString &robot, QObject *parent);
+    static QStringList robots();
+
+    explicit Simulator(QObject *parent);
+
+    bool isConnected() const override { return m_connected; }
+    bool write(const QByteArray &data) override;
+
+    void setLatency(const int milliseconds) { m_latency = qMax(milliseconds, 0); }
+    int latency() const { return m_latency; }
+
+    // 0 - 1, chance of every write or notification chunk going missing
+    void setLossRate(const double rate) { m_lossRate = qBound(0., rate, 1.); }
+    double lossRate() const { return m_lossRate; }
+
+    void setMtu(const int bytes) { m_mtu = qMax(bytes, 1); }
+    void setConnectionInterval(const int milliseconds) { m_connectionInterval = qMax(milliseconds, 1); }
+
+    // So runs with loss can be reproduced
+    void setSeed(const quint32 seed) { m_random.seed(seed); }
+
+    int droppedWrites() const { return m_droppedWrites; }
+    int droppedNotifications() const { return m_droppedNotifications; }
+
+public slots:
+    void connectToRobot() override;
+    void disconnectFromRobot() override;
+
+protected:
+    // Called with every write that makes it through
+    virtual void handleWrite(const QByteArray &data) = 0;
+
+    virtual void onConnected() {}
+    virtual void onDisconnected() {}
+
+    // Sends data back to the handler, in MTU sized chunks
+    void notify(const QByteArray &data);
+
+private:
+    bool shouldDrop();
+
+    bool m_connected = false;
+    int m_latency = 10;
+    double m_lossRate = 0.;
+    int m_mtu = 20;
+    int m_connectionInterval = 15;
+
+    int m_droppedWrites = 0;
+    int m_droppedNotifications = 0;
+
+    QRandomGenerator m_random;
+};
+
+} // namespace simulator
@@ -0,0 +1,380 @@
+#include "SpheroSimulator.h"
+
+#include "logging.h"
+#include "sphero/v1/CommandPackets.h"
+#include "sphero/v1/ResponsePackets.h"
+#include "sphero/v1/SensorStream.h"
+#include "sphero/v2/Packets.h"
+
+#include <QDebug>
+#include <QtEndian>
+#include <QtMath>
+
+namespace simulator {
+
+using sphero::v1::CommandPacketHeader;
+using sphero::ResponsePacketHeader;
+using namespace sphero::v1::SensorChannel;
+
+namespace {
+// magic, flags, device, command, sequence number, data length
+static constexpr int commandHeaderSize = 6;
+
+// Degrees per second
+static constexpr float maxTurnRate = 180.f;
+
+// cm/s at full speed
+static constexpr float maxVelocity = 100.f;
+
+uint8_t checksumV1(const QByteArray &packet)
+{
+    uint8_t checksum = 0;
+    for (int i=2; i<packet.size(); i++) {
+        checksum += uint8_t(packet[i]);
+    }
+    return checksum ^ 0xFF;
+}
+} // namespace
+
+SpheroSimulator::SpheroSimulator(const Protocol protocol, QObject *parent) :
+    Simulator(parent),
+    m_protocol(protocol)
+{
+    setPowerNotificationInterval(10000);
+
+    // So they follow along if we're moved to a worker thread
+    m_powerTimer.setParent(this);
+    m_streamTimer.setParent(this);
+
+    connect(&m_powerTimer, &QTimer::timeout, this, &SpheroSimulator::sendPowerNotification);
+    connect(&m_streamTimer, &QTimer::timeout, this, &SpheroSimulator::sendSensorData);
+}
+
+QString SpheroSimulator::name() const
+{
+    // Needs to look like the real ones for the handler to know what it is
+    return m_protocol == V1 ? QStringLiteral("BB-0000") : QStringLiteral("D2-0000");
+}
+
+void SpheroSimulator::setPowerNotificationInterval(const int milliseconds)
+{
+    m_powerTimer.setInterval(qMax(milliseconds, 1));
+}
+
+void SpheroSimulator::onConnected()
+{
+    m_receiveBuffer.clear();
+    m_decoderV2.reset();
+    m_movementTimer.start();
+}
+
+void SpheroSimulator::onDisconnected()
+{
+    m_powerTimer.stop();
+    m_streamTimer.stop();
+}
+
+void SpheroSimulator::handleWrite(const QByteArray &data)
+{
+    if (m_protocol == V2) {
+        m_decoderV2.feed(data.constData(), data.size(), [this](const char *frame, const int size) {
+            handleCommandV2(frame, size);
+        });
+        return;
+    }
+
+    m_receiveBuffer.append(data);
+
+    while (m_receiveBuffer.size() >= commandHeaderSize) {
+        if (uint8_t(m_receiveBuffer[0]) != 0xFF) {
+            qCWarning(lcSimulator) << " ! Simulated Sphero skipping garbage" << m_receiveBuffer.left(1).toHex();
+            m_receiveBuffer.remove(0, 1);
+            continue;
+        }
+
+        const int dataLength = uint8_t(m_receiveBuffer[5]);
+        const int packetSize = commandHeaderSize + dataLength;
+        if (m_receiveBuffer.size() < packetSize) {
+            return;
+        }
+
+        const QByteArray packet = m_receiveBuffer.left(packetSize);
+        m_receiveBuffer.remove(0, packetSize);
+
+        if (dataLength < 1 || checksumV1(packet.left(packetSize - 1)) != uint8_t(packet[packetSize - 1])) {
+            qCWarning(lcSimulator) << " ! Simulated Sphero got invalid packet" << packet.toHex(':');
+            continue;
+        }
+
+        handleCommandV1(packet[1], packet[2], packet[3], packet[4], packet.mid(commandHeaderSize, dataLength - 1));
+    }
+}
+
+void SpheroSimulator::handleCommandV1(const uint8_t flags, const uint8_t deviceId, const uint8_t commandId, const uint8_t sequenceNumber, const QByteArray &data)
+{
+    // Like the real ones, only answer 0xFF packets. Roll etc. are sent as 0xFE and
+    // never get anything back, answering them hides bugs in the retrying.
+    const bool synchronous = flags & CommandPacketHeader::Synchronous;
+
+    QByteArray response;
+
+    switch(deviceId) {
+    case CommandPacketHeader::Internal:
+        switch(commandId) {
+        case CommandPacketHeader::GetPwrState: {
+            // record version, state, voltage, number of charges, seconds since charge
+            response.resize(8);
+            char *out = response.data();
+            out[0] = 1;
+            out[1] = m_voltage > 700 ? sphero::PowerStatePacket::BatteryOK : sphero::PowerStatePacket::BatteryLow;
+            qToBigEndian<uint16_t>(m_voltage, out + 2);
+            qToBigEndian<uint16_t>(42, out + 4);
+            qToBigEndian<uint16_t>(m_movementTimer.elapsed() / 1000, out + 6);
+            break;
+        }
+        case CommandPacketHeader::SetPwrNotify:
+            if (!data.isEmpty() && data[0]) {
+                m_powerTimer.start();
+            } else {
+                m_powerTimer.stop();
+            }
+            break;
+        default:
+            break;
+        }
+        break;
+    case CommandPacketHeader::HardwareControl:
+        switch(commandId) {
+        case CommandPacketHeader::Roll:
+            if (data.size() < 4) {
+                qCWarning(lcSimulator) << " ! Simulated Sphero got short roll command";
+                break;
+            }
+            updateMovement();
+            m_speed = data[0];
+            m_targetHeading = qFromBigEndian<uint16_t>(data.constData() + 1) % 360;
+            break;
+        case CommandPacketHeader::SetRGBLed:
+            if (data.size() >= 3) {
+                m_red = data[0];
+                m_green = data[1];
+                m_blue = data[2];
+            }
+            break;
+        case CommandPacketHeader::GetRGBLed:
+            response = QByteArray(1, char(m_red)) + char(m_green) + char(m_blue);
+            break;
+        case CommandPacketHeader::GetLocatorData: {
+            // flags, x, y, tilt
+            updateMovement();
+            response.resize(7);
+            char *out = response.data();
+            out[0] = 1;
+            qToBigEndian<int16_t>(qRound(m_x), out + 1);
+            qToBigEndian<int16_t>(qRound(m_y), out + 3);
+            qToBigEndian<int16_t>(0, out + 5);
+            break;
+        }
+        case CommandPacketHeader::SetDataStreaming:
+            configureStreaming(data);
+            break;
+        default:
+            break;
+        }
+        break;
+    default:
+        qCWarning(lcSimulator) << " ! Simulated Sphero got command for unknown device" << deviceId;
+        break;
+    }
+
+    if (synchronous) {
+        sendResponseV1(sequenceNumber, response);
+    }
+}
+
+void SpheroSimulator::sendResponseV1(const uint8_t sequenceNumber, const QByteArray &data)
+{
+    QByteArray packet;
+    packet.reserve(5 + data.size() + 1);
+    packet += char(0xFF);
+    packet += char(ResponsePacketHeader::Response);
+    packet += char(ResponsePacketHeader::Ack);
+    packet += char(sequenceNumber);
+    packet += char(data.size() + 1);
+    packet += data;
+    packet += char(checksumV1(packet));
+    notify(packet);
+}
+
+void SpheroSimulator::sendNotificationV1(const uint8_t type, const QByteArray &data)
+{
+    // Notifications have a 16 bit length instead of the sequence number
+    const int length = data.size() + 1;
+
+    QByteArray packet;
+    packet.reserve(5 + length);
+    packet += char(0xFF);
+    packet += char(ResponsePacketHeader::Notification);
+    packet += char(type);
+    packet += char(length >> 8);
+    packet += char(length & 0xFF);
+    packet += data;
+    packet += char(checksumV1(packet));
+    notify(packet);
+}
+
+void SpheroSimulator::sendPowerNotification()
+{
+    if (m_voltage > 650) {
+        m_voltage--;
+    }
+    sendNotificationV1(ResponsePacketHeader::PowerNotification, QByteArray(1, m_voltage > 700 ? sphero::PowerStatePacket::BatteryOK : sphero::PowerStatePacket::BatteryLow));
+}
+
+void SpheroSimulator::configureStreaming(const QByteArray &data)
+{
+    // divisor, frames per packet, mask, packet count, mask2 (newer firmware)
+    if (data.size() < 9) {
+        qCWarning(lcSimulator) << " ! Simulated Sphero got invalid streaming configuration" << data.toHex(':');
+        return;
+    }
+    const int divisor = qMax<int>(qFromBigEndian<uint16_t>(data.constData()), 1);
+    m_framesPerPacket = qBound<int>(1, qFromBigEndian<uint16_t>(data.constData() + 2), sphero::v1::SensorStreamDecoder::MaxFramesPerPacket);
+    m_streamMask = qFromBigEndian<uint32_t>(data.constData() + 4);
+    m_packetsLeft = uint8_t(data[8]);
+    m_streamMask2 = data.size() >= 13 ? qFromBigEndian<uint32_t>(data.constData() + 9) : 0;
+
+    if (!m_streamMask && !m_streamMask2) {
+        qCDebug(lcSimulator) << " - Simulated Sphero stopping streaming";
+        m_streamTimer.stop();
+        return;
+    }
+
+    m_framePeriod = divisor / 400.f;
+    m_streamTimer.setInterval(qMax(1, qRound(1000.f * m_framePeriod * m_framesPerPacket)));
+    m_streamTimer.start();
+    qCDebug(lcSimulator) << " - Simulated Sphero streaming a packet every" << m_streamTimer.interval() << "ms";
+}
+
+void SpheroSimulator::updateMovement()
+{
+    const float elapsed = m_movementTimer.restart() / 1000.f;
+    m_time += elapsed;
+
+    float delta = m_targetHeading - m_heading;
+    if (delta > 180.f) {
+        delta -= 360.f;
+    } else if (delta < -180.f) {
+        delta += 360.f;
+    }
+    const float maxTurn = maxTurnRate * elapsed;
+    const float turn = qBound(-maxTurn, delta, maxTurn);
+    m_turnRate = elapsed > 0.f ? turn / elapsed : 0.f;
+    m_heading = std::fmod(m_heading + turn + 360.f, 360.f);
+
+    const float velocity = maxVelocity * m_speed / 255.f;
+    m_x += velocity * elapsed * qSin(qDegreesToRadians(m_heading));
+    m_y += velocity * elapsed * qCos(qDegreesToRadians(m_heading));
+}
+
+void SpheroSimulator::sendSensorData()
+{
+    updateMovement();
+
+    const float yaw = m_heading > 180.f ? m_heading - 360.f : m_heading;
+    const float velocity = maxVelocity * m_speed / 255.f;
+
+    QByteArray data;
+    data.reserve(m_framesPerPacket * ChannelCount * 2);
+
+    for (int frame=0; frame<m_framesPerPacket; frame++) {
+        // Spaced out like they were sampled, the last one is now
+        const float t = m_time - (m_framesPerPacket - 1 - frame) * m_framePeriod;
+
+        for (const Definition &definition : definitions) {
+            if (!(definition.bit & (definition.secondMask ? m_streamMask2 : m_streamMask))) {
+                continue;
+            }
+
+            float value = 0.f;
+            switch(definition.channel) {
+            case Pitch: value = 2.f * qSin(t * 3.f); break;
+            case Roll: value = 2.f * qCos(t * 2.f); break;
+            case Yaw: value = yaw; break;
+            case AccelerometerX: value = 0.05f * qSin(t * 5.f); break;
+            case AccelerometerY: value = 0.05f * qCos(t * 5.f); break;
+            case AccelerometerZ: value = 1.f; break;
+            case GyroZ: value = m_turnRate; break;
+            case QuaternionW: value = qCos(qDegreesToRadians(yaw) / 2.f); break;
+            case QuaternionZ: value = qSin(qDegreesToRadians(yaw) / 2.f); break;
+            case OdometerX: value = m_x; break;
+            case OdometerY: value = m_y; break;
+            case AccelerationOne: value = 1.f; break;
+            case VelocityX: value = 10.f * velocity * qSin(qDegreesToRadians(m_heading)); break;
+            case VelocityY: value = 10.f * velocity * qCos(qDegreesToRadians(m_heading)); break;
+            default: break;
+            }
+
+            char raw[2];
+            qToBigEndian<int16_t>(int16_t(qBound(-32768, qRound(value / definition.scale), 32767)), raw);
+            data.append(raw, 2);
+        }
+    }
+
+    sendNotificationV1(ResponsePacketHeader::SensorStream, data);
+
+    if (m_packetsLeft > 0 && --m_packetsLeft == 0) {
+        m_streamTimer.stop();
+    }
+}
+
+void SpheroSimulator::handleCommandV2(const char *frame, const int size)
+{
+    // flags, device, command, sequence number, payload
+    if (size < 4) {
+        qCWarning(lcSimulator) << " ! Simulated Sphero got too short packet" << QByteArray(frame, size).toHex(':');
+        return;
+    }
+    const uint8_t flags = frame[0];
+    const uint8_t deviceId = frame[1];
+    const uint8_t commandId = frame[2];
+    const uint8_t sequenceNumber = frame[3];
+    const char *payload = frame + 4;
+    const int payloadSize = size - 4;
+
+    QByteArray response;
+    response += char(sphero::v2::Packet::HasErrorCode | sphero::v2::Packet::ResetTimeout);
+    response += char(deviceId);
+    response += char(commandId);
+    response += char(sequenceNumber);
+    response += char(sphero::v2::Packet::Error::Success);
+
+    switch(deviceId) {
+    case sphero::v2::Packet::MainSystem:
+        if (commandId == sphero::v2::Power::GetBatteryVoltage) {
+            char voltage[2];
+            qToBigEndian<uint16_t>(m_voltage, voltage);
+            response.append(voltage, 2);
+        }
+        break;
+    case sphero::v2::Packet::DrivingSystem:
+        if (commandId == sphero::v2::DrivePacket::id && payloadSize >= 3) {
+            updateMovement();
+            m_speed = payload[0];
+            m_targetHeading = qFromBigEndian<uint16_t>(payload + 1) % 360;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!(flags & sphero::v2::Packet::Synchronous)) {
+        return;
+    }
+
+    QByteArray encoded(sphero::v2::maxEncodedSize(response.size()), Qt::Uninitialized);
+    encoded.resize(sphero::v2::encodeFrame(response.constData(), response.size(), encoded.data()));
+    notify(encoded);
+}
+
+} // namespace simulator
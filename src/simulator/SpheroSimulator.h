@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Simulator.h"
+
+#include "sphero/v2/Framing.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+namespace simulator {
+
+// BB-8 (v1 protocol) or R2-D2 (v2 protocol).
+//
+// v1: answers the synchronous commands with the right sequence numbers,
+// sends power notifications if asked to and streams sensor data the way it
+// is configured with SetDataStreaming.
+// v2: answers everything synchronous with an escaped frame echoing the
+// sequence number, including the battery voltage.
+class SpheroSimulator : public Simulator
+{
+    Q_OBJECT
+
+public:
+    enum Protocol {
+        V1,
+        V2
+    };
+
+    SpheroSimulator(const Protocol protocol, QObject *parent);
+
+    QString name() const override;
+
+    void setPowerNotificationInterval(const int milliseconds);
+
+protected:
+    void handleWrite(const QByteArray &data) override;
+    void onConnected() override;
+    void onDisconnected() override;
+
+private slots:
+    void sendPowerNotification();
+    void sendSensorData();
+
+private:
+    void handleCommandV1(const uint8_t flags, const uint8_t deviceId, const uint8_t commandId, const uint8_t sequenceNumber, const QByteArray &data);
+    void sendResponseV1(const uint8_t sequenceNumber, const QByteArray &data = QByteArray());
+    void sendNotificationV1(const uint8_t type, const QByteArray &data);
+    void configureStreaming(const QByteArray &data);
+    void updateMovement();
+
+    void handleCommandV2(const char *frame, const int size);
+
+    Protocol m_protocol;
+
+    QByteArray m_receiveBuffer;
+    sphero::v2::StreamDecoder m_decoderV2;
+
+    QTimer m_powerTimer;
+    QTimer m_streamTimer;
+    QElapsedTimer m_movementTimer;
+
+    uint32_t m_streamMask = 0;
+    uint32_t m_streamMask2 = 0;
+    int m_framesPerPacket = 1;
+    int m_packetsLeft = 0; // 0 is forever
+    float m_framePeriod = 0.f; // seconds
+
+    uint8_t m_red = 0, m_green = 0, m_blue = 0;
+    uint8_t m_speed = 0;
+    float m_heading = 0.f;
+    float m_targetHeading = 0.f;
+    float m_turnRate = 0.f; // degrees per second, for the gyro
+    float m_x = 0.f, m_y = 0.f; // cm
+    float m_time = 0.f; // for the wobbling
+
+    uint16_t m_voltage = 790; // centivolts
+};
+
+} // namespace simulator
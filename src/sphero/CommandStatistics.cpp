@@ -0,0 +1,164 @@
+#include "CommandStatistics.h"
+
+#include "logging.h"
+#include "utils.h"
+#include "v1/CommandPackets.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QVariantMap>
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+namespace sphero {
+
+CommandStatistics::CommandStatistics(QObject *parent) : QObject(parent)
+{
+}
+
+void CommandStatistics::addSample(const uint8_t deviceId, const uint8_t commandId, const qint64 microseconds)
+{
+    m_histograms[quint16(deviceId << 8 | commandId)].add(microseconds);
+    m_total.add(microseconds);
+    emit updated();
+}
+
+QVariantList CommandStatistics::commands() const
+{
+    QList<quint16> keys = m_histograms.keys();
+    std::sort(keys.begin(), keys.end());
+
+    QVariantList ret;
+    for (const quint16 key : keys) {
+        const Histogram &histogram = m_histograms[key];
+        ret.append(QVariantMap({
+            {"name", commandName(key >> 8, key & 0xFF)},
+            {"count", histogram.count},
+            {"p50", histogram.percentile(0.50)},
+            {"p95", histogram.percentile(0.95)},
+            {"p99", histogram.percentile(0.99)},
+            {"min", histogram.min / 1000.},
+            {"max", histogram.max / 1000.},
+        }));
+    }
+    return ret;
+}
+
+bool CommandStatistics::dumpToFile(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qCWarning(lcSphero) << " ! Failed to open" << path << "for writing:" << file.errorString();
+        return false;
+    }
+
+    // Tab separated so it is easy to throw into whatever
+    QTextStream out(&file);
+    out << "command\tcount\tp50_ms\tp95_ms\tp99_ms\tmin_ms\tmax_ms\n";
+    for (const QVariant &entry : commands()) {
+        const QVariantMap command = entry.toMap();
+        out << command["name"].toString() << '\t'
+            << command["count"].toInt() << '\t'
+            << command["p50"].toFloat() << '\t'
+            << command["p95"].toFloat() << '\t'
+            << command["p99"].toFloat() << '\t'
+            << command["min"].toFloat() << '\t'
+            << command["max"].toFloat() << '\n';
+    }
+    out << "total\t" << count() << '\t' << p50() << '\t' << p95() << '\t' << p99() << '\t'
+        << m_total.min / 1000. << '\t' << m_total.max / 1000. << '\n';
+
+    qCDebug(lcSphero) << " + Wrote statistics for" << m_histograms.count() << "commands to" << path;
+    return true;
+}
+
+void CommandStatistics::reset()
+{
+    m_histograms.clear();
+    m_total = Histogram();
+    emit updated();
+}
+
+QString CommandStatistics::commandName(const uint8_t deviceId, const uint8_t commandId)
+{
+    using Header = v1::CommandPacketHeader;
+
+    const char *name = nullptr;
+    switch(deviceId) {
+    case Header::Internal:
+        name = EnumHelper::toKey(Header::InternalCommand(commandId));
+        break;
+    case Header::Bootloader:
+        name = EnumHelper::toKey(Header::BootloaderCommand(commandId));
+        break;
+    case Header::HardwareControl:
+        name = EnumHelper::toKey(Header::HardwareCommand(commandId));
+        break;
+    default:
+        break;
+    }
+    if (name) {
+        return QString::fromUtf8(name);
+    }
+
+    return QStringLiteral("0x%1:0x%2").arg(deviceId, 2, 16, QLatin1Char('0')).arg(commandId, 2, 16, QLatin1Char('0'));
+}
+
+void CommandStatistics::Histogram::add(const qint64 microseconds)
+{
+    const quint32 value = quint32(qBound<qint64>(0, microseconds, std::numeric_limits<quint32>::max()));
+    buckets[bucketIndex(value)]++;
+
+    if (count == 0) {
+        min = max = microseconds;
+    } else {
+        min = qMin(min, microseconds);
+        max = qMax(max, microseconds);
+    }
+    count++;
+}
+
+float CommandStatistics::Histogram::percentile(const float fraction) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    const quint32 wanted = qMax<quint32>(1, qCeil(count * fraction));
+    quint32 seen = 0;
+    for (int i=0; i<BucketCount; i++) {
+        seen += buckets[i];
+        if (seen >= wanted) {
+            // Don't claim anything outside of what we actually have seen
+            return qBound(min / 1000.f, bucketValue(i), max / 1000.f);
+        }
+    }
+    return max / 1000.f;
+}
+
+// The highest bit selects the power of two, the next two bits the sub bucket
+int CommandStatistics::Histogram::bucketIndex(const quint32 microseconds)
+{
+    if (microseconds < SubBuckets) {
+        return microseconds;
+    }
+    const int exponent = 31 - __builtin_clz(microseconds);
+    const int subBucket = (microseconds >> (exponent - 2)) & (SubBuckets - 1);
+    return qMin((exponent - 1) * SubBuckets + subBucket, BucketCount - 1);
+}
+
+// Middle of the bucket
+float CommandStatistics::Histogram::bucketValue(const int index)
+{
+    if (index < SubBuckets) {
+        return index / 1000.f;
+    }
+    const int exponent = index / SubBuckets + 1;
+    const int subBucket = index % SubBuckets;
+    const float lower = float(quint64(SubBuckets + subBucket) << (exponent - 2));
+    const float width = float(quint64(1) << (exponent - 2));
+    return (lower + width / 2.f) / 1000.f;
+}
+
+} // namespace sphero
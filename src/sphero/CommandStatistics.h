@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QVariantList>
+#include <array>
+
+namespace sphero {
+
+// Round trip times for synchronous v1 commands, from sending until we get the matching response
+class CommandStatistics : public QObject
+{
+    Q_OBJECT
+
+    // All commands, in milliseconds
+    Q_PROPERTY(int count READ count NOTIFY updated)
+    Q_PROPERTY(float p50 READ p50 NOTIFY updated)
+    Q_PROPERTY(float p95 READ p95 NOTIFY updated)
+    Q_PROPERTY(float p99 READ p99 NOTIFY updated)
+
+public:
+    explicit CommandStatistics(QObject *parent);
+
+    void addSample(const uint8_t deviceId, const uint8_t commandId, const qint64 microseconds);
+
+    int count() const { return m_total.count; }
+    float p50() const { return m_total.percentile(0.50); }
+    float p95() const { return m_total.percentile(0.95); }
+    float p99() const { return m_total.percentile(0.99); }
+
+    // One map per command, with name, count, p50, p95, p99, min and max
+    Q_INVOKABLE QVariantList commands() const;
+
+public slots:
+    bool dumpToFile(const QString &path) const;
+    void reset();
+
+signals:
+    void updated();
+
+private:
+    // Four buckets per power of two, so the percentiles are within ~20%
+    struct Histogram {
+        static constexpr int SubBuckets = 4;
+        static constexpr int BucketCount = 32 * SubBuckets;
+
+        void add(const qint64 microseconds);
+        float percentile(const float fraction) const; // milliseconds
+
+        static int bucketIndex(const quint32 microseconds);
+        static float bucketValue(const int index); // milliseconds
+
+        std::array<quint32, BucketCount> buckets{};
+        int count = 0;
+        qint64 min = 0;
+        qint64 max = 0;
+    };
+
+    static QString commandName(const uint8_t deviceId, const uint8_t commandId);
+
+    QHash<quint16, Histogram> m_histograms;
+    Histogram m_total;
+};
+
+} // namespace sphero
@@ -0,0 +1,241 @@
+#include "SensorStream.h"
+
+#include "logging.h"
+#include "v1/CommandPackets.h"
+
+#include <QSettings>
+#include <QtMath>
+
+namespace sphero {
+
+using namespace v1::SensorChannel;
+
+SensorStream::SensorStream(QObject *parent) :
+    QObject(parent),
+    m_samples(std::make_unique<v1::SensorSamples>())
+{
+    m_mask = mask(AccelerometerX) | mask(AccelerometerY) | mask(AccelerometerZ) |
+        mask(GyroX) | mask(GyroY) | mask(GyroZ) |
+        mask(Pitch) | mask(Roll) | mask(Yaw);
+    m_mask2 = mask2(QuaternionW) | mask2(QuaternionX) | mask2(QuaternionY) | mask2(QuaternionZ) |
+        mask2(OdometerX) | mask2(OdometerY) |
+        mask2(AccelerationOne) |
+        mask2(VelocityX) | mask2(VelocityY);
+
+    QSettings settings;
+    settings.beginGroup("sphero");
+    m_enabled = settings.value("sensorStreaming", false).toBool();
+    setRate(settings.value("sensorRate", 50).toInt());
+
+    m_clock.start();
+
+    // Don't need to update the UI more often than it can draw
+    m_publishTimer.setInterval(33);
+    connect(&m_publishTimer, &QTimer::timeout, this, &SensorStream::publish);
+}
+
+SensorStream::~SensorStream()
+{
+    stopRecording();
+}
+
+void SensorStream::setEnabled(const bool enabled)
+{
+    if (enabled == m_enabled) {
+        return;
+    }
+    m_enabled = enabled;
+
+    QSettings settings;
+    settings.beginGroup("sphero");
+    settings.setValue("sensorStreaming", m_enabled);
+
+    emit configurationChanged();
+}
+
+void SensorStream::setRate(const int rate)
+{
+    const int divisor = qBound(1, MaxRate / qMax(rate, 1), MaxRate);
+
+    // BLE can't keep up with a notification for every frame at high rates
+    const int framesPerPacket = qBound(1, MaxRate / divisor / 50, v1::SensorStreamDecoder::MaxFramesPerPacket);
+
+    if (divisor == m_rateDivisor && framesPerPacket == m_framesPerPacket) {
+        return;
+    }
+    m_rateDivisor = divisor;
+    m_framesPerPacket = framesPerPacket;
+
+    QSettings settings;
+    settings.beginGroup("sphero");
+    settings.setValue("sensorRate", this->rate());
+
+    emit configurationChanged();
+}
+
+void SensorStream::setFramesPerPacket(const int frames)
+{
+    const int framesPerPacket = qBound(1, frames, v1::SensorStreamDecoder::MaxFramesPerPacket);
+    if (framesPerPacket == m_framesPerPacket) {
+        return;
+    }
+    m_framesPerPacket = framesPerPacket;
+    emit configurationChanged();
+}
+
+QByteArray SensorStream::streamingCommand()
+{
+    reset();
+
+    if (!m_enabled) {
+        m_decoder.configure(0, 0);
+        m_publishTimer.stop();
+        return v1::DataStreamingCommandPacket::create(0, m_rateDivisor, 1, 0, 0);
+    }
+
+    m_decoder.configure(m_mask, m_mask2);
+    m_publishTimer.start();
+
+    qCDebug(lcSphero) << " - Streaming" << m_decoder.channelCount() << "channels at" << rate() << "Hz," << m_framesPerPacket << "frames per packet";
+    return v1::DataStreamingCommandPacket::create(0, m_rateDivisor, m_framesPerPacket, m_mask, m_mask2);
+}
+
+void SensorStream::handleSensorData(const char *data, const int size)
+{
+    const quint64 first = m_samples->written;
+    const qint64 framePeriod = 1000 * 1000 * m_rateDivisor / MaxRate;
+    const int count = m_decoder.decode(data, size, m_clock.nsecsElapsed() / 1000, framePeriod, m_samples.get());
+    if (count < 0) {
+        m_invalidPackets++;
+        return;
+    }
+
+    if (m_recordFile.isOpen()) {
+        record(first, count);
+    }
+
+    m_dirty = true;
+    emit framesDecoded(first, count);
+}
+
+void SensorStream::reset()
+{
+    m_samples->clear();
+    m_invalidPackets = 0;
+    m_publishedFrames = 0;
+    m_measuredRate = 0.f;
+    m_lastPublish = m_clock.elapsed();
+    m_dirty = true;
+}
+
+void SensorStream::publish()
+{
+    if (!m_dirty) {
+        return;
+    }
+    m_dirty = false;
+
+    const qint64 now = m_clock.elapsed();
+    if (now > m_lastPublish) {
+        m_measuredRate = (m_samples->written - m_publishedFrames) * 1000.f / (now - m_lastPublish);
+    }
+    m_publishedFrames = m_samples->written;
+    m_lastPublish = now;
+
+    emit updated();
+}
+
+QVector3D SensorStream::accelerometer() const
+{
+    return QVector3D(latest(AccelerometerX), latest(AccelerometerY), latest(AccelerometerZ));
+}
+
+QVector3D SensorStream::gyroscope() const
+{
+    return QVector3D(latest(GyroX), latest(GyroY), latest(GyroZ));
+}
+
+QVector3D SensorStream::orientation() const
+{
+    return QVector3D(latest(Pitch), latest(Roll), latest(Yaw));
+}
+
+QQuaternion SensorStream::quaternion() const
+{
+    return QQuaternion(latest(QuaternionW), latest(QuaternionX), latest(QuaternionY), latest(QuaternionZ));
+}
+
+QPointF SensorStream::odometer() const
+{
+    return QPointF(latest(OdometerX), latest(OdometerY));
+}
+
+QPointF SensorStream::velocity() const
+{
+    return QPointF(latest(VelocityX), latest(VelocityY));
+}
+
+bool SensorStream::startRecording(const QString &path)
+{
+    stopRecording();
+
+    m_recordFile.setFileName(path);
+    if (!m_recordFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qCWarning(lcSphero) << " ! Failed to open" << path << "for recording:" << m_recordFile.errorString();
+        return false;
+    }
+
+    QByteArray header = "timestamp_us";
+    for (const Definition &definition : definitions) {
+        header += ',';
+        header += definition.name;
+    }
+    header += '\n';
+    m_recordFile.write(header);
+
+    qCDebug(lcSphero) << " + Recording sensor data to" << path;
+    emit recordingChanged();
+    return true;
+}
+
+void SensorStream::stopRecording()
+{
+    if (!m_recordFile.isOpen()) {
+        return;
+    }
+    m_recordFile.close();
+    qCDebug(lcSphero) << " + Stopped recording to" << m_recordFile.fileName();
+    emit recordingChanged();
+}
+
+// Everything is in the file, disabled channels are just left empty
+void SensorStream::record(const quint64 first, const int count)
+{
+    QByteArray lines;
+    lines.reserve(count * ChannelCount * 8);
+
+    const int channelCount = m_decoder.channelCount();
+    const Channel *channels = m_decoder.channels();
+
+    for (int frame=0; frame<count; frame++) {
+        const int index = (first + frame) % v1::SensorSamples::Capacity;
+        lines += QByteArray::number(m_samples->timestamps[index]);
+
+        int enabled = 0;
+        for (int channel=0; channel<ChannelCount; channel++) {
+            lines += ',';
+            if (enabled < channelCount && channels[enabled] == channel) {
+                lines += QByteArray::number(m_samples->channels[channel][index], 'g', 6);
+                enabled++;
+            }
+        }
+        lines += '\n';
+    }
+
+    if (m_recordFile.write(lines) != lines.size()) {
+        qCWarning(lcSphero) << " ! Failed to write sensor data:" << m_recordFile.errorString();
+        stopRecording();
+    }
+}
+
+} // namespace sphero
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "v1/SensorStream.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPointF>
+#include <QQuaternion>
+#include <QTimer>
+#include <QVector3D>
+#include <memory>
+
+namespace sphero {
+
+// Data streaming from the v1 robots. The robot samples at 400 Hz internally,
+// we decode everything as it comes in, but only tell QML about it at a sane rate.
+class SensorStream : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY configurationChanged)
+    Q_PROPERTY(int rate READ rate WRITE setRate NOTIFY configurationChanged) // Hz, 400 / divisor
+    Q_PROPERTY(int framesPerPacket READ framesPerPacket WRITE setFramesPerPacket NOTIFY configurationChanged)
+
+    Q_PROPERTY(QVector3D accelerometer READ accelerometer NOTIFY updated) // G
+    Q_PROPERTY(QVector3D gyroscope READ gyroscope NOTIFY updated) // degrees per second
+    Q_PROPERTY(QVector3D orientation READ orientation NOTIFY updated) // pitch, roll, yaw in degrees
+    Q_PROPERTY(QQuaternion quaternion READ quaternion NOTIFY updated)
+    Q_PROPERTY(QPointF odometer READ odometer NOTIFY updated) // cm
+    Q_PROPERTY(QPointF velocity READ velocity NOTIFY updated) // mm/s
+
+    Q_PROPERTY(float measuredRate READ measuredRate NOTIFY updated)
+    Q_PROPERTY(int framesReceived READ framesReceived NOTIFY updated)
+    Q_PROPERTY(int invalidPackets READ invalidPackets NOTIFY updated)
+
+    Q_PROPERTY(bool recording READ isRecording NOTIFY recordingChanged)
+
+public:
+    static constexpr int MaxRate = 400;
+
+    explicit SensorStream(QObject *parent);
+    ~SensorStream();
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(const bool enabled);
+
+    int rate() const { return MaxRate / m_rateDivisor; }
+    void setRate(const int rate);
+
+    int framesPerPacket() const { return m_framesPerPacket; }
+    void setFramesPerPacket(const int frames);
+
+    // Payload for SetDataStreaming, turns it off if we're disabled.
+    // Also resets the decoder to the new configuration.
+    QByteArray streamingCommand();
+
+    void handleSensorData(const char *data, const int size);
+    void reset();
+
+    const v1::SensorSamples &samples() const { return *m_samples; }
+
+    QVector3D accelerometer() const;
+    QVector3D gyroscope() const;
+    QVector3D orientation() const;
+    QQuaternion quaternion() const;
+    QPointF odometer() const;
+    QPointF velocity() const;
+
+    float measuredRate() const { return m_measuredRate; }
+    int framesReceived() const { return int(m_samples->written); }
+    int invalidPackets() const { return m_invalidPackets; }
+
+    bool isRecording() const { return m_recordFile.isOpen(); }
+
+public slots:
+    // Writes all decoded samples as CSV until stopped
+    bool startRecording(const QString &path);
+    void stopRecording();
+
+signals:
+    void configurationChanged();
+    void updated();
+    void recordingChanged();
+
+    // For anyone who wants everything, not just what QML gets
+    void framesDecoded(const quint64 first, const int count);
+
+private slots:
+    void publish();
+
+private:
+    void record(const quint64 first, const int count);
+
+    float latest(const v1::SensorChannel::Channel channel) const {
+        return m_samples->latest(channel);
+    }
+
+    bool m_enabled = false;
+    int m_rateDivisor = 8; // 50 Hz
+    int m_framesPerPacket = 1;
+    uint32_t m_mask = 0;
+    uint32_t m_mask2 = 0;
+
+    v1::SensorStreamDecoder m_decoder;
+    std::unique_ptr<v1::SensorSamples> m_samples; // big-ish
+    int m_invalidPackets = 0;
+
+    QElapsedTimer m_clock;
+    QTimer m_publishTimer;
+    bool m_dirty = false;
+    quint64 m_publishedFrames = 0;
+    qint64 m_lastPublish = 0;
+    float m_measuredRate = 0.f;
+
+    QFile m_recordFile;
+};
+
+} // namespace sphero
@@ -3,7 +3,13 @@
 
 #include "SpheroHandler.h"
 #include "utils.h"
+#include "logging.h"
+#include "gattcache.h"
 #include "Uuids.h"
+#include "CommandStatistics.h"
+#include "SensorStream.h"
+#include "transport/Recorder.h"
+#include "transport/Transport.h"
 
 #include "v1/ResponsePackets.h"
 #include "v1/CommandPackets.h"
@@ -16,6 +22,7 @@
 #include <QDateTime>
 #include <QtEndian>
 #include <QCoreApplication>
+#include <QSettings>
 
 namespace sphero {
 
@@ -121,31 +128,36 @@ bool isValidRobot(const QString &name, const QString &address)
 
 SpheroHandler::SpheroHandler(const QBluetoothDeviceInfo &deviceInfo, QObject *parent) :
     QObject(parent),
+    m_address(deviceInfo.address()),
     m_name(deviceInfo.name()),
     m_robot(typeFromName(deviceInfo.name()))
 
 {
-    m_robotType = typeFromName(m_name);
-    qDebug() << "Connecting to" << deviceInfo.address().toString();
+    qCDebug(lcSphero) << "Connecting to" << deviceInfo.address().toString();
+
+    initialize();
 
-    qDebug() << sizeof(SensorStreamPacket);
+    m_knownServices = GattCache::load(m_address, deviceType()).hasServices({m_robot.radioService, m_robot.mainService});
+
+    qCDebug(lcSphero) << sizeof(SensorStreamPacket);
     m_deviceController = QLowEnergyController::createCentral(deviceInfo, this);
 
     connect(m_deviceController, &QLowEnergyController::connected, m_deviceController, &QLowEnergyController::discoverServices);
+    connect(m_deviceController, &QLowEnergyController::serviceDiscovered, this, &SpheroHandler::onServiceDiscovered);
     connect(m_deviceController, &QLowEnergyController::discoveryFinished, this, &SpheroHandler::onServiceDiscoveryFinished);
 
     connect(m_deviceController, &QLowEnergyController::connectionUpdated, this, [](const QLowEnergyConnectionParameters &parms) {
-            qDebug() << " - controller connection updated, latency" << parms.latency() << "maxinterval:" << parms.maximumInterval() << "mininterval:" << parms.minimumInterval() << "supervision timeout" << parms.supervisionTimeout();
+            qCDebug(lcSphero) << " - controller connection updated, latency" << parms.latency() << "maxinterval:" << parms.maximumInterval() << "mininterval:" << parms.minimumInterval() << "supervision timeout" << parms.supervisionTimeout();
             });
     connect(m_deviceController, &QLowEnergyController::connected, this, []() {
-            qDebug() << " - controller connected";
+            qCDebug(lcSphero) << " - controller connected";
             });
     connect(m_deviceController, &QLowEnergyController::disconnected, this, []() {
-            qDebug() << " ! controller disconnected";
+            qCDebug(lcSphero) << " ! controller disconnected";
             });
     connect(m_deviceController, &QLowEnergyController::disconnected, this, &SpheroHandler::disconnected);
     connect(m_deviceController, &QLowEnergyController::discoveryFinished, this, []() {
-            qDebug() << " - controller discovery finished";
+            qCDebug(lcSphero) << " - controller discovery finished";
             });
     connect(m_deviceController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::error), this, &SpheroHandler::onControllerError);
 
@@ -154,46 +166,131 @@ SpheroHandler::SpheroHandler(const QBluetoothDeviceInfo &deviceInfo, QObject *pa
     m_deviceController->connectToDevice();
 
     if (m_deviceController->error() != QLowEnergyController::NoError) {
-        qWarning() << " ! controller error when starting:" << m_deviceController->error() << m_deviceController->errorString();
+        qCWarning(lcSphero) << " ! controller error when starting:" << m_deviceController->error() << m_deviceController->errorString();
+    }
+    qCDebug(lcSphero) << " - Created handler";
+}
+
+SpheroHandler::SpheroHandler(transport::Transport *transport, QObject *parent) :
+    QObject(parent),
+    m_transport(transport),
+    m_name(transport->name()),
+    m_robot(typeFromName(transport->name()))
+{
+    qCDebug(lcSphero) << "Connecting through" << transport->name();
+
+    initialize();
+
+    m_transport->setParent(this);
+
+    connect(m_transport, &transport::Transport::connected, this, &SpheroHandler::startSession);
+    connect(m_transport, &transport::Transport::disconnected, this, &SpheroHandler::onDisconnected);
+    connect(m_transport, &transport::Transport::received, this, &SpheroHandler::handleData);
+
+    m_transport->connectToRobot();
+}
+
+void SpheroHandler::initialize()
+{
+    m_robotType = typeFromName(m_name);
+
+    m_commandStatistics = new CommandStatistics(this);
+    m_requestTimer.start();
+
+    QSettings settings;
+    settings.beginGroup("sphero");
+    m_pendingSyncRequests.setTimeout(settings.value("requestTimeout", 500).toLongLong() * 1000 * 1000);
+    m_pendingSyncRequests.setMaxRetries(settings.value("requestRetries", 2).toInt());
+
+    m_requestTimeoutTimer.setInterval(50);
+    connect(&m_requestTimeoutTimer, &QTimer::timeout, this, &SpheroHandler::checkRequestTimeouts);
+
+    m_sensors = new SensorStream(this);
+    connect(m_sensors, &SensorStream::configurationChanged, this, &SpheroHandler::sendStreamingConfiguration);
+}
+
+void SpheroHandler::setRecorder(transport::Recorder *recorder)
+{
+    if (m_recorder) {
+        m_recorder->deleteLater();
+    }
+    m_recorder = recorder;
+    if (m_recorder) {
+        m_recorder->setParent(this);
     }
-    qDebug() << " - Created handler";
 }
 
 SpheroHandler::~SpheroHandler()
 {
-    qDebug() << " - sphero handler dead";
-    if (m_deviceController) {
+    qCDebug(lcSphero) << " - sphero handler dead";
+    if (m_transport) {
+        // We're going away, so don't care about it telling us
+        disconnect(m_transport, nullptr, this, nullptr);
+        disconnectFromRobot();
+    } else if (m_deviceController) {
         disconnectFromRobot();
     } else {
-        qWarning() << "no controller";
+        qCWarning(lcSphero) << "no controller";
     }
 }
 
+QObject *SpheroHandler::commandStatistics() const
+{
+    return m_commandStatistics;
+}
+
+QObject *SpheroHandler::sensors() const
+{
+    return m_sensors;
+}
+
+void SpheroHandler::sendStreamingConfiguration()
+{
+    if (m_robot.api != RobotDefinition::V1) {
+        qCDebug(lcSphero) << "Sensor streaming only implemented for v1";
+        return;
+    }
+    if (!canWrite()) {
+        qCDebug(lcSphero) << "Not connected, not configuring streaming yet";
+        return;
+    }
+    sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::SetDataStreaming, m_sensors->streamingCommand(), true);
+}
+
 void SpheroHandler::disconnectFromRobot()
 {
     if (!isConnected()) {
-        qDebug() << "Can't disconnect when not connected";
+        qCDebug(lcSphero) << "Can't disconnect when not connected";
         return;
     }
+    emit disconnectRequested();
 
     setAutoStabilize(false);
     brake();
     goToSleep();
 
-    // Disconnect from device invalidates
-    disconnect(m_mainService, nullptr, this, nullptr);
-    m_mainService->deleteLater();
-    disconnect(m_radioService, nullptr, this, nullptr);
-    m_radioService->deleteLater();
+    if (m_transport) {
+        m_transport->disconnectFromRobot();
+    } else {
+        // Disconnect from device invalidates
+        disconnect(m_mainService, nullptr, this, nullptr);
+        m_mainService->deleteLater();
+        disconnect(m_radioService, nullptr, this, nullptr);
+        m_radioService->deleteLater();
 
-    m_deviceController->disconnectFromDevice();
+        m_deviceController->disconnectFromDevice();
+    }
 
-    qDebug() << "Disconnected from robot";
+    qCDebug(lcSphero) << "Disconnected from robot";
     emit statusMessageChanged("Disconnected");
 }
 
 bool SpheroHandler::isConnected()
 {
+    if (m_transport) {
+        return m_transport->isConnected();
+    }
+
     return m_deviceController && m_deviceController->state() != QLowEnergyController::UnconnectedState &&
             m_mainService && m_mainService->state() == QLowEnergyService::ServiceDiscovered &&
             m_radioService && m_radioService->state() == QLowEnergyService::ServiceDiscovered &&
@@ -230,18 +327,18 @@ void SpheroHandler::setColor(const int r, const int g, const int b)
             bodyLED = v2::B9BodyLED;
             break;
         default:
-            qWarning() << "Don't know ID of body led for" << m_robotType;
+            qCWarning(lcSphero) << "Don't know ID of body led for" << m_robotType;
             break;
         }
 
         if (bodyLED != v2::InvalidLED) {
             // Set the body to green
-            m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::SetLED(bodyLED, r, g, b)));
+            writeCommand(v2::encode(v2::SetLED(bodyLED, r, g, b)));
         }
         break;
     }
     default:
-        qWarning() << "TODO setcolor";
+        qCWarning(lcSphero) << "TODO setcolor";
         break;
     }
 
@@ -272,7 +369,7 @@ void SpheroHandler::setSpeedAndAngle(int speed, int angle)
         if (m_robotType == RobotType::BB9E) {
             speed *= 0.75;
         }
-        m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::DrivePacket(speed, angle)));
+        writeCommand(v2::DrivePacket::encode(speed, angle));
         break;
     }
 
@@ -306,7 +403,7 @@ void SpheroHandler::setAngle(int angle)
         angle += 360;
     }
     angle %= 360;
-    qDebug() << "Setting angle to" << angle;
+    qCDebug(lcSphero) << "Setting angle to" << angle;
 
     if (angle == m_angle) {
         return;
@@ -318,8 +415,8 @@ void SpheroHandler::setAngle(int angle)
         sendCommandV1(v1::RollCommandPacket({uint8_t(m_speed), qbswap<quint16>(uint16_t(angle)), v1::RollCommandPacket::Brake}));
         break;
     default:
-        m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::DrivePacket(0, angle, v2::DrivePacket::FastTurn)));
-        qWarning() << "TODO setangle";
+        writeCommand(v2::DrivePacket::encode(0, angle, v2::DrivePacket::FastTurn));
+        qCWarning(lcSphero) << "TODO setangle";
         break;
     }
 
@@ -334,10 +431,10 @@ void SpheroHandler::brake()
         sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(0), v1::RollCommandPacket::Brake}));
         break;
     case RobotDefinition::V2:
-        m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::DrivePacket(0, 0)));
+        writeCommand(v2::DrivePacket::encode(0, 0));
         break;
     default:
-        qWarning() << "TODO brake";
+        qCWarning(lcSphero) << "TODO brake";
         break;
     }
 }
@@ -349,7 +446,7 @@ void SpheroHandler::faceLeft()
         sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(270), v1::RollCommandPacket::Brake}));
         break;
     default:
-        qWarning() << "TODO faceleft";
+        qCWarning(lcSphero) << "TODO faceleft";
         break;
     }
 }
@@ -361,7 +458,7 @@ void SpheroHandler::faceRight()
         sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(90), v1::RollCommandPacket::Brake}));
         break;
     default:
-        qWarning() << "TODO faceleft";
+        qCWarning(lcSphero) << "TODO faceleft";
         break;
     }
 }
@@ -373,7 +470,7 @@ void SpheroHandler::faceForward()
         sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(0), v1::RollCommandPacket::Brake}));
         break;
     default:
-        qWarning() << "TODO faceforward";
+        qCWarning(lcSphero) << "TODO faceforward";
         break;
     }
 }
@@ -383,14 +480,14 @@ void SpheroHandler::setAutoStabilize(const bool enabled)
 {
     switch(m_robot.api) {
     case RobotDefinition::V1:
-        sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::SetStabilization, QByteArray(enabled ? "\x1" : "\x0"));
+        sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::SetStabilization, QByteArray(enabled ? "\x1" : "\x0"), true);
         if (enabled != m_autoStabilize) {
             m_autoStabilize = enabled;
             emit autoStabilizeChanged();
         }
         break;
     default:
-        qWarning() << "TODO setautostabilize";
+        qCWarning(lcSphero) << "TODO setautostabilize";
         break;
     }
 }
@@ -402,7 +499,7 @@ void SpheroHandler::setDetectCollisions(const bool enabled)
         sendCommandV1(v1::EnableCollisionDetectionPacket(enabled));
         break;
     default:
-        qWarning() << "TODO set detect collisions";
+        qCWarning(lcSphero) << "TODO set detect collisions";
         break;
     }
 }
@@ -411,13 +508,13 @@ void SpheroHandler::goToSleep()
 {
     switch(m_robot.api) {
     case RobotDefinition::V1:
-        sendCommandV1(v1::GoToSleepPacket());
+        sendCommandV1(v1::GoToSleepPacket::encoded);
         break;
     case RobotDefinition::V2:
-        m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::GoToLightSleep()));
+        writeCommand(v2::GoToLightSleep::encoded.toRawByteArray());
         break;
     default:
-        qWarning() << "TODO gotosleep";
+        qCWarning(lcSphero) << "TODO gotosleep";
         break;
     }
 }
@@ -431,7 +528,7 @@ void SpheroHandler::goToDeepSleep()
         sendRadioControlCommand(Characteristics::Radio::V1::deepSleep, "011i3");
         break;
     default:
-        qWarning() << "TODO gotodeepsleep";
+        qCWarning(lcSphero) << "TODO gotodeepsleep";
         break;
     }
 }
@@ -443,7 +540,7 @@ void SpheroHandler::enablePowerNotifications()
         sendCommandV1(v1::CommandPacketHeader::Internal, v1::CommandPacketHeader::SetPwrNotify, QByteArray("\x1", 1));
         break;
     default:
-        qWarning() << "TODO enable power notifications";
+        qCWarning(lcSphero) << "TODO enable power notifications";
         break;
     }
 }
@@ -455,7 +552,7 @@ void SpheroHandler::setEnableAsciiShell(const bool enabled)
         sendCommandV1(v1::SetUserHackModePacket({enabled}));
         break;
     default:
-        qWarning() << "TODO enable ascii shell";
+        qCWarning(lcSphero) << "TODO enable ascii shell";
         break;
     }
 }
@@ -472,7 +569,7 @@ void SpheroHandler::boost(int angle, int duration)
         sendCommandV1(v1::BoostCommandPacket({uint8_t(qBound(0, duration, 255)), uint16_t(angle)}));
         break;
     default:
-        qWarning() << "TODO boost";
+        qCWarning(lcSphero) << "TODO boost";
         break;
     }
 
@@ -482,17 +579,37 @@ void SpheroHandler::boost(int angle, int duration)
     }
 }
 
+void SpheroHandler::onServiceDiscovered(const QBluetoothUuid &newService)
+{
+    if (!m_knownServices || m_radioService) {
+        return;
+    }
+
+    const QList<QBluetoothUuid> services = m_deviceController->services();
+    if (!services.contains(m_robot.radioService) || !services.contains(m_robot.mainService)) {
+        return;
+    }
+
+    qCDebug(lcSphero) << " - Found the services we know from before, not waiting for the rest" << newService;
+    onServiceDiscoveryFinished();
+}
+
 void SpheroHandler::onServiceDiscoveryFinished()
 {
-    qDebug() << " - Discovered services";
+    // Already set up when we found them
+    if (m_radioService && m_mainService) {
+        return;
+    }
+
+    qCDebug(lcSphero) << " - Discovered services";
 
 #if 0 // for dumping all services and all their characteristics
     for (const QBluetoothUuid &service : m_deviceController->services()) {
-        qDebug() << service;
+        qCDebug(lcSphero) << service;
         QLowEnergyService *leService = m_deviceController->createServiceObject(service);
         connect(leService, &QLowEnergyService::stateChanged, this, [=](QLowEnergyService::ServiceState newState) {
             if (newState == QLowEnergyService::InvalidService) {
-                qWarning() << "invalided" << service;
+                qCWarning(lcSphero) << "invalided" << service;
                 leService->deleteLater();
                 return;
             }
@@ -502,12 +619,12 @@ void SpheroHandler::onServiceDiscoveryFinished()
             }
 
             if (newState != QLowEnergyService::ServiceDiscovered) {
-                qDebug() << " ! unhandled service state changed:" << newState;
+                qCDebug(lcSphero) << " ! unhandled service state changed:" << newState;
                 leService->deleteLater();
                 return;
             }
             for (const QLowEnergyCharacteristic &characteristic : leService->characteristics()) {
-                qDebug() << "service" << service << "has char" << characteristic.uuid() << characteristic.name();
+                qCDebug(lcSphero) << "service" << service << "has char" << characteristic.uuid() << characteristic.name();
             }
             leService->deleteLater();
         });
@@ -517,42 +634,42 @@ void SpheroHandler::onServiceDiscoveryFinished()
 
     m_radioService = m_deviceController->createServiceObject(m_robot.radioService, this);
     if (!m_radioService) {
-        qWarning() << " ! Failed to get radio service";
+        qCWarning(lcSphero) << " ! Failed to get radio service";
         return;
     }
-    qDebug() << " - Got radio service";
+    qCDebug(lcSphero) << " - Got radio service";
 
     connect(m_radioService, &QLowEnergyService::characteristicChanged, this, &SpheroHandler::onCharacteristicChanged);
     connect(m_radioService, &QLowEnergyService::stateChanged, this, &SpheroHandler::onRadioServiceChanged);
     connect(m_radioService, QOverload<QLowEnergyService::ServiceError>::of(&QLowEnergyService::error), this, &SpheroHandler::onServiceError);
 
     connect(m_radioService, &QLowEnergyService::characteristicWritten, this, [](const QLowEnergyCharacteristic &c, const QByteArray &v) {
-        qDebug() << " - " << c.uuid() << "radio written" << v;
+        qCDebug(lcSphero) << " - " << c.uuid() << "radio written" << v;
     });
 
 
     if (m_mainService) {
-        qWarning() << " ! main service already exists!";
+        qCWarning(lcSphero) << " ! main service already exists!";
         return;
     }
 
     m_mainService = m_deviceController->createServiceObject(m_robot.mainService, this);
     if (!m_mainService) {
-        qWarning() << " ! no main service";
+        qCWarning(lcSphero) << " ! no main service";
         return;
     }
 
     connect(m_mainService, &QLowEnergyService::descriptorWritten, this, [](const QLowEnergyDescriptor  &info, const QByteArray &value) {
-        qDebug() << "main descriptor write" << value;
+        qCDebug(lcSphero) << "main descriptor write" << value;
     });
     connect(m_mainService, &QLowEnergyService::descriptorRead, this, [](const QLowEnergyDescriptor  &info, const QByteArray &value) {
-        qDebug() << "main descriptor read" << value;
+        qCDebug(lcSphero) << "main descriptor read" << value;
     });
 
     connect(m_mainService, &QLowEnergyService::characteristicChanged, this, &SpheroHandler::onCharacteristicChanged);
     connect(m_mainService, QOverload<QLowEnergyService::ServiceError>::of(&QLowEnergyService::error), this, &SpheroHandler::onServiceError);
     connect(m_mainService, &QLowEnergyService::characteristicWritten, this, [](const QLowEnergyCharacteristic &info, const QByteArray &value) {
-        qDebug() << " - main written" << info.uuid() << value.toHex(':');
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - main written" << info.uuid() << value.toHex(':');
     });
     connect(m_mainService, &QLowEnergyService::stateChanged, this, &SpheroHandler::onMainServiceChanged);
 
@@ -561,10 +678,13 @@ void SpheroHandler::onServiceDiscoveryFinished()
 
 void SpheroHandler::onMainServiceChanged(QLowEnergyService::ServiceState newState)
 {
-    qDebug() << " ! mainservice change" << newState;
+    qCDebug(lcSphero) << " ! mainservice change" << newState;
 
     if (newState == QLowEnergyService::InvalidService) {
-        qWarning() << "Got invalid service";
+        qCWarning(lcSphero) << "Got invalid service";
+        if (m_knownServices) {
+            GattCache::forget(m_address);
+        }
         emit disconnected();
         emit statusMessageChanged(tr("Sphero BLE service failed"));
         return;
@@ -575,17 +695,17 @@ void SpheroHandler::onMainServiceChanged(QLowEnergyService::ServiceState newStat
     }
 
     if (newState != QLowEnergyService::ServiceDiscovered) {
-        qDebug() << " ! unhandled service state changed:" << newState;
+        qCDebug(lcSphero) << " ! unhandled service state changed:" << newState;
         return;
     }
 
     for (const QLowEnergyCharacteristic &characteristic : m_mainService->characteristics()) {
-        qDebug() << "service has char" << characteristic.uuid() << characteristic.name();
+        qCDebug(lcSphero) << "service has char" << characteristic.uuid() << characteristic.name();
     }
 
     m_commandsCharacteristic = m_mainService->characteristic(m_robot.commandsCharacteristic);
     if (!m_commandsCharacteristic.isValid()) {
-        qWarning() << " ! Commands characteristic invalid";
+        qCWarning(lcSphero) << " ! Commands characteristic invalid";
         return;
     }
 
@@ -598,11 +718,11 @@ void SpheroHandler::onMainServiceChanged(QLowEnergyService::ServiceState newStat
         responseCharacteristic = m_commandsCharacteristic;
         break;
     default:
-        qWarning() << "Unhandled API version";
+        qCWarning(lcSphero) << "Unhandled API version";
         return;
     }
     if (!responseCharacteristic.isValid()) {
-        qWarning() << " ! response characteristic invalid";
+        qCWarning(lcSphero) << " ! response characteristic invalid";
         return;
     }
 
@@ -611,22 +731,35 @@ void SpheroHandler::onMainServiceChanged(QLowEnergyService::ServiceState newStat
     m_mainService->writeDescriptor(responseCharacteristic.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration), QByteArray::fromHex("0100"));
     m_mainService->writeDescriptor(m_mainService->characteristic(Characteristics::Main::V2::unknown1).descriptor(QBluetoothUuid::ClientCharacteristicConfiguration), QByteArray::fromHex("0100"));
 
-    qDebug() << " - Successfully connected";
+    qCDebug(lcSphero) << " - Successfully connected";
+
+    GattCache::Entry cacheEntry;
+    cacheEntry.type = deviceType();
+    cacheEntry.services = { m_robot.radioService, m_robot.mainService };
+    GattCache::store(m_address, cacheEntry);
 
+    emit connectionEstablished();
+    startSession();
+}
+
+void SpheroHandler::startSession()
+{
     switch(m_robot.api) {
     case RobotDefinition::V1:
         sendCommandV1(v1::SetPowerNotifyCommandPacket{0});
-        sendCommandV1(v1::CommandPacketHeader::Internal, v1::CommandPacketHeader::Ping, {});
+        sendCommandV1(v1::PingPacket::encoded);
         sendCommandV1(v1::SetNonPersistentOptionsPacket{v1::SetNonPersistentOptionsPacket::StopOnDisconnect});
         setAutoStabilize(true);
         setDetectCollisions(true);
-        sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::SetDataStreaming, v1::DataStreamingCommandPacket::create(1) );
+        sendStreamingConfiguration();
+        sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(0), v1::RollCommandPacket::Calibrate}));
+        sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::GetLocatorData, {});
         break;
     case RobotDefinition::V2:
-        m_mainService->writeCharacteristic(m_commandsCharacteristic, v2::encode(v2::WakePacket()));
+        writeCommand(v2::WakePacket::encoded.toRawByteArray());
         break;
     default:
-        qWarning() << "Unhandled API version";
+        qCWarning(lcSphero) << "Unhandled API version";
         return;
     }
 
@@ -639,22 +772,33 @@ void SpheroHandler::onMainServiceChanged(QLowEnergyService::ServiceState newStat
 void SpheroHandler::onControllerStateChanged(QLowEnergyController::ControllerState state)
 {
     if (state == QLowEnergyController::UnconnectedState) {
-        qWarning() << " ! Disconnected";
-        emit disconnected();
-        emit statusMessageChanged(tr("Sphero lost connection"));
+        onDisconnected();
         return;
     }
 
-    qDebug() << " - controller state changed" << state;
+    qCDebug(lcSphero) << " - controller state changed" << state;
     emit connectedChanged();
     emit statusMessageChanged(statusString());
 }
 
+void SpheroHandler::onDisconnected()
+{
+    qCWarning(lcSphero) << " ! Disconnected";
+    m_pendingSyncRequests.clear();
+    m_requestTimeoutTimer.stop();
+    m_sensors->reset();
+    m_receiveBuffer.clear();
+    m_decoderV2.reset();
+    emit disconnected();
+    emit connectedChanged();
+    emit statusMessageChanged(tr("Sphero lost connection"));
+}
+
 void SpheroHandler::onControllerError(QLowEnergyController::Error newError)
 {
-    qWarning() << " - controller error:" << newError << m_deviceController->errorString();
+    qCWarning(lcSphero) << " - controller error:" << newError << m_deviceController->errorString();
     if (newError == QLowEnergyController::UnknownError) {
-        qWarning() << "Probably 'Operation already in progress' because qtbluetooth doesn't understand why it can't get answers over dbus when a connection attempt hangs";
+        qCWarning(lcSphero) << "Probably 'Operation already in progress' because qtbluetooth doesn't understand why it can't get answers over dbus when a connection attempt hangs";
         emit statusMessageChanged(tr("Sphero connection attempt hung, out of range?"));
     }
     emit disconnected();
@@ -663,15 +807,20 @@ void SpheroHandler::onControllerError(QLowEnergyController::Error newError)
 
 void SpheroHandler::onServiceError(QLowEnergyService::ServiceError error)
 {
-    qWarning() << "Service error:" << error;
+    qCWarning(lcSphero) << "Service error:" << error;
     if (error == QLowEnergyService::NoError) {
         return;
     }
     if (error == QLowEnergyService::OperationError) {
-        qWarning() << "OPeration error";
+        qCWarning(lcSphero) << "OPeration error";
         return;
     }
 
+    // Might be from setting it up too early, so do it properly next time
+    if (m_knownServices) {
+        GattCache::forget(m_address);
+    }
+
     emit statusMessageChanged(tr("Sphero service connection failed: %1").arg(error));
     emit disconnected();
 }
@@ -680,19 +829,26 @@ void SpheroHandler::onCharacteristicChanged(const QLowEnergyCharacteristic &char
 {
 
     if (data.isEmpty()) {
-        qWarning() << " ! " << characteristic.uuid() << "got empty data";
+        qCWarning(lcSphero) << " ! " << characteristic.uuid() << "got empty data";
         return;
     }
 
+    if (m_recorder) {
+        // Still recorded, but a replay shouldn't feed it to the parser
+        const bool isServiceChanged = characteristic.uuid() == QBluetoothUuid::ServiceChanged;
+        const bool isStream = !isServiceChanged && (m_robot.api == RobotDefinition::V2 || characteristic.uuid() == Characteristics::Main::V1::response);
+        m_recorder->record(transport::Recorder::Received, characteristic.uuid(), data, isStream);
+    }
+
     if (characteristic.uuid() == QBluetoothUuid::ServiceChanged) {
         // TODO: I think maybe this is when it is removed from the charger, and the battery service becomes available
-        qDebug() << " ? GATT service changed" << data.toHex(':');
+        qCDebug(lcSphero) << " ? GATT service changed" << data.toHex(':');
         return;
     }
 
     switch(m_robot.api) {
     case RobotDefinition::V1:
-        qDebug() << "main characteristic changed";
+        PROTOCOL_TRACE(lcSpheroProtocol) << "main characteristic changed";
         if (characteristic.uuid() == Characteristics::Radio::V1::rssi) {
             m_rssi = data[0];
             emit rssiChanged();
@@ -704,194 +860,228 @@ void SpheroHandler::onCharacteristicChanged(const QLowEnergyCharacteristic &char
             break;
         }
 
-        qWarning() << " ? Changed from unexpected characteristic" << characteristic.name() << characteristic.uuid() << data;
+        qCWarning(lcSphero) << " ? Changed from unexpected characteristic" << characteristic.name() << characteristic.uuid() << data;
         break;
 
     case RobotDefinition::V2:
         parsePacketV2(data);
         break;
     default:
-        qWarning() << " !!!!! Unhandled API version";
-        qDebug() << "characteristic" << characteristic.uuid();
-        qDebug() << "DatA:" << data.toHex(':');
+        qCWarning(lcSphero) << " !!!!! Unhandled API version";
+        qCDebug(lcSphero) << "characteristic" << characteristic.uuid();
+        qCDebug(lcSphero) << "DatA:" << data.toHex(':');
         break;
 
     }
 }
 
-void SpheroHandler::parsePacketV2(const QByteArray &data)
+void SpheroHandler::handleData(const QByteArray &data)
 {
-    if (data.startsWith(v2::StartOfPacket)) {
-        m_receiveBuffer = data;
-    } else if (!m_receiveBuffer.isEmpty()) {
-        m_receiveBuffer.append(data);
-    } else {
-        qWarning() << " ! Got data but without correct start";
-        qDebug() << data.toHex(':');
-        const int startOfData = data.indexOf(v2::StartOfPacket);
-        if (startOfData < 0) {
-            qWarning() << " ! Contains nothing useful";
-            m_receiveBuffer.clear();
-            return;
-        }
-        m_receiveBuffer = data.mid(startOfData);
+    if (m_recorder) {
+        m_recorder->record(transport::Recorder::Received, QBluetoothUuid(), data, true);
     }
 
-    int end = m_receiveBuffer.indexOf(v2::EndOfPacket);
-    while (end != -1) {
-        const QByteArray packetData = m_receiveBuffer.mid(0, end + 1);
-        m_receiveBuffer = m_receiveBuffer.mid(end + 1);
-        end = m_receiveBuffer.indexOf(v2::EndOfPacket);
+    switch(m_robot.api) {
+    case RobotDefinition::V1:
+        parsePacketV1(data);
+        break;
+    case RobotDefinition::V2:
+        parsePacketV2(data);
+        break;
+    default:
+        qCWarning(lcSphero) << " !!!!! Unhandled API version";
+        break;
+    }
+}
 
-        qDebug() << "Decoding" << packetData.toHex(':');
-        if (size_t(packetData.size()) < sizeof(v2::Packet)) {
-            qWarning() << "not enough data" << packetData.size();
-            qDebug() << packetData.toHex(':');
-            continue;
-        }
+void SpheroHandler::parsePacketV2(const QByteArray &data)
+{
+    m_decoderV2.feed(data.constData(), data.size(), [this](const char *frame, const int size) {
         bool ok;
-        const v2::Packet base = v2::decode<v2::Packet>(packetData, &ok);
+        const v2::Packet base = bytesToPacket<v2::Packet>(frame, size, &ok);
         if (!ok) {
-            qWarning() << "Failed to decode" << packetData.toHex(':');
+            qCWarning(lcSphero) << "not enough data" << size;
+            return;
         }
+        int headerSize = sizeof(v2::Packet);
         if (base.m_flags & v2::Packet::HasErrorCode) {
-            const v2::ResponsePacket response = v2::decode<v2::ResponsePacket>(packetData, &ok);
-            qWarning() << "Got error code" << v2::Packet::Error(response.errorCode);
-            qDebug() << "for" << v2::Packet::CommandTarget(base.m_deviceID) << base.m_commandID;
-            continue;
+            const v2::ResponsePacket response = bytesToPacket<v2::ResponsePacket>(frame, size, &ok);
+            if (!ok) {
+                qCWarning(lcSphero) << "Missing error code";
+                return;
+            }
+            // Normal responses have it too, just without an error
+            if (v2::Packet::Error(response.errorCode) != v2::Packet::Error::Success) {
+                qCWarning(lcSphero) << "Got error code" << v2::Packet::Error(response.errorCode);
+                PROTOCOL_TRACE(lcSpheroProtocol) << "for" << v2::Packet::CommandTarget(base.m_deviceID) << base.m_commandID;
+                return;
+            }
+            headerSize = sizeof(v2::ResponsePacket);
         }
 
-//        qDebug() << "Got data for" << v2::Packet::CommandTarget(base.m_deviceID) << base.;
-    }
+        if (base.m_deviceID == v2::Packet::MainSystem && base.m_commandID == v2::Power::GetBatteryVoltage && size >= headerSize + 2) {
+            qCDebug(lcSphero) << "  + battery voltage" << qFromBigEndian<uint16_t>(frame + headerSize);
+        }
+
+//        qCDebug(lcSphero) << "Got data for" << v2::Packet::CommandTarget(base.m_deviceID) << base.;
+    });
 }
 
 void SpheroHandler::parsePacketV1(const QByteArray &data)
 {
 
-    qDebug() << " ------------ Characteristic changed" << data.toHex(':') << " ----------";
+    PROTOCOL_TRACE(lcSpheroProtocol) << " ------------ Characteristic changed" << data.toHex(':') << " ----------";
 
     if (data.isEmpty()) {
-        qWarning() << " ! No data received";
+        qCWarning(lcSphero) << " ! No data received";
         return;
     }
 
-    // New messages start with 0xFF, so reset buffer in that case
-    if (data.startsWith(0xFF)) {
-        m_receiveBuffer = data;
-    } else if (data.startsWith("u>\xff\xff")) {
-        // We don't always get this
-         // I _think_ the 'u>' is a separate packet, so just strip it
-        qDebug() << " - Got unknown something that looks like a prompt (u>), is an ack of some sorts?";
-        m_receiveBuffer = data.mid(2);
-    } else if (!m_receiveBuffer.isEmpty()) {
-        m_receiveBuffer.append(data);
-    } else {
-        qWarning() << " ! Got data but without correct start";
-        qDebug() << data;
-        const int startOfData = data.indexOf(0xFF);
-        if (startOfData < 0) {
-            qWarning() << " ! Contains nothing useful";
-            m_receiveBuffer.clear();
-            return;
-        }
-        m_receiveBuffer = data.mid(startOfData);
-    }
+    // Packets can be split over several notifications, and we can get several
+    // in one (especially when streaming), so just keep appending and take out
+    // complete packets as we get them.
+    m_receiveBuffer.append(data);
 
     if (m_receiveBuffer.size() > 10000) {
-        qWarning() << " ! Receive buffer too large, nuking" << m_receiveBuffer.size();
+        qCWarning(lcSphero) << " ! Receive buffer too large, nuking" << m_receiveBuffer.size();
         m_receiveBuffer.clear();
         return;
     }
 
-    if (m_receiveBuffer.size() < int(sizeof(v1::CommandPacketHeader))) {
-        qDebug() << " - Not a full header" << m_receiveBuffer.size();
-        return;
-    }
+    while (!m_receiveBuffer.isEmpty()) {
+        // Resync if we're not at the start of a packet, we sometimes get a 'u>'
+        // before packets, I _think_ it is a prompt from the ascii shell.
+        if (uint8_t(m_receiveBuffer[0]) != 0xFF) {
+            const int startOfData = m_receiveBuffer.indexOf(char(0xFF));
+            if (startOfData < 0) {
+                qCWarning(lcSphero) << " ! Contains nothing useful" << m_receiveBuffer;
+                m_receiveBuffer.clear();
+                return;
+            }
+            PROTOCOL_TRACE(lcSpheroProtocol) << " - Skipping" << m_receiveBuffer.left(startOfData) << "before packet";
+            m_receiveBuffer.remove(0, startOfData);
+        }
 
-    ResponsePacketHeader header;
-    qFromBigEndian<uint8_t>(m_receiveBuffer.data(), sizeof(ResponsePacketHeader), &header);
-    qDebug() << " - magic" << header.magic;
-    if (header.magic != 0xFF) {
-        qWarning() << " ! Invalid magic";
-        return;
-    }
-    qDebug() << " - type" << header.type;
+        if (m_receiveBuffer.size() < int(sizeof(ResponsePacketHeader))) {
+            PROTOCOL_TRACE(lcSpheroProtocol) << " - Not a full header" << m_receiveBuffer.size();
+            return;
+        }
 
-    switch(header.type) {
-    case ResponsePacketHeader::Response:
-    case ResponsePacketHeader::Notification:
-        break;
-    default:
-        qWarning() << " !!!!!!!!!!!!!!!!!!!!!  unhandled response type!: " << header.type;
-        m_receiveBuffer.clear();
-    }
+        ResponsePacketHeader header;
+        qFromBigEndian<uint8_t>(m_receiveBuffer.data(), sizeof(ResponsePacketHeader), &header);
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - type" << header.type;
 
-    qDebug() << " - sequence num" << header.sequenceNumber;
-    qDebug() << " - data length" << header.dataLength;
+        int dataLength = 0;
+        switch(header.type) {
+        case ResponsePacketHeader::Response:
+            dataLength = header.dataLength;
+            break;
+        case ResponsePacketHeader::Notification:
+            // Notifications have a 16 bit length where the sequence number would be
+            dataLength = header.sequenceNumber << 8 | header.dataLength;
+            break;
+        default:
+            qCWarning(lcSphero) << " !!!!!!!!!!!!!!!!!!!!!  unhandled response type!: " << header.type;
+            m_receiveBuffer.remove(0, 1);
+            continue;
+        }
 
-    if (m_receiveBuffer.size() != sizeof(v1::CommandPacketHeader) + header.dataLength - 1) {
-        qWarning() << " ! Packet size wrong" << m_receiveBuffer.size();
-        qDebug() << "  > Expected" << sizeof(v1::CommandPacketHeader) << "+" << header.dataLength;
-        return;
-    }
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - data length" << dataLength;
 
-    uint8_t checksum = 0;
-    for (int i=2; i<m_receiveBuffer.size() - 1; i++) {
-        checksum += uint8_t(m_receiveBuffer[i]);
-    }
-    checksum ^= 0xFF;
-    if (!m_receiveBuffer.endsWith(checksum)) {
-        qWarning() << " !!!! Invalid checksum !!!!" << checksum;
-        qDebug() << "  > Expected" << uint8_t(m_receiveBuffer.back());
-        return;
-    }
+        if (dataLength < 1) {
+            qCWarning(lcSphero) << " ! Invalid data length";
+            m_receiveBuffer.remove(0, 1);
+            continue;
+        }
 
-    qDebug() << " - Checksum:" << QByteArray::number(checksum, 16);
+        const int packetSize = int(sizeof(ResponsePacketHeader)) + dataLength;
+        if (m_receiveBuffer.size() < packetSize) {
+            PROTOCOL_TRACE(lcSpheroProtocol) << " - Waiting for the rest of the packet" << m_receiveBuffer.size() << "of" << packetSize;
+            return;
+        }
 
-    QByteArray contents = data.mid(sizeof(ResponsePacketHeader), header.dataLength - 1); // checksum is last byte
-    if (contents.isEmpty()) {
-        qWarning() << " ! No contents";
+        uint8_t checksum = 0;
+        for (int i=2; i<packetSize - 1; i++) {
+            checksum += uint8_t(m_receiveBuffer[i]);
+        }
+        checksum ^= 0xFF;
+        if (uint8_t(m_receiveBuffer[packetSize - 1]) != checksum) {
+            qCWarning(lcSphero) << " !!!! Invalid checksum !!!!" << checksum;
+            qCDebug(lcSphero) << "  > Expected" << uint8_t(m_receiveBuffer[packetSize - 1]);
+            m_receiveBuffer.remove(0, 1);
+            continue;
+        }
+
+        // Hot path when streaming, so avoid copying it around
+        if (header.type == ResponsePacketHeader::Notification && header.packetType == ResponsePacketHeader::SensorStream) {
+            m_sensors->handleSensorData(m_receiveBuffer.constData() + sizeof(ResponsePacketHeader), dataLength - 1);
+            m_receiveBuffer.remove(0, packetSize);
+            continue;
+        }
+
+        const QByteArray contents = m_receiveBuffer.mid(sizeof(ResponsePacketHeader), dataLength - 1); // checksum is last byte
+        m_receiveBuffer.remove(0, packetSize);
+
+        handlePacketV1(header, contents);
     }
-    qDebug() << " - received contents" << contents.size() << contents.toHex(':');
-    qDebug() << " - response type:" << header.type;
+}
 
-    m_receiveBuffer.clear(); // TODO leave some
+void SpheroHandler::handlePacketV1(const ResponsePacketHeader &header, const QByteArray &contents)
+{
+    if (contents.isEmpty()) {
+        qCWarning(lcSphero) << " ! No contents";
+    }
+    PROTOCOL_TRACE(lcSpheroProtocol) << " - received contents" << contents.size() << contents.toHex(':');
+    PROTOCOL_TRACE(lcSpheroProtocol) << " - response type:" << header.type;
 
     switch(header.type) {
     case ResponsePacketHeader::Response: {
-        if (!m_pendingSyncRequests.contains(header.sequenceNumber)) {
-            qWarning() << " ! this was not an expected response";
+        const v1::PendingRequests::Request responseToCommand = m_pendingSyncRequests.take(header.sequenceNumber);
+        if (!responseToCommand.active) {
+            qCWarning(lcSphero) << " ! this was not an expected response";
             break;
         }
+        if (!m_pendingSyncRequests.count()) {
+            m_requestTimeoutTimer.stop();
+        }
+
+        // Can't know which attempt this is a response to if we resent it
+        if (responseToCommand.attempts == 1) {
+            m_commandStatistics->addSample(responseToCommand.deviceId, responseToCommand.commandId, (m_requestTimer.nsecsElapsed() - responseToCommand.sentAt) / 1000);
+        }
 
-        const QPair<uint8_t, uint8_t> responseToCommand = m_pendingSyncRequests.take(header.sequenceNumber);
+        // Something newer was sent since, that's the one we care about
+        if (responseToCommand.cancelled) {
+            PROTOCOL_TRACE(lcSpheroProtocol) << " - response to cancelled request" << header.sequenceNumber;
+            break;
+        }
 
-        qDebug() << " - ack response" << ResponsePacketHeader::PacketType(header.packetType);
-//        qDebug() << "Content length" << contents.length() << "data length" << header.dataLength << "buffer length" << m_receiveBuffer.length() << "locator packet size" << sizeof(LocatorPacket) << "response packet size" << sizeof(ResponsePacketHeader);
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - ack response" << ResponsePacketHeader::PacketType(header.packetType);
+//        qCDebug(lcSphero) << "Content length" << contents.length() << "data length" << header.dataLength << "buffer length" << m_receiveBuffer.length() << "locator packet size" << sizeof(LocatorPacket) << "response packet size" << sizeof(ResponsePacketHeader);
 
         if (header.packetType == ResponsePacketHeader::InvalidParameter) {
-            qWarning() << " !!!!! We sent an invalid parameter!";
-            if (responseToCommand.first == v1::CommandPacketHeader::HardwareControl) {
-                qDebug() << " ! hardware command" << v1::CommandPacketHeader::HardwareCommand(responseToCommand.second);
+            qCWarning(lcSphero) << " !!!!! We sent an invalid parameter!";
+            if (responseToCommand.deviceId == v1::CommandPacketHeader::HardwareControl) {
+                qCDebug(lcSphero) << " ! hardware command" << v1::CommandPacketHeader::HardwareCommand(responseToCommand.commandId);
 
-                if (responseToCommand.second != v1::CommandPacketHeader::GetLocatorData) {
+                if (responseToCommand.commandId != v1::CommandPacketHeader::GetLocatorData) {
                     sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::GetLocatorData, {});
                 }
-            } else if (responseToCommand.first == v1::CommandPacketHeader::Internal) {
-                qDebug() << " ! internal command" << v1::CommandPacketHeader::InternalCommand(responseToCommand.second);
+            } else if (responseToCommand.deviceId == v1::CommandPacketHeader::Internal) {
+                qCDebug(lcSphero) << " ! internal command" << v1::CommandPacketHeader::InternalCommand(responseToCommand.commandId);
                 sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::GetLocatorData, {});
             } else {
-                qDebug() << " ! invalid command target" << responseToCommand;
+                qCDebug(lcSphero) << " ! invalid command target" << responseToCommand.deviceId;
             }
             break;
         }
 
         // TODO separate function
-        switch(responseToCommand.first) {
+        switch(responseToCommand.deviceId) {
         case v1::CommandPacketHeader::Internal:
-            switch(responseToCommand.second) {
+            switch(responseToCommand.commandId) {
             case v1::CommandPacketHeader::Ping: {
-                qDebug() << "Got pong";
+                PROTOCOL_TRACE(lcSpheroProtocol) << "Got pong";
                 break;
             }
             case v1::CommandPacketHeader::GetPwrState: {
@@ -900,40 +1090,40 @@ void SpheroHandler::parsePacketV1(const QByteArray &data)
                 if (!ok) {
                     return;
                 }
-                qDebug() << "  ========== power response ====== ";
-                qDebug() << "  + version" << response.recordVersion;
-                qDebug() << "  + state" << response.powerState;
-                qDebug() << "  + battery voltage" << response.batteryVoltage;
-                qDebug() << "  + number of charges" << response.numberOfCharges;
-                qDebug() << "  + seconds since charge" << response.secondsSinceCharge;
+                qCDebug(lcSphero) << "  ========== power response ====== ";
+                qCDebug(lcSphero) << "  + version" << response.recordVersion;
+                qCDebug(lcSphero) << "  + state" << response.powerState;
+                qCDebug(lcSphero) << "  + battery voltage" << response.batteryVoltage;
+                qCDebug(lcSphero) << "  + number of charges" << response.numberOfCharges;
+                qCDebug(lcSphero) << "  + seconds since charge" << response.secondsSinceCharge;
                 break;
             }
             default:
-                qWarning() << " !!!!! unhandled internal response" << v1::CommandPacketHeader::InternalCommand(responseToCommand.second) << "!!!!!!!!!!!";
+                qCWarning(lcSphero) << " !!!!! unhandled internal response" << v1::CommandPacketHeader::InternalCommand(responseToCommand.commandId) << "!!!!!!!!!!!";
                 break;
             }
             break;
         case v1::CommandPacketHeader::HardwareControl: {
-            switch(responseToCommand.second) {
+            switch(responseToCommand.commandId) {
             case v1::CommandPacketHeader::GetLocatorData: {
                 bool ok;
                 LocatorPacket resp = byteArrayToPacket<LocatorPacket>(contents, &ok);
                 if (!ok) {
-                    qDebug() << " ! Locator state packet invalid";
+                    qCDebug(lcSphero) << " ! Locator state packet invalid";
                     break;
                 }
-                qDebug() << "  ========== locator response ====== ";
-                qDebug() << "  + calibrated?" << bool(resp.flags & LocatorPacket::Calibrated);
-                qDebug() << "  + position x:" << resp.position.x;
-                qDebug() << "  + position y:" << resp.position.y;
-                qDebug() << "  + tilt:" << resp.tilt;
+                qCDebug(lcSphero) << "  ========== locator response ====== ";
+                qCDebug(lcSphero) << "  + calibrated?" << bool(resp.flags & LocatorPacket::Calibrated);
+                qCDebug(lcSphero) << "  + position x:" << resp.position.x;
+                qCDebug(lcSphero) << "  + position y:" << resp.position.y;
+                qCDebug(lcSphero) << "  + tilt:" << resp.tilt;
                 break;
             }
             case v1::CommandPacketHeader::GetRGBLed: {
                 bool ok;
                 RgbPacket resp = byteArrayToPacket<RgbPacket>(contents, &ok);
                 if (!ok) {
-                    qDebug() << " ! RGB packet invalid";
+                    qCDebug(lcSphero) << " ! RGB packet invalid";
                     break;
                 }
 
@@ -942,128 +1132,120 @@ void SpheroHandler::parsePacketV1(const QByteArray &data)
                 break;
             }
             case v1::CommandPacketHeader::SetNonPersistentOptionFlags: {
-                qDebug() << " + temporary options set";
+                PROTOCOL_TRACE(lcSpheroProtocol) << " + temporary options set";
                 break;
             }
             case v1::CommandPacketHeader::SetStabilization: {
-                qDebug() << " + Stabilization set";
+                PROTOCOL_TRACE(lcSpheroProtocol) << " + Stabilization set";
                 break;
             }
             case v1::CommandPacketHeader::SetHeading: {
-                qDebug() << " + Heading set";
+                PROTOCOL_TRACE(lcSpheroProtocol) << " + Heading set";
                 break;
             }
             case v1::CommandPacketHeader::Roll: {
-                qDebug() << " + Roll set";
+                PROTOCOL_TRACE(lcSpheroProtocol) << " + Roll set";
                 break;
             }
             case v1::CommandPacketHeader::SetDataStreaming: {
-                qDebug() << " + Data streaming enabled";
-//                sendCommand();
-//                faceLeft();
-//                setAngle(180);
-//                setSpeedAndAngle(0, 180);
-                sendCommandV1(v1::RollCommandPacket({uint8_t(0), uint16_t(0), v1::RollCommandPacket::Calibrate}));
-                sendCommandV1(v1::CommandPacketHeader::HardwareControl, v1::CommandPacketHeader::GetLocatorData, {});
-//                faceRight();
+                PROTOCOL_TRACE(lcSpheroProtocol) << " + Data streaming configured";
                 break;
             }
             default:
-                qWarning() << " !!!! unhandled hardware response" << v1::CommandPacketHeader::HardwareCommand(responseToCommand.second) << "!!!!!!!!";
+                qCWarning(lcSphero) << " !!!! unhandled hardware response" << v1::CommandPacketHeader::HardwareCommand(responseToCommand.commandId) << "!!!!!!!!";
                 break;
             }
             break;
         }
         default:
-            qWarning() << " ! unhandled command target" << responseToCommand.first;
+            qCWarning(lcSphero) << " ! unhandled command target" << responseToCommand.deviceId;
         }
         break;
     }
     case ResponsePacketHeader::Notification:
-        qDebug() << " - data notification" << header.packetType;
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - data notification" << header.packetType;
         switch(header.packetType) {
         case ResponsePacketHeader::PowerNotification: {
             if (contents.size() != 1) {
-                qWarning() << " ! Invalid size of power notification";
+                qCWarning(lcSphero) << " ! Invalid size of power notification";
                 break;
             }
             const uint8_t state = contents[0];
             if (state > 4) {
-                qWarning() << " ! Invalid reported state";
+                qCWarning(lcSphero) << " ! Invalid reported state";
                 break;
             }
             if (state != m_powerState) {
                 m_powerState = PowerState(state);
-                qDebug() << "new power state" << m_powerState;
+                qCDebug(lcSphero) << "new power state" << m_powerState;
                 emit powerChanged();
             }
 
             break;
         }
         case ResponsePacketHeader::SleepingIn10Sec : {
-            qWarning() << "Going to sleep soon";
+            qCWarning(lcSphero) << "Going to sleep soon";
             break;
         }
         case ResponsePacketHeader::Sleep : {
-            qWarning() << "Gone to sleep";
+            qCWarning(lcSphero) << "Gone to sleep";
             break;
         }
         default:
-            qWarning() << " ! unhandled notification type" << header.packetType;
+            qCWarning(lcSphero) << " ! unhandled notification type" << header.packetType;
 
         }
 
         break;
     default:
-        qWarning() << " ! unhandled type" << header.type;
-        m_receiveBuffer.clear();
+        qCWarning(lcSphero) << " ! unhandled type" << header.type;
     }
-    qDebug() << " ************************* ";
+    PROTOCOL_TRACE(lcSpheroProtocol) << " ************************* ";
 
 //    // async
 //    switch(header.response) {
 //    case StreamingResponse:
 //        if (m_receiveBuffer.size() != 88) {
-//            qWarning() << "Invalid streaming data size" << m_receiveBuffer.size();
+//            qCWarning(lcSphero) << "Invalid streaming data size" << m_receiveBuffer.size();
 //            break;
 //        }
-//        qDebug() << "Got streaming command";
+//        qCDebug(lcSphero) << "Got streaming command";
 //        break;
 //    case PowerStateResponse: {
 //        if (m_receiveBuffer.size() != sizeof(PowerStatePacket)) {
-//            qWarning() << "Invalid size of powerstate packet" << m_receiveBuffer.size();
-//            qDebug() << "Expected" << sizeof(PowerStatePacket);
+//            qCWarning(lcSphero) << "Invalid size of powerstate packet" << m_receiveBuffer.size();
+//            qCDebug(lcSphero) << "Expected" << sizeof(PowerStatePacket);
 //            break;
 //        }
 
-//        qDebug() << "Got powerstate response";
+//        qCDebug(lcSphero) << "Got powerstate response";
 //        PowerStatePacket powerState;
 //        qFromBigEndian<uint8_t>(m_receiveBuffer.data(), sizeof(PowerStatePacket), &powerState);
-//        qDebug() << "record version" << powerState.recordVersion;
-//        qDebug() << "power state" << powerState.powerState;
-//        qDebug() << "battery voltage" << powerState.batteryVoltage;
-//        qDebug() << "number of charges" << powerState.numberOfCharges;
-//        qDebug() << "seconds since last charge" << powerState.secondsSinceCharge;
+//        qCDebug(lcSphero) << "record version" << powerState.recordVersion;
+//        qCDebug(lcSphero) << "power state" << powerState.powerState;
+//        qCDebug(lcSphero) << "battery voltage" << powerState.batteryVoltage;
+//        qCDebug(lcSphero) << "number of charges" << powerState.numberOfCharges;
+//        qCDebug(lcSphero) << "seconds since last charge" << powerState.secondsSinceCharge;
 
 //        break;
 //    }
 //    case LocatorResponse: {
 //        if (m_receiveBuffer.size() != 16) {
-//            qWarning() << "Invalid size of locator response" << m_receiveBuffer.size();
+//            qCWarning(lcSphero) << "Invalid size of locator response" << m_receiveBuffer.size();
 //            break;
 //        }
-//        qDebug() << "Got locator response";
+//        qCDebug(lcSphero) << "Got locator response";
 //        LocatorPacket locator;
 //        qFromBigEndian<uint8_t>(m_receiveBuffer.data(), sizeof(PowerStatePacket), &locator);
-//        qDebug() << "flags" << locator.flags;
-//        qDebug() << "X:" << locator.position.x;
-//        qDebug() << "Y:" << locator.position.y;
-//        qDebug() << "tilt:" << locator.tilt;
+//        qCDebug(lcSphero) << "flags" << locator.flags;
+//        qCDebug(lcSphero) << "X:" << locator.position.x;
+//        qCDebug(lcSphero) << "Y:" << locator.position.y;
+//        qCDebug(lcSphero) << "tilt:" << locator.tilt;
 
 //        break;
 //    }
 //    default:
-//        qDebug() << "Unknown command" << header.commandID;
+//        qCDebug(lcSphero) << "Unknown command" << header.commandID;
 //        break;
 //    }
 
@@ -1078,12 +1260,12 @@ void SpheroHandler::onRadioServiceChanged(QLowEnergyService::ServiceState newSta
         return;
     }
     if (newState != QLowEnergyService::ServiceDiscovered) {
-        qDebug() << " ! unhandled radio service state changed:" << newState;
+        qCDebug(lcSphero) << " ! unhandled radio service state changed:" << newState;
         return;
     }
 
     if (!sendRadioControlCommand(m_robot.passwordCharacteristic, m_robot.radioPassword)) {
-        qWarning() << "Failed to send unlock password";
+        qCWarning(lcSphero) << "Failed to send unlock password";
         return;
     }
 
@@ -1091,7 +1273,7 @@ void SpheroHandler::onRadioServiceChanged(QLowEnergyService::ServiceState newSta
     case RobotDefinition::V1: {
         if (!sendRadioControlCommand(Characteristics::Radio::V1::transmitPower, "\x7") ||
             !sendRadioControlCommand(Characteristics::Radio::V1::wake, "\x1")) {
-            qWarning() << " ! Init sequence failed";
+            qCWarning(lcSphero) << " ! Init sequence failed";
             emit disconnected();
             emit statusMessageChanged(tr("Sphero Init sequence failed"));
             return;
@@ -1114,63 +1296,149 @@ void SpheroHandler::onRadioServiceChanged(QLowEnergyService::ServiceState newSta
         break;
     }
     default:
-        qWarning() << "unhandled robot api";
+        qCWarning(lcSphero) << "unhandled robot api";
         return;
     }
 
-    qDebug() << " - Init sequence done";
+    qCDebug(lcSphero) << " - Init sequence done";
     m_mainService->discoverDetails();
 }
 
 bool SpheroHandler::sendRadioControlCommand(const QBluetoothUuid &characteristicUuid, const QByteArray &data)
 {
     if (!m_radioService || m_radioService->state() != QLowEnergyService::ServiceDiscovered) {
-        qWarning() << "Radio service not connected";
+        qCWarning(lcSphero) << "Radio service not connected";
         return false;
     }
     QLowEnergyCharacteristic characteristic = m_radioService->characteristic(characteristicUuid);
     if (!characteristic.isValid()) {
-        qWarning() << "Radio characteristic" << characteristicUuid << "not available";
+        qCWarning(lcSphero) << "Radio characteristic" << characteristicUuid << "not available";
         return false;
     }
+    if (m_recorder) {
+        m_recorder->record(transport::Recorder::Sent, characteristicUuid, data, false);
+    }
     m_radioService->writeCharacteristic(characteristic, data);
     return true;
 }
 
-void SpheroHandler::sendCommandV1(const uint8_t deviceId, const uint8_t commandID, const QByteArray &data)
+void SpheroHandler::writeCommand(const QByteArray &data)
+{
+    if (m_recorder) {
+        m_recorder->record(transport::Recorder::Sent, m_commandsCharacteristic.uuid(), data, true);
+    }
+    if (m_transport) {
+        m_transport->write(data);
+        return;
+    }
+    m_mainService->writeCharacteristic(m_commandsCharacteristic, data);
+}
+
+bool SpheroHandler::canWrite() const
+{
+    if (m_transport) {
+        return m_transport->isConnected();
+    }
+    return m_mainService && m_commandsCharacteristic.isValid();
+}
+
+bool SpheroHandler::reserveSequenceNumber(const uint8_t deviceId, const uint8_t commandID, uint8_t *sequenceNumber, const bool supersede)
+{
+    // For settings where only the newest one matters, so retrying the old ones is pointless
+    if (supersede) {
+        const int superseded = m_pendingSyncRequests.cancel(deviceId, commandID);
+        if (superseded) {
+            qCDebug(lcSphero) << " - cancelled" << superseded << "pending requests for the same command";
+        }
+    }
+
+    // Skips 0, that's special
+    if (!m_pendingSyncRequests.findFree(m_nextSequenceNumber, sequenceNumber)) {
+        qCWarning(lcSphero) << " !!!!!! All sequence numbers are in use, overflow?";
+        qCWarning(lcSphero) << " !!!!!! Outstanding requests:" << m_pendingSyncRequests.sequenceNumbers();
+        return false;
+    }
+
+    m_nextSequenceNumber = *sequenceNumber + 1;
+    return true;
+}
+
+void SpheroHandler::trackRequest(const uint8_t sequenceNumber, const uint8_t deviceId, const uint8_t commandID, const QByteArray &frame)
+{
+    m_pendingSyncRequests.add(sequenceNumber, deviceId, commandID, frame, m_requestTimer.nsecsElapsed());
+    if (!m_requestTimeoutTimer.isActive()) {
+        m_requestTimeoutTimer.start();
+    }
+}
+
+void SpheroHandler::checkRequestTimeouts()
+{
+    if (!canWrite()) {
+        m_pendingSyncRequests.clear();
+    }
+
+    m_pendingSyncRequests.checkDeadlines(m_requestTimer.nsecsElapsed(),
+        [this](const uint8_t sequenceNumber, const v1::PendingRequests::Request &request) {
+            qCDebug(lcSphero) << " - No response to" << sequenceNumber << "in time, attempt" << request.attempts;
+            writeCommand(request.frame);
+        },
+        [](const uint8_t sequenceNumber, const v1::PendingRequests::Request &request) {
+            qCWarning(lcSphero) << " ! Giving up on request" << sequenceNumber << "to" << request.deviceId << "command" << request.commandId << "after" << request.attempts << "attempts";
+        }
+    );
+
+    if (!m_pendingSyncRequests.count()) {
+        m_requestTimeoutTimer.stop();
+    }
+}
+
+void SpheroHandler::sendCommandV1(const uint8_t deviceId, const uint8_t commandID, const QByteArray &data, const bool supersede)
 {
     v1::CommandPacketHeader packet(deviceId, commandID);
     if (!packet.isValid()) {
         return;
     }
-    qDebug() << " >>>>>>>>>>> sending command <<<<<<<<<<";
-    qDebug() << " - data" << data;
+    PROTOCOL_TRACE(lcSpheroProtocol) << " >>>>>>>>>>> sending command <<<<<<<<<<";
+    PROTOCOL_TRACE(lcSpheroProtocol) << " - data" << data;
 
+    uint8_t sequenceNumber = 0;
     if (packet.isSynchronous()) {
-        if (!m_nextSequenceNumber) {
-            m_nextSequenceNumber++; // skip 0, that's special
-        }
-        if (m_pendingSyncRequests.contains(m_nextSequenceNumber)) {
-            qWarning() << " !!!!!! We have outstanding requests, overflow?";
-            qWarning() << " !!!!!! Next request:" << m_nextSequenceNumber;
-            qWarning() << " !!!!!! Outstanding requests:" << m_pendingSyncRequests;
+        if (!reserveSequenceNumber(deviceId, commandID, &sequenceNumber, supersede)) {
             return;
         }
-
-        packet.setSequenceNumber(m_nextSequenceNumber);
-        m_pendingSyncRequests.insert(m_nextSequenceNumber, {deviceId, commandID});
-
-        m_nextSequenceNumber++;
+        packet.setSequenceNumber(sequenceNumber);
     }
 
     const QByteArray toSend = packet.encode(data);
     if (toSend.isEmpty()) {
-        qDebug() << " ! Encoding packet failed!";
+        qCDebug(lcSphero) << " ! Encoding packet failed!";
+        return;
+    }
+    PROTOCOL_TRACE(lcSpheroProtocol) << " ++++++++++++++++++++++++++++++++++++++";
+
+    if (packet.isSynchronous()) {
+        trackRequest(sequenceNumber, deviceId, commandID, toSend);
+    }
+
+    writeCommand(toSend);
+}
+
+template<size_t SIZE>
+void SpheroHandler::sendCommandV1(const v1::ConstantCommand<SIZE> &command)
+{
+    if (!command.isSynchronous()) {
+        writeCommand(command.encode(0));
+        return;
+    }
+
+    uint8_t sequenceNumber = 0;
+    if (!reserveSequenceNumber(command.deviceId, command.commandId, &sequenceNumber)) {
         return;
     }
-    qDebug() << " ++++++++++++++++++++++++++++++++++++++";
 
-    m_mainService->writeCharacteristic(m_commandsCharacteristic, toSend);
+    const QByteArray toSend = command.encode(sequenceNumber);
+    trackRequest(sequenceNumber, command.deviceId, command.commandId, toSend);
+    writeCommand(toSend);
 }
 
 SpheroHandler::RobotDefinition::RobotDefinition(const RobotType type)
@@ -1215,7 +1483,7 @@ SpheroHandler::RobotDefinition::RobotDefinition(const RobotType type)
         break;
 
     default:
-        qWarning() << "unhandled type" << int(type);
+        qCWarning(lcSphero) << "unhandled type" << int(type);
         return;
     }
 }
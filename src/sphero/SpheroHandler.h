@@ -3,20 +3,38 @@
 #include "BasicTypes.h"
 
 #include "utils.h"
+#include "v1/PendingRequests.h"
+#include "v2/Framing.h"
 
 #include <QObject>
 #include <QPointer>
+#include <QBluetoothAddress>
 #include <QBluetoothUuid>
 #include <QLowEnergyService>
 #include <QLowEnergyCharacteristic>
 #include <QLowEnergyController>
 #include <QColor>
+#include <QElapsedTimer>
+#include <QTimer>
 
 class QLowEnergyController;
 class QBluetoothDeviceInfo;
 
+namespace transport {
+class Recorder;
+class Transport;
+}
+
 namespace sphero {
 
+class CommandStatistics;
+class SensorStream;
+struct ResponsePacketHeader;
+
+namespace v1 {
+template<size_t DATASIZE> struct ConstantCommand;
+} // namespace v1
+
 // BB-8 at least
 static constexpr int manufacturerID = 12339;
 bool isValidRobot(const QString &name, const QString &address);
@@ -46,6 +64,9 @@ class SpheroHandler : public QObject
 
     Q_PROPERTY(PowerState powerState READ powerState NOTIFY powerChanged)
 
+    Q_PROPERTY(QObject* commandStatistics READ commandStatistics CONSTANT)
+    Q_PROPERTY(QObject* sensors READ sensors CONSTANT)
+
 public:
     enum class RobotType {
         Unknown,
@@ -74,8 +95,14 @@ public:
 public:
 
     explicit SpheroHandler(const QBluetoothDeviceInfo &deviceInfo, QObject *parent);
+
+    // Talks through the transport instead of BLE, takes ownership of it
+    explicit SpheroHandler(transport::Transport *transport, QObject *parent);
     ~SpheroHandler();
 
+    // Writes everything sent and received to a file, takes ownership of it
+    void setRecorder(transport::Recorder *recorder);
+
     bool isConnected();
 
     QString statusString();
@@ -117,10 +144,15 @@ public:
 
     PowerState powerState() const { return m_powerState; }
 
+    QObject *commandStatistics() const;
+    QObject *sensors() const;
+
 signals:
     void connectedChanged();
     void rssiChanged();
     void disconnected(); // TODO
+    void connectionEstablished(); // all the way through the handshake
+    void disconnectRequested(); // by the user, so we shouldn't reconnect
     void statusMessageChanged(const QString &message);
 
     void colorChanged();
@@ -139,6 +171,7 @@ private slots:
     void onControllerStateChanged(QLowEnergyController::ControllerState state);
     void onControllerError(QLowEnergyController::Error newError);
 
+    void onServiceDiscovered(const QBluetoothUuid &newService);
     void onServiceDiscoveryFinished();
     void onMainServiceChanged(QLowEnergyService::ServiceState newState);
     void onServiceError(QLowEnergyService::ServiceError error);
@@ -146,10 +179,26 @@ private slots:
     void onCharacteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &newValue);
     void onRadioServiceChanged(QLowEnergyService::ServiceState newState);
 
+    void checkRequestTimeouts();
+    void sendStreamingConfiguration();
+
+    void startSession();
+    void handleData(const QByteArray &data);
+    void onDisconnected();
+
 private:
+    void initialize();
+    bool canWrite() const;
+
     bool sendRadioControlCommand(const QBluetoothUuid &characteristicUuid, const QByteArray &data);
-    void sendCommandV1(const uint8_t deviceId, const uint8_t commandID, const QByteArray &data = QByteArray());
+    void writeCommand(const QByteArray &data);
+    // If supersede is set any pending requests for the same command are cancelled
+    bool reserveSequenceNumber(const uint8_t deviceId, const uint8_t commandID, uint8_t *sequenceNumber, const bool supersede = false);
+    void trackRequest(const uint8_t sequenceNumber, const uint8_t deviceId, const uint8_t commandID, const QByteArray &frame);
+    void sendCommandV1(const uint8_t deviceId, const uint8_t commandID, const QByteArray &data = QByteArray(), const bool supersede = false);
+    template<size_t SIZE> void sendCommandV1(const v1::ConstantCommand<SIZE> &command);
     void parsePacketV1(const QByteArray &data);
+    void handlePacketV1(const ResponsePacketHeader &header, const QByteArray &contents);
     void parsePacketV2(const QByteArray &data);
 
     template<typename PACKET> void sendCommandV1(const PACKET &packet) {
@@ -166,7 +215,14 @@ private:
     QPointer<QLowEnergyService> m_mainService;
     QPointer<QLowEnergyService> m_radioService;
 
+    QBluetoothAddress m_address;
+    bool m_knownServices = false; // from the GattCache, so we don't wait for the discovery to finish
+
+    QPointer<transport::Transport> m_transport;
+    transport::Recorder *m_recorder = nullptr;
+
     QByteArray m_receiveBuffer;
+    v2::StreamDecoder m_decoderV2;
 
     QString m_name;
     int8_t m_rssi = 0;
@@ -200,7 +256,11 @@ private:
 
     RobotType m_robotType = RobotType::Unknown;
 
-    QMap<uint8_t, QPair<uint8_t, uint8_t>> m_pendingSyncRequests;
+    v1::PendingRequests m_pendingSyncRequests; // times are from m_requestTimer
+    QElapsedTimer m_requestTimer;
+    QTimer m_requestTimeoutTimer;
+    CommandStatistics *m_commandStatistics = nullptr;
+    SensorStream *m_sensors = nullptr;
     uint8_t m_nextSequenceNumber = 0;
 
     PowerState m_powerState = UnknownPowerState;
@@ -3,9 +3,12 @@
 #include "BasicTypes.h"
 #include "utils.h"
 
+#include "logging.h"
+
 #include <QDebug>
 #include <QObject>
 #include <QtEndian>
+#include <array>
 #include <cstdint>
 
 namespace sphero {
@@ -16,15 +19,17 @@ namespace v1 {
 struct CommandPacketHeader {
     Q_GADGET
 public:
+    // The second byte (SOP2), bit 0 asks for an answer and bit 1 resets the
+    // inactivity timeout. So 0xFF gets answered and 0xFE doesn't.
     enum TimeoutHandling : uint8_t {
         KeepTimeout = 0,
-        ResetTimeout = 1 << 0
+        ResetTimeout = 1 << 1
     };
     Q_ENUM(TimeoutHandling)
 
     enum SynchronousType : uint8_t {
         Asynchronous = 0,
-        Synchronous = 1 << 1
+        Synchronous = 1 << 0
     };
     Q_ENUM(SynchronousType)
 
@@ -139,108 +144,81 @@ public:
         m_deviceID(deviceID),
         m_commandID(commandID)
     {
-        uint8_t flags = 0xFC;
         switch(deviceID) {
         case CommandPacketHeader::Internal:
-            qDebug() << " > Sending internal command" << CommandPacketHeader::InternalCommand(m_commandID);
-            switch(m_commandID) {
+            PROTOCOL_TRACE(lcSpheroProtocol) << " > Sending internal command" << CommandPacketHeader::InternalCommand(m_commandID);
+            break;
+        case CommandPacketHeader::HardwareControl:
+            PROTOCOL_TRACE(lcSpheroProtocol) << " > Sending hardware command" << CommandPacketHeader::HardwareCommand(m_commandID);
+            break;
+        default:
+            break;
+        }
+
+        bool known = false;
+        m_flags = commandFlags(deviceID, commandID, &known);
+        if (!known) {
+            qCWarning(lcSpheroProtocol) << " !!!!!!!!!!!!!!! Unhandled command" << deviceID << commandID;
+        }
+    }
+
+    // Returns 0 for unknown internal commands, which we refuse to send. Other
+    // unknown commands are sent as asynchronous, check known to find those.
+    static constexpr uint8_t commandFlags(const uint8_t deviceID, const uint8_t commandID, bool *known = nullptr)
+    {
+        bool synchronous = false;
+        bool isKnown = true;
+
+        switch(deviceID) {
+        case CommandPacketHeader::Internal:
+            switch(commandID) {
             case CommandPacketHeader::GetPwrState:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
-            case CommandPacketHeader::SetPwrNotify:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::Sleep:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::GetAutoReconnect:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::Ping:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
+                synchronous = true;
+                break;
+            case CommandPacketHeader::SetPwrNotify:
                 break;
             default:
-                qWarning() << "Unhandled packet internal command" << m_commandID;
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                return;
+                if (known) {
+                    *known = false;
+                }
+                return 0;
             }
-
             break;
         case CommandPacketHeader::HardwareControl:
-            qDebug() << " > Sending hardware command" << CommandPacketHeader::HardwareCommand(m_commandID);
-            switch(m_commandID) {
+            switch(commandID) {
             case CommandPacketHeader::GetRGBLed:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::GetLocatorData:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::SetDataStreaming:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
+            case CommandPacketHeader::SetStabilization:
+            case CommandPacketHeader::SetNonPersistentOptionFlags:
+                synchronous = true;
                 break;
             case CommandPacketHeader::ConfigureCollisionDetection:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::SetRGBLed:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::SetBackLED:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::Roll:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
-            case CommandPacketHeader::SetStabilization:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::SetHeading:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
             case CommandPacketHeader::SetRotationRate:
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
-                break;
-            case CommandPacketHeader::SetNonPersistentOptionFlags:
-                flags |= CommandPacketHeader::Synchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
                 break;
             default:
-                qWarning() << " !!!!!!!!!!!!!!! Unhandled packet hardware command" << m_commandID;
-                flags |= CommandPacketHeader::Asynchronous;
-                flags |= CommandPacketHeader::ResetTimeout;
+                isKnown = false;
                 break;
             }
-
             break;
         default:
-            qWarning() << "Unhandled device id" << deviceID;
-            m_flags |= CommandPacketHeader::Asynchronous;
-            m_flags |= CommandPacketHeader::ResetTimeout;
+            isKnown = false;
             break;
         }
 
-//        m_flags = flags;
-        if (flags & Synchronous) {
-            m_flags = 0xff;
-        } else {
-            m_flags = 0xfe;
+        if (known) {
+            *known = isKnown;
         }
 
+        // The SDK also sets the reset timeout bit etc., but the robots only seem to care about this
+        return synchronous ? 0xff : 0xfe;
     }
 
     bool isValid() const {
@@ -257,7 +235,7 @@ public:
 
     QByteArray encode(const QByteArray &data) {
         if (m_flags == 0) {
-            qWarning() << "Can't encode invalid packet";
+            qCWarning(lcSpheroProtocol) << "Can't encode invalid packet";
             return {};
         }
 
@@ -276,12 +254,12 @@ public:
 
         toSend.append(checksum xor 0xFF);
 
-        qDebug() << " - Writing command" << toSend.toHex(':');
+        PROTOCOL_TRACE(lcSpheroProtocol) << " - Writing command" << toSend.toHex(':');
 
-        qDebug() << " + Packet:";
-        qDebug() << "  ] Device id:" << m_deviceID;
-        qDebug() << "  ] command id:" << m_commandID;
-        qDebug() << "  ] seq number:" << m_sequenceNumber;
+        PROTOCOL_TRACE(lcSpheroProtocol) << " + Packet:";
+        PROTOCOL_TRACE(lcSpheroProtocol) << "  ] Device id:" << m_deviceID;
+        PROTOCOL_TRACE(lcSpheroProtocol) << "  ] command id:" << m_commandID;
+        PROTOCOL_TRACE(lcSpheroProtocol) << "  ] seq number:" << m_sequenceNumber;
 
         return toSend;
     }
@@ -298,6 +276,71 @@ private:
 
 static_assert(sizeof(CommandPacketHeader) == 6);
 
+// For commands without any runtime fields, everything except the sequence
+// number is done at compile time.
+template<size_t DATASIZE>
+struct ConstantCommand
+{
+    static constexpr int size = sizeof(CommandPacketHeader) + DATASIZE + 1;
+
+    constexpr ConstantCommand(const uint8_t deviceID, const uint8_t commandID, const std::array<char, DATASIZE> &data) :
+        deviceId(deviceID),
+        commandId(commandID)
+    {
+        bytes[0] = char(0xFF);
+        bytes[1] = char(CommandPacketHeader::commandFlags(deviceID, commandID));
+        bytes[2] = char(deviceID);
+        bytes[3] = char(commandID);
+        bytes[4] = 0; // sequence number
+        bytes[5] = char(DATASIZE + 1); // + 1 for checksum
+
+        for (size_t i=0; i<DATASIZE; i++) {
+            bytes[6 + i] = data[i];
+        }
+
+        // Checksum doesn't include the magic and the flags
+        for (int i=2; i<size - 1; i++) {
+            checksum += uint8_t(bytes[i]);
+        }
+        bytes[size - 1] = char(checksum xor 0xFF);
+    }
+
+    bool isSynchronous() const {
+        return uint8_t(bytes[1]) & CommandPacketHeader::Synchronous;
+    }
+
+    QByteArray encode(const uint8_t sequenceNumber) const {
+        if (!sequenceNumber) {
+            return QByteArray::fromRawData(bytes.data(), size);
+        }
+        QByteArray ret(bytes.data(), size);
+        ret[4] = char(sequenceNumber);
+        ret[size - 1] = char(uint8_t(checksum + sequenceNumber) xor 0xFF);
+        return ret;
+    }
+
+    const uint8_t deviceId;
+    const uint8_t commandId;
+
+    std::array<char, size> bytes{};
+    uint8_t checksum = 0; // without the sequence number, so not inverted
+};
+
+template<size_t SIZE, typename... BYTES>
+constexpr bool commandIs(const ConstantCommand<SIZE> &command, const BYTES... bytes)
+{
+    const uint8_t expected[] = { uint8_t(bytes)... };
+    if (command.size != int(sizeof...(bytes))) {
+        return false;
+    }
+    for (int i=0; i<command.size; i++) {
+        if (uint8_t(command.bytes[i]) != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
 struct RotateCommandPacket
 {
     float rate;
@@ -431,21 +474,21 @@ struct DataStreamingCommandPacket : DataStreamingCommandPacket_Old
     static constexpr uint32_t deviceId = CommandPacketHeader::HardwareControl;
     static constexpr uint32_t commandId = CommandPacketHeader::SetDataStreaming;
 
+    // See SensorStream.h for the full list
     enum SourceMask : uint64_t {
         Quaternion0 = 0x80000000,
         Quaternion1 = 0x40000000,
         Quaternion2 = 0x20000000,
         Quaternion3 = 0x10000000,
-        LocatorX = 0x0800000,
-        LocatorY = 0x0400000,
+        LocatorX = 0x08000000,
+        LocatorY = 0x04000000,
 
-        // TODO:
-        //MaskAccelOne                  = 0x0200000000000000,
+        AccelOne = 0x02000000,
 
-        VelocityX = 0x0100000,
-        VelocityY = 0x0080000,
+        VelocityX = 0x01000000,
+        VelocityY = 0x00800000,
 
-        LocatorAll = 0x0D80000,
+        LocatorAll = 0x0D800000,
         QuaternionAll = 0xF0000000,
 
         AllSourcesHigh = 0xFFFFFFFF,
@@ -453,13 +496,14 @@ struct DataStreamingCommandPacket : DataStreamingCommandPacket_Old
     };
     uint32_t sourceMaskHighBits = AllSourcesHigh; // firmware >= 1.17
 
+    // Everything is big endian
     static QByteArray create(const int packetCount, const uint16_t maxRateDivisor = 10, const uint16_t framesPerPacket = 1, const uint32_t sourceMask = AllSources, const uint32_t sourceMask2 = NoMask) {
         DataStreamingCommandPacket def;
         def.packetCount = packetCount;
-        def.maxRateDivisor = maxRateDivisor;
-        def.framesPerPacket = framesPerPacket;
-        def.sourceMask = sourceMask;
-        def.sourceMaskHighBits = sourceMask2;
+        def.maxRateDivisor = qToBigEndian(maxRateDivisor);
+        def.framesPerPacket = qToBigEndian(framesPerPacket);
+        def.sourceMask = qToBigEndian(sourceMask);
+        def.sourceMaskHighBits = qToBigEndian(sourceMask2);
         return packetToByteArray(def);
     }
 };
@@ -555,6 +599,9 @@ struct GoToSleepPacket
 
     GoToSleepPacket(const uint16_t wakeInterval_ = 5) : wakeupInterval(wakeInterval_) {
     }
+
+    // The default one, big endian wakeup interval of 5 seconds
+    static constexpr ConstantCommand<5> encoded = ConstantCommand<5>(deviceId, commandId, { 0x00, 0x05, 0x00, 0x00, 0x00 });
 };
 
 struct SetNonPersistentOptionsPacket
@@ -617,6 +664,14 @@ struct SetPIDCommandPacket
 };
 
 
+struct PingPacket
+{
+    static constexpr uint32_t deviceId = CommandPacketHeader::Internal;
+    static constexpr uint32_t commandId = CommandPacketHeader::Ping;
+
+    static constexpr ConstantCommand<0> encoded = ConstantCommand<0>(deviceId, commandId, {});
+};
+
 struct SetPowerNotifyCommandPacket
 {
     static constexpr uint32_t deviceId = CommandPacketHeader::Internal;
@@ -626,5 +681,8 @@ struct SetPowerNotifyCommandPacket
 };
 #pragma pack(pop)
 
+static_assert(commandIs(GoToSleepPacket::encoded, 0xff, 0xff, 0x00, 0x22, 0x00, 0x06, 0x00, 0x05, 0x00, 0x00, 0x00, 0xd2));
+static_assert(commandIs(PingPacket::encoded, 0xff, 0xff, 0x00, 0x01, 0x00, 0x01, 0xfd));
+
 } // namespace v1
 } // namespace sphero
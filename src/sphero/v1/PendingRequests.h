@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDebug>
+#include <QList>
+#include <array>
+#include <cstdint>
+
+namespace sphero {
+namespace v1 {
+
+// Synchronous commands we are waiting for a response to, indexed directly by
+// the sequence number. Entries have a deadline and are resent with backoff a
+// few times before we give up on them, so a lost response doesn't end up
+// blocking the sequence number forever.
+//
+// Cancelled requests aren't resent, but keep their sequence number until the
+// response or the deadline arrives, so a late response can't be mistaken for
+// the response to something newer.
+//
+// All times are in nanoseconds, from whatever monotonic clock the owner uses.
+class PendingRequests
+{
+public:
+    struct Request {
+        bool active = false;
+        bool cancelled = false; // still reserved, but nobody cares about the response
+        uint8_t deviceId = 0;
+        uint8_t commandId = 0;
+        int attempts = 0;
+        qint64 sentAt = 0; // last attempt
+        qint64 deadline = 0;
+        QByteArray frame; // encoded, for resending
+    };
+
+    void setTimeout(const qint64 timeout) { m_timeout = timeout; }
+    void setMaxRetries(const int retries) { m_maxRetries = retries; }
+
+    bool isPending(const uint8_t sequenceNumber) const {
+        return m_requests[sequenceNumber].active;
+    }
+
+    int count() const { return m_count; }
+
+    // Sequence number 0 is never used
+    bool findFree(const uint8_t start, uint8_t *sequenceNumber) const {
+        for (int i=0; i<256; i++) {
+            const uint8_t candidate = uint8_t(start + i);
+            if (candidate && !m_requests[candidate].active) {
+                *sequenceNumber = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add(const uint8_t sequenceNumber, const uint8_t deviceId, const uint8_t commandId, const QByteArray &frame, const qint64 now) {
+        Request &request = m_requests[sequenceNumber];
+        if (!request.active) {
+            m_count++;
+        }
+        request.active = true;
+        request.cancelled = false;
+        request.deviceId = deviceId;
+        request.commandId = commandId;
+        request.attempts = 1;
+        request.sentAt = now;
+        request.deadline = now + m_timeout;
+        request.frame = frame;
+    }
+
+    // Returns an inactive request if we weren't waiting for this
+    Request take(const uint8_t sequenceNumber) {
+        Request &request = m_requests[sequenceNumber];
+        if (!request.active) {
+            return Request();
+        }
+        Request ret = std::move(request);
+        request = Request();
+        m_count--;
+        return ret;
+    }
+
+    bool cancel(const uint8_t sequenceNumber) {
+        Request &request = m_requests[sequenceNumber];
+        if (!request.active || request.cancelled) {
+            return false;
+        }
+        request.cancelled = true;
+        request.frame.clear();
+        return true;
+    }
+
+    // Returns the number of cancelled requests
+    int cancel(const uint8_t deviceId, const uint8_t commandId) {
+        int cancelled = 0;
+        for (int i=0; i<256; i++) {
+            const Request &request = m_requests[i];
+            if (request.active && request.deviceId == deviceId && request.commandId == commandId && cancel(i)) {
+                cancelled++;
+            }
+        }
+        return cancelled;
+    }
+
+    void clear() {
+        for (Request &request : m_requests) {
+            request = Request();
+        }
+        m_count = 0;
+    }
+
+    // Calls resend(uint8_t sequenceNumber, const Request &) for requests that
+    // should be retried and expired(uint8_t sequenceNumber, const Request &)
+    // for the ones that have run out of retries, those are removed afterwards.
+    // The timeout is doubled for every attempt. Cancelled requests are just
+    // removed when they reach their deadline.
+    template<typename RESEND, typename EXPIRED>
+    void checkDeadlines(const qint64 now, RESEND &&resend, EXPIRED &&expired) {
+        if (!m_count) {
+            return;
+        }
+        for (int i=0; i<256; i++) {
+            Request &request = m_requests[i];
+            if (!request.active || request.deadline > now) {
+                continue;
+            }
+            if (request.cancelled) {
+                take(i);
+                continue;
+            }
+            if (request.attempts > m_maxRetries) {
+                const Request dead = take(i);
+                expired(uint8_t(i), dead);
+                continue;
+            }
+            request.sentAt = now;
+            request.deadline = now + (m_timeout << qMin(request.attempts, 16));
+            request.attempts++;
+            resend(uint8_t(i), request);
+        }
+    }
+
+    QList<uint8_t> sequenceNumbers() const {
+        QList<uint8_t> ret;
+        for (int i=0; i<256; i++) {
+            if (m_requests[i].active) {
+                ret.append(i);
+            }
+        }
+        return ret;
+    }
+
+private:
+    std::array<Request, 256> m_requests;
+    int m_count = 0;
+
+    qint64 m_timeout = 1000 * 1000 * 1000;
+    int m_maxRetries = 2;
+};
+
+} // namespace v1
+} // namespace sphero
@@ -0,0 +1,183 @@
+#include "SampleConversion.h"
+
+#include "logging.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QVector>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define SPHERO_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace sphero {
+namespace v1 {
+
+namespace {
+
+using ConvertFunction = void (*)(const char *data, const int count, const float *scales, float *out);
+
+void convertScalar(const char *data, const int count, const float *scales, float *out)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+    for (int i=0; i<count; i++) {
+        out[i] = float(int16_t(uint16_t(bytes[2 * i] << 8 | bytes[2 * i + 1]))) * scales[i];
+    }
+}
+
+#ifdef SPHERO_X86_SIMD
+
+// Baseline on x86-64, so no need to check for it
+void convertSSE2(const char *data, const int count, const float *scales, float *out)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * i));
+        raw = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+
+        // Sign extend by putting the values in the upper halves and shifting down
+        const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+        const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(raw, raw), 16);
+
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), _mm_loadu_ps(scales + i)));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), _mm_loadu_ps(scales + i + 4)));
+    }
+    convertScalar(data + 2 * i, count - i, scales + i, out + i);
+}
+
+__attribute__((target("avx2")))
+void convertAVX2(const char *data, const int count, const float *scales, float *out)
+{
+    const __m256i swap = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+    );
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i raw = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 2 * i)), swap);
+
+        const __m256i low = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(raw));
+        const __m256i high = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(raw, 1));
+
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), _mm256_loadu_ps(scales + i)));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), _mm256_loadu_ps(scales + i + 8)));
+    }
+    convertSSE2(data + 2 * i, count - i, scales + i, out + i);
+}
+
+#endif // SPHERO_X86_SIMD
+
+struct Implementation {
+    const char *name;
+    ConvertFunction function;
+};
+
+Implementation bestImplementation()
+{
+#ifdef SPHERO_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { "AVX2", convertAVX2 };
+    }
+    return { "SSE2", convertSSE2 };
+#else
+    return { "scalar", convertScalar };
+#endif
+}
+
+const Implementation &implementation()
+{
+    static const Implementation best = bestImplementation();
+    return best;
+}
+
+// What we would do without this, for comparison
+void convertQFromBigEndian(const char *data, const int count, const float *scales, float *out)
+{
+    for (int i=0; i<count; i++) {
+        out[i] = qFromBigEndian<int16_t>(data + 2 * i) * scales[i];
+    }
+}
+
+} // namespace
+
+void convertBigEndianSamples(const char *data, const int count, const float *scales, float *out)
+{
+    implementation().function(data, count, scales, out);
+}
+
+const char *sampleConversionImplementation()
+{
+    return implementation().name;
+}
+
+void benchmarkSampleConversion()
+{
+    // Sixteen frames with most of the channels we usually stream
+    static constexpr int samplesPerPacket = 16 * 18;
+    static constexpr int packetCount = 1000;
+    static constexpr int rounds = 20;
+
+    QVector<quint32> random(samplesPerPacket * packetCount / 2);
+    QRandomGenerator(1337).fillRange(random.data(), random.size());
+    QByteArray input(reinterpret_cast<const char*>(random.constData()), random.size() * int(sizeof(quint32)));
+
+    QVector<float> scales(samplesPerPacket);
+    for (int i=0; i<samplesPerPacket; i++) {
+        scales[i] = 1.f / (1 + i % 18);
+    }
+    QVector<float> output(samplesPerPacket);
+    QVector<float> expected(samplesPerPacket * packetCount);
+    for (int packet=0; packet<packetCount; packet++) {
+        convertQFromBigEndian(input.constData() + packet * samplesPerPacket * 2, samplesPerPacket, scales.constData(), expected.data() + packet * samplesPerPacket);
+    }
+
+    QVector<Implementation> implementations = {
+        { "qFromBigEndian", convertQFromBigEndian },
+        { "scalar", convertScalar },
+    };
+#ifdef SPHERO_X86_SIMD
+    implementations.append({ "SSE2", convertSSE2 });
+    if (__builtin_cpu_supports("avx2")) {
+        implementations.append({ "AVX2", convertAVX2 });
+    }
+#endif
+
+    qCDebug(lcBenchmark) << "Converting" << packetCount * rounds << "packets of" << samplesPerPacket << "samples, using" << sampleConversionImplementation() << "by default";
+
+    qint64 baseline = 0;
+    for (const Implementation &candidate : implementations) {
+        float sum = 0;
+        bool correct = true;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int round=0; round<rounds; round++) {
+            for (int packet=0; packet<packetCount; packet++) {
+                candidate.function(input.constData() + packet * samplesPerPacket * 2, samplesPerPacket, scales.constData(), output.data());
+                sum += output[packet % samplesPerPacket];
+
+                if (round == 0 && memcmp(output.constData(), expected.constData() + packet * samplesPerPacket, samplesPerPacket * sizeof(float)) != 0) {
+                    correct = false;
+                }
+            }
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        if (!baseline) {
+            baseline = elapsed;
+        }
+
+        const double nsPerSample = double(elapsed) / (double(samplesPerPacket) * packetCount * rounds);
+        qCDebug(lcBenchmark).nospace() << " - " << candidate.name << ": " << nsPerSample << " ns/sample, "
+            << double(baseline) / elapsed << "x" << (correct ? "" : " WRONG RESULTS") << " (" << sum << ")";
+    }
+}
+
+} // namespace v1
+} // namespace sphero
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace sphero {
+namespace v1 {
+
+// Byte swaps count big endian int16s and converts them to floats, multiplied
+// with the matching entry in scales. Picks the widest SIMD implementation the
+// CPU supports the first time it is called.
+void convertBigEndianSamples(const char *data, const int count, const float *scales, float *out);
+
+// Which one convertBigEndianSamples() ended up using
+const char *sampleConversionImplementation();
+
+// Prints timings for all the implementations we can run here, compared to
+// doing it one field at a time with qFromBigEndian.
+void benchmarkSampleConversion();
+
+} // namespace v1
+} // namespace sphero
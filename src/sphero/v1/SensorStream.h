@@ -0,0 +1,222 @@
+#pragma once
+
+#include "SampleConversion.h"
+
+#include "logging.h"
+
+#include <QDebug>
+#include <array>
+#include <cstdint>
+
+namespace sphero {
+namespace v1 {
+
+// Every value in the data streaming notifications is a big endian int16,
+// the enabled ones are sent in the order of the mask bits, MSB first, first
+// for the first mask and then the second one.
+namespace SensorChannel {
+enum Channel : uint8_t {
+    // First mask
+    AccelerometerXRaw,
+    AccelerometerYRaw,
+    AccelerometerZRaw,
+    GyroXRaw,
+    GyroYRaw,
+    GyroZRaw,
+    RightMotorBackEMFRaw,
+    LeftMotorBackEMFRaw,
+    LeftMotorPWMRaw,
+    RightMotorPWMRaw,
+    Pitch, // degrees
+    Roll, // degrees
+    Yaw, // degrees
+    AccelerometerX, // G
+    AccelerometerY, // G
+    AccelerometerZ, // G
+    GyroX, // degrees per second
+    GyroY, // degrees per second
+    GyroZ, // degrees per second
+    RightMotorBackEMF, // 22.5 cm units
+    LeftMotorBackEMF, // 22.5 cm units
+
+    // Second mask, firmware >= 1.17
+    QuaternionW,
+    QuaternionX,
+    QuaternionY,
+    QuaternionZ,
+    OdometerX, // cm
+    OdometerY, // cm
+    AccelerationOne, // G
+    VelocityX, // mm/s
+    VelocityY, // mm/s
+
+    ChannelCount
+};
+
+struct Definition {
+    Channel channel;
+    bool secondMask;
+    uint32_t bit;
+    float scale;
+    const char *name;
+};
+
+static constexpr std::array<Definition, ChannelCount> definitions = {{
+    { AccelerometerXRaw,    false, 0x80000000, 1.f, "accelerometerXRaw" },
+    { AccelerometerYRaw,    false, 0x40000000, 1.f, "accelerometerYRaw" },
+    { AccelerometerZRaw,    false, 0x20000000, 1.f, "accelerometerZRaw" },
+    { GyroXRaw,             false, 0x10000000, 1.f, "gyroXRaw" },
+    { GyroYRaw,             false, 0x08000000, 1.f, "gyroYRaw" },
+    { GyroZRaw,             false, 0x04000000, 1.f, "gyroZRaw" },
+    { RightMotorBackEMFRaw, false, 0x00400000, 1.f, "rightMotorBackEMFRaw" },
+    { LeftMotorBackEMFRaw,  false, 0x00200000, 1.f, "leftMotorBackEMFRaw" },
+    { LeftMotorPWMRaw,      false, 0x00100000, 1.f, "leftMotorPWMRaw" },
+    { RightMotorPWMRaw,     false, 0x00080000, 1.f, "rightMotorPWMRaw" },
+    { Pitch,                false, 0x00040000, 1.f, "pitch" },
+    { Roll,                 false, 0x00020000, 1.f, "roll" },
+    { Yaw,                  false, 0x00010000, 1.f, "yaw" },
+    { AccelerometerX,       false, 0x00008000, 1.f / 4096.f, "accelerometerX" },
+    { AccelerometerY,       false, 0x00004000, 1.f / 4096.f, "accelerometerY" },
+    { AccelerometerZ,       false, 0x00002000, 1.f / 4096.f, "accelerometerZ" },
+    { GyroX,                false, 0x00001000, 0.1f, "gyroX" },
+    { GyroY,                false, 0x00000800, 0.1f, "gyroY" },
+    { GyroZ,                false, 0x00000400, 0.1f, "gyroZ" },
+    { RightMotorBackEMF,    false, 0x00000040, 1.f, "rightMotorBackEMF" },
+    { LeftMotorBackEMF,     false, 0x00000020, 1.f, "leftMotorBackEMF" },
+
+    { QuaternionW,          true,  0x80000000, 1.f / 10000.f, "quaternionW" },
+    { QuaternionX,          true,  0x40000000, 1.f / 10000.f, "quaternionX" },
+    { QuaternionY,          true,  0x20000000, 1.f / 10000.f, "quaternionY" },
+    { QuaternionZ,          true,  0x10000000, 1.f / 10000.f, "quaternionZ" },
+    { OdometerX,            true,  0x08000000, 1.f, "odometerX" },
+    { OdometerY,            true,  0x04000000, 1.f, "odometerY" },
+    { AccelerationOne,      true,  0x02000000, 1.f / 1000.f, "accelerationOne" },
+    { VelocityX,            true,  0x01000000, 1.f, "velocityX" },
+    { VelocityY,            true,  0x00800000, 1.f, "velocityY" },
+}};
+
+constexpr bool definitionsInOrder()
+{
+    for (size_t i=0; i<definitions.size(); i++) {
+        if (definitions[i].channel != Channel(i)) {
+            return false;
+        }
+        if (i > 0 && definitions[i].secondMask == definitions[i-1].secondMask && definitions[i].bit >= definitions[i-1].bit) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(definitionsInOrder(), "The stream order needs to match the channel order");
+
+constexpr uint32_t mask(const Channel channel)
+{
+    return definitions[channel].secondMask ? 0 : definitions[channel].bit;
+}
+
+constexpr uint32_t mask2(const Channel channel)
+{
+    return definitions[channel].secondMask ? definitions[channel].bit : 0;
+}
+
+} // namespace SensorChannel
+
+// Struct of arrays ring buffer, so consumers can run through one channel at a
+// time. Timestamps are in microseconds.
+struct SensorSamples
+{
+    static constexpr int Capacity = 1024; // ~2.5 seconds at 400 Hz
+
+    std::array<std::array<float, Capacity>, SensorChannel::ChannelCount> channels{};
+    std::array<qint64, Capacity> timestamps{};
+
+    // Total number of frames ever written, the newest is at (written - 1) % Capacity
+    quint64 written = 0;
+
+    float latest(const SensorChannel::Channel channel) const {
+        if (!written) {
+            return 0.f;
+        }
+        return channels[channel][(written - 1) % Capacity];
+    }
+
+    qint64 latestTimestamp() const {
+        if (!written) {
+            return 0;
+        }
+        return timestamps[(written - 1) % Capacity];
+    }
+
+    void clear() { written = 0; }
+};
+
+class SensorStreamDecoder
+{
+public:
+    // The firmware doesn't like more than this
+    static constexpr int MaxFramesPerPacket = 16;
+
+    void configure(const uint32_t mask, const uint32_t mask2) {
+        m_enabledCount = 0;
+        for (const SensorChannel::Definition &definition : SensorChannel::definitions) {
+            if (definition.bit & (definition.secondMask ? mask2 : mask)) {
+                m_enabled[m_enabledCount] = definition.channel;
+                m_enabledCount++;
+            }
+        }
+
+        // One scale per value in a full packet, so the conversion can go
+        // through everything in one straight line
+        for (int frame=0; frame<MaxFramesPerPacket; frame++) {
+            for (int channel=0; channel<m_enabledCount; channel++) {
+                m_scales[frame * m_enabledCount + channel] = SensorChannel::definitions[m_enabled[channel]].scale;
+            }
+        }
+    }
+
+    int channelCount() const { return m_enabledCount; }
+    int frameSize() const { return m_enabledCount * int(sizeof(int16_t)); }
+
+    const SensorChannel::Channel *channels() const { return m_enabled.data(); }
+
+    // Decodes all the frames in a notification in one go, the last one gets
+    // the timestamp and the rest are spaced out by framePeriod before it.
+    // Returns the number of frames, or -1 if the size doesn't match what we have configured.
+    int decode(const char *data, const int size, const qint64 timestamp, const qint64 framePeriod, SensorSamples *out) {
+        if (!m_enabledCount || size % frameSize() != 0) {
+            qCWarning(lcSphero) << " ! Sensor data size" << size << "doesn't match frame size" << frameSize();
+            return -1;
+        }
+        const int frameCount = size / frameSize();
+        if (frameCount > MaxFramesPerPacket) {
+            qCWarning(lcSphero) << " ! Too many frames in sensor data" << frameCount;
+            return -1;
+        }
+
+        convertBigEndianSamples(data, frameCount * m_enabledCount, m_scales.data(), m_scratch.data());
+
+        const quint64 first = out->written;
+        for (int channel=0; channel<m_enabledCount; channel++) {
+            std::array<float, SensorSamples::Capacity> &values = out->channels[m_enabled[channel]];
+            for (int frame=0; frame<frameCount; frame++) {
+                values[(first + frame) % SensorSamples::Capacity] = m_scratch[frame * m_enabledCount + channel];
+            }
+        }
+        for (int frame=0; frame<frameCount; frame++) {
+            out->timestamps[(first + frame) % SensorSamples::Capacity] = timestamp - (frameCount - 1 - frame) * framePeriod;
+        }
+        out->written += frameCount;
+
+        return frameCount;
+    }
+
+private:
+    std::array<SensorChannel::Channel, SensorChannel::ChannelCount> m_enabled{};
+    std::array<float, MaxFramesPerPacket * SensorChannel::ChannelCount> m_scales{};
+    int m_enabledCount = 0;
+
+    std::array<float, MaxFramesPerPacket * SensorChannel::ChannelCount> m_scratch{};
+};
+
+} // namespace v1
+} // namespace sphero
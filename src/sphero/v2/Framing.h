@@ -0,0 +1,268 @@
+#pragma once
+
+#include <QByteArray>
+#include "logging.h"
+
+#include <QDebug>
+#include <array>
+#include <cstdint>
+
+namespace sphero {
+namespace v2 {
+
+static constexpr char Escape = 0xAB;
+static constexpr char EscapedEscape = 0x23;
+static constexpr char StartOfPacket = 0x8D;
+static constexpr char EscapedStartOfPacket = 0x03;
+static constexpr char EndOfPacket = 0xD8;
+static constexpr char EscapedEndOfPacket = 0x50;
+
+// Worst case every byte, including the checksum, needs to be escaped
+constexpr int maxEncodedSize(const int rawSize)
+{
+    return 1 + 2 * (rawSize + 1) + 1;
+}
+
+// Escapes into out (needs room for 2 * size) and adds to the checksum.
+// Returns the number of bytes written.
+constexpr int escapeBytes(const char *data, const int size, char *out, uint8_t *checksum)
+{
+    int pos = 0;
+    for (int i=0; i<size; i++) {
+        const char c = data[i];
+        *checksum += uint8_t(c);
+
+        switch(c) {
+        case Escape:
+            out[pos++] = Escape;
+            out[pos++] = EscapedEscape;
+            break;
+        case StartOfPacket:
+            out[pos++] = Escape;
+            out[pos++] = EscapedStartOfPacket;
+            break;
+        case EndOfPacket:
+            out[pos++] = Escape;
+            out[pos++] = EscapedEndOfPacket;
+            break;
+        default:
+            out[pos++] = c;
+            break;
+        }
+    }
+    return pos;
+}
+
+// Appends the (escaped) checksum and the end marker, returns the number of bytes written
+constexpr int finishFrame(const uint8_t checksum, char *out)
+{
+    const char checksumByte = char(checksum xor 0xFF);
+    uint8_t unused = 0;
+    const int size = escapeBytes(&checksumByte, 1, out, &unused);
+    out[size] = EndOfPacket;
+    return size + 1;
+}
+
+// Escapes and checksums in one go, out needs to have room for maxEncodedSize(size).
+// Returns the number of bytes written.
+constexpr int encodeFrame(const char *data, const int size, char *out)
+{
+    int pos = 0;
+    out[pos++] = StartOfPacket;
+    uint8_t checksum = 0;
+    pos += escapeBytes(data, size, out + pos, &checksum);
+    pos += finishFrame(checksum, out + pos);
+    return pos;
+}
+
+template<int MAXSIZE>
+struct EncodedFrame
+{
+    std::array<char, MAXSIZE> data{};
+    int size = 0;
+
+    QByteArray toByteArray() const {
+        return QByteArray(data.data(), size);
+    }
+
+    // Doesn't copy, so only for frames that are never going away (i. e. static constexpr ones)
+    QByteArray toRawByteArray() const {
+        return QByteArray::fromRawData(data.data(), size);
+    }
+};
+
+// For packets without any runtime fields, so they can be done at compile time
+template<size_t SIZE>
+constexpr EncodedFrame<maxEncodedSize(SIZE)> encodeConstant(const std::array<char, SIZE> &raw)
+{
+    EncodedFrame<maxEncodedSize(SIZE)> ret;
+    ret.size = encodeFrame(raw.data(), SIZE, ret.data.data());
+    return ret;
+}
+
+// For static_asserts on the encoded bytes
+template<int MAXSIZE, typename... BYTES>
+constexpr bool frameIs(const EncodedFrame<MAXSIZE> &frame, const BYTES... bytes)
+{
+    const uint8_t expected[] = { uint8_t(bytes)... };
+    if (frame.size != int(sizeof...(bytes))) {
+        return false;
+    }
+    for (int i=0; i<frame.size; i++) {
+        if (uint8_t(frame.data[i]) != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// For packets where only the payload changes, the header is escaped and
+// checksummed at compile time so only the payload is left at runtime.
+template<size_t HEADERSIZE, size_t PAYLOADSIZE>
+class FrameTemplate
+{
+public:
+    using Frame = EncodedFrame<maxEncodedSize(HEADERSIZE + PAYLOADSIZE)>;
+
+    constexpr explicit FrameTemplate(const std::array<char, HEADERSIZE> &header)
+    {
+        m_prefix[0] = StartOfPacket;
+        m_prefixSize = 1 + escapeBytes(header.data(), HEADERSIZE, m_prefix.data() + 1, &m_checksum);
+    }
+
+    constexpr Frame encode(const std::array<char, PAYLOADSIZE> &payload) const
+    {
+        Frame ret;
+        for (int i=0; i<m_prefixSize; i++) {
+            ret.data[i] = m_prefix[i];
+        }
+        uint8_t checksum = m_checksum;
+        int pos = m_prefixSize;
+        pos += escapeBytes(payload.data(), PAYLOADSIZE, ret.data.data() + pos, &checksum);
+        pos += finishFrame(checksum, ret.data.data() + pos);
+        ret.size = pos;
+        return ret;
+    }
+
+private:
+    std::array<char, 1 + 2 * HEADERSIZE> m_prefix{};
+    int m_prefixSize = 0;
+    uint8_t m_checksum = 0;
+};
+
+// Incremental decoder for the v2 framing.
+// Unescapes and checksums in one pass straight into a fixed buffer, so we
+// don't need to slice up QByteArrays for every notification we get.
+class StreamDecoder
+{
+public:
+    // Unescaped, including the checksum. Everything we know about is way smaller.
+    static constexpr int MaxFrameSize = 256;
+
+    // Calls onFrame(const char *data, int size) for every valid frame, the
+    // checksum is stripped. The data is only valid during the callback.
+    template<typename CALLBACK>
+    void feed(const char *data, const int size, CALLBACK &&onFrame)
+    {
+        for (int i=0; i<size; i++) {
+            const char c = data[i];
+
+            switch(m_state) {
+            case WaitingForStart:
+                if (c == StartOfPacket) {
+                    startFrame();
+                }
+                break;
+            case InFrame:
+                switch(c) {
+                case StartOfPacket:
+                    qCWarning(lcSpheroProtocol) << " ! Start of packet inside packet, dropping" << m_size << "bytes";
+                    m_droppedFrames++;
+                    startFrame();
+                    break;
+                case EndOfPacket:
+                    m_state = WaitingForStart;
+                    if (m_size < 1) {
+                        qCWarning(lcSpheroProtocol) << " ! Empty packet";
+                        m_droppedFrames++;
+                        break;
+                    }
+                    // The checksum is the sum inverted, so everything including it sums up to 0xFF
+                    if (m_checksum != 0xFF) {
+                        qCWarning(lcSpheroProtocol) << " ! Invalid checksum" << uint8_t(m_buffer[m_size - 1]);
+                        m_droppedFrames++;
+                        break;
+                    }
+                    onFrame(m_buffer.data(), m_size - 1);
+                    break;
+                case Escape:
+                    m_state = InEscape;
+                    break;
+                default:
+                    append(c);
+                    break;
+                }
+                break;
+            case InEscape:
+                switch(c) {
+                case EscapedEscape:
+                    append(Escape);
+                    break;
+                case EscapedStartOfPacket:
+                    append(StartOfPacket);
+                    break;
+                case EscapedEndOfPacket:
+                    append(EndOfPacket);
+                    break;
+                default:
+                    qCWarning(lcSpheroProtocol) << " ! Invalid escape sequence" << uint8_t(c);
+                    m_droppedFrames++;
+                    m_state = WaitingForStart;
+                    continue;
+                }
+                // append() might have bailed out because of overflow
+                if (m_state == InEscape) {
+                    m_state = InFrame;
+                }
+                break;
+            }
+        }
+    }
+
+    void reset() { m_state = WaitingForStart; m_size = 0; }
+
+    int droppedFrames() const { return m_droppedFrames; }
+
+private:
+    void startFrame() {
+        m_state = InFrame;
+        m_size = 0;
+        m_checksum = 0;
+    }
+
+    void append(const char c) {
+        if (m_size >= MaxFrameSize) {
+            qCWarning(lcSpheroProtocol) << " ! Packet too large, dropping";
+            m_droppedFrames++;
+            m_state = WaitingForStart;
+            return;
+        }
+        m_buffer[m_size++] = c;
+        m_checksum += uint8_t(c);
+    }
+
+    enum State {
+        WaitingForStart,
+        InFrame,
+        InEscape
+    };
+
+    State m_state = WaitingForStart;
+    std::array<char, MaxFrameSize> m_buffer;
+    int m_size = 0;
+    uint8_t m_checksum = 0;
+    int m_droppedFrames = 0;
+};
+
+} // namespace v2
+} // namespace sphero
@@ -3,6 +3,9 @@
 #include "BasicTypes.h"
 
 #include "utils.h"
+#include "Framing.h"
+
+#include "logging.h"
 
 #include <QDebug>
 #include <QObject>
@@ -14,109 +17,41 @@
 namespace sphero {
 namespace v2 {
 
-static constexpr char Escape = 0xAB;
-static constexpr char EscapedEscape = 0x23;
-static constexpr char StartOfPacket = 0x8D;
-static constexpr char EscapedStartOfPacket = 0x03;
-static constexpr char EndOfPacket = 0xD8;
-static constexpr char EscapedEndOfPacket = 0x50;
+template <typename PACKET>
+static constexpr int maxPacketSize = maxEncodedSize(sizeof(PACKET));
 
+// out needs to have room for maxPacketSize<PACKET>, returns the number of bytes written
 template <typename PACKET>
-QByteArray encode(const PACKET &packet)
+int encode(const PACKET &packet, char *out)
 {
-    QByteArray raw(reinterpret_cast<const char*>(&packet), sizeof(PACKET));
-    uint8_t checksum = 0;
-    for (const char c : raw) {
-        checksum += c;
-    }
-    raw.append(checksum xor 0xFF);
-
-    QByteArray encoded(1, StartOfPacket);
-    for (const char c : raw) {
-        switch(c) {
-        case Escape:
-            encoded.append(Escape);
-            encoded.append(EscapedEscape);
-            break;
-        case StartOfPacket:
-            encoded.append(Escape);
-            encoded.append(EscapedStartOfPacket);
-            break;
-        case EndOfPacket:
-            encoded.append(Escape);
-            encoded.append(EscapedEndOfPacket);
-            break;
-        default:
-            encoded.append(c);
-            break;
-        }
-    }
-
-
-
-    encoded.append(EndOfPacket);
-
-    qDebug() << " + Packet:";
-    qDebug() << "  ] Flags:" << packet.m_flags;
-    qDebug() << "  ] Device ID:" << packet.m_deviceID;
-    qDebug() << "  ] Command ID:" << packet.m_commandID;
-//    qDebug() << "  ] Sequence number:" << packet.m_sequenceNumber;
-//    qDebug() << "  ] Source:" << packet.sourceID;
-//    qDebug() << "  ] Target:" << packet.targetID;
-//    qDebug() << "  ] Error code:" << packet.errorCode;
+    return encodeFrame(reinterpret_cast<const char*>(&packet), sizeof(PACKET), out);
+}
 
-    return encoded;
+template <typename PACKET>
+QByteArray encode(const PACKET &packet)
+{
+    std::array<char, maxPacketSize<PACKET>> buffer;
+    const int size = encode(packet, buffer.data());
+    return QByteArray(buffer.data(), size);
 }
+
 template <typename PACKET>
 PACKET decode(const QByteArray &input, bool *ok)
 {
     if (!input.startsWith(StartOfPacket) || !input.endsWith(EndOfPacket)) {
-        qWarning() << "invalid start or end";
-        *ok = false;
-        return {};
-    }
-
-    QByteArray decoded;
-    for (int i=1; i<input.size()-1; i++){
-        const char c = input[i];
-        if (c != Escape) {
-            decoded.append(c);
-            continue;
-        }
-        i++;
-        switch(input[i]) {
-        case EscapedEscape:
-            decoded.append(Escape);
-            break;
-        case EscapedStartOfPacket:
-            decoded.append(StartOfPacket);
-            break;
-        case EscapedEndOfPacket:
-            decoded.append(EndOfPacket);
-            break;
-        default:
-            *ok = false;
-            qWarning() << "Invalid escape sequence" << c << input[i];
-            qDebug() << input.toHex(':');
-            return {};
-        }
-    }
-    qDebug() << "decoded" << decoded.toHex(':');
-
-    uint8_t checksum = 0;
-    for (int i=0; i<decoded.size() - 1; i++) {
-        checksum += decoded[i];
-    }
-
-    if (!decoded.endsWith(checksum xor 0xff)) {
-        qWarning() <<  "invalid checksum" << decoded.back() << "expected" << checksum;
+        qCWarning(lcSpheroProtocol) << "invalid start or end";
         *ok = false;
         return {};
     }
 
-    decoded.chop(1); // remove the checksum at the end
+    *ok = false;
+    PACKET ret{};
+    StreamDecoder decoder;
+    decoder.feed(input.constData(), input.size(), [&](const char *frame, const int size) {
+        ret = bytesToPacket<PACKET>(frame, size, ok);
+    });
 
-    return byteArrayToPacket<PACKET>(decoded, ok);
+    return ret;
 }
 
 #pragma pack(push,1)
@@ -204,6 +139,11 @@ public:
 //        m_sequenceNumber = number;
     //}
 
+    // What the header of a default constructed packet looks like on the wire, for the compile time encoding
+    static constexpr std::array<char, 4> headerBytes(const uint8_t deviceID, const uint8_t commandID) {
+        return { char(Synchronous | ResetTimeout), char(deviceID), char(commandID), 0 };
+    }
+
 protected:
     Packet(const uint8_t deviceID, const uint8_t commandID) :
         m_deviceID(deviceID),
@@ -460,28 +400,38 @@ struct RequestBatteryVoltagePacket : public Packet {
     static constexpr uint8_t id = 0x3;
 
     RequestBatteryVoltagePacket() : Packet(Packet::MainSystem, id) {}
+
+    static constexpr auto encoded = encodeConstant(headerBytes(Packet::MainSystem, id));
 };
 
 struct GoToLightSleep : public Packet {
     static constexpr uint8_t id = 0x1;
 
     GoToLightSleep() : Packet(Packet::MainSystem, id) {}
+
+    static constexpr auto encoded = encodeConstant(headerBytes(Packet::MainSystem, id));
 };
 
 struct WakePacket : public Packet {
     static constexpr uint8_t id = 0xd;
 
     WakePacket() : Packet(Packet::MainSystem, id) {}
+
+    static constexpr auto encoded = encodeConstant(headerBytes(Packet::MainSystem, id));
 };
 
 struct PingPacket : public Packet {
     static constexpr uint8_t id = 0;
     PingPacket() : Packet(Packet::PingPong, id) {}
+
+    static constexpr auto encoded = encodeConstant(headerBytes(Packet::PingPong, id));
 };
 
 struct GetTemperaturePacket : public Packet {
     static constexpr uint8_t id = 0xe;
     GetTemperaturePacket() : Packet(Packet::Info, id) {}
+
+    static constexpr auto encoded = encodeConstant(headerBytes(Packet::Info, id));
 };
 
 struct DrivePacket : public Packet {
@@ -505,7 +455,15 @@ struct DrivePacket : public Packet {
     uint8_t m_speed = 0;
     uint16_t m_heading = 0;
     uint8_t m_driveFlags = 0;
+
+    static constexpr FrameTemplate<4, 4> frameTemplate = FrameTemplate<4, 4>(headerBytes(Packet::DrivingSystem, id));
+
+    // Same as encode(DrivePacket(...)), but only the payload is encoded at runtime
+    static QByteArray encode(const uint8_t speed, const uint16_t heading, const uint8_t flags = 0) {
+        return frameTemplate.encode({ char(speed), char(heading >> 8), char(heading & 0xFF), char(flags) }).toByteArray();
+    }
 };
+static_assert(sizeof(DrivePacket) == sizeof(Packet) + 4);
 
 struct RCDrivePacket : public Packet {
     static constexpr uint8_t id = 0x02;
@@ -621,5 +579,15 @@ struct SetLEDIntensity : public SetLED {
 
 #pragma pack(pop)
 
+static_assert(frameIs(WakePacket::encoded, 0x8d, 0x0a, 0x13, 0x0d, 0x00, 0xd5, 0xd8));
+static_assert(frameIs(GoToLightSleep::encoded, 0x8d, 0x0a, 0x13, 0x01, 0x00, 0xe1, 0xd8));
+static_assert(frameIs(PingPacket::encoded, 0x8d, 0x0a, 0x10, 0x00, 0x00, 0xe5, 0xd8));
+static_assert(frameIs(RequestBatteryVoltagePacket::encoded, 0x8d, 0x0a, 0x13, 0x03, 0x00, 0xdf, 0xd8));
+static_assert(frameIs(GetTemperaturePacket::encoded, 0x8d, 0x0a, 0x11, 0x0e, 0x00, 0xd6, 0xd8));
+
+// Speed 166 at 90 degrees, happens to have 0xD8 as the checksum which needs to be escaped
+static_assert(frameIs(DrivePacket::frameTemplate.encode({ char(0xa6), 0x00, 0x5a, 0x00 }),
+                      0x8d, 0x0a, 0x16, 0x07, 0x00, 0xa6, 0x00, 0x5a, 0x00, 0xab, 0x50, 0xd8));
+
 } // namespace v2
 } // namespace sphero
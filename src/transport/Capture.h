@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// The format of the recorded traffic, written by Recorder and read by
+// ReplayTransport.
+//
+// A file header with the name of the robot, and then just records appended
+// one after another, so a truncated file (e. g. if we crashed) is still
+// valid up to the last complete record.
+//
+// Everything is little endian, like the robots.
+
+namespace transport {
+namespace capture {
+
+static constexpr char magic[8] = { 'R', 'B', 'T', 'C', 'A', 'P', '\r', '\n' };
+static constexpr uint16_t version = 1;
+
+#pragma pack(push,1)
+
+struct FileHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t nameLength; // followed by the name, utf8
+};
+
+struct RecordHeader {
+    enum Type : uint8_t {
+        Received = 0,
+        Sent = 1,
+
+        // Defines which characteristic a channel is, data is the 128 bit UUID.
+        // Written the first time a channel is used.
+        Channel = 2
+    };
+
+    enum Flags : uint8_t {
+        // Part of the byte stream the handler parses (what a Transport
+        // carries), as opposed to e. g. the RSSI notifications
+        Stream = 1 << 0
+    };
+
+    uint64_t timestamp; // microseconds since the recording started
+    uint8_t type;
+    uint8_t flags;
+    uint8_t channel; // 0 is "no characteristic", e. g. a simulator
+    uint8_t reserved = 0;
+    uint16_t size; // followed by this much data
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) == 12);
+static_assert(sizeof(RecordHeader) == 14);
+
+} // namespace capture
+} // namespace transport
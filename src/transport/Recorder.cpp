@@ -0,0 +1,104 @@
+#include "Recorder.h"
+
+#include "Capture.h"
+#include "logging.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QRegularExpression>
+#include <cstring>
+
+namespace transport {
+
+Recorder::Recorder(const QString &path, const QString &robotName, QObject *parent) :
+    QObject(parent),
+    m_file(path)
+{
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcSessions) << " ! Failed to open" << path << "for recording:" << m_file.errorString();
+        return;
+    }
+
+    const QByteArray name = robotName.toUtf8().left(UINT16_MAX);
+
+    capture::FileHeader header;
+    memcpy(header.magic, capture::magic, sizeof(header.magic));
+    header.version = capture::version;
+    header.nameLength = name.size();
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.write(name);
+
+    m_clock.start();
+
+    qCDebug(lcSessions) << " + Recording traffic to" << path;
+}
+
+Recorder::~Recorder()
+{
+    if (m_file.isOpen()) {
+        qCDebug(lcSessions) << " - Stopped recording to" << m_file.fileName() << "," << m_file.size() << "bytes";
+    }
+}
+
+void Recorder::record(const Direction direction, const QBluetoothUuid &characteristic, const QByteArray &data, const bool stream)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    const uint8_t type = direction == Sent ? capture::RecordHeader::Sent : capture::RecordHeader::Received;
+    const uint8_t flags = stream ? capture::RecordHeader::Stream : 0;
+
+    // Notifications are max 512 bytes, so this shouldn't ever happen, but better safe than sorry
+    for (int offset = 0; offset < data.size() || offset == 0; offset += UINT16_MAX) {
+        writeRecord(type, flags, channel(characteristic), data.constData() + offset, qMin(data.size() - offset, int(UINT16_MAX)));
+    }
+}
+
+QString Recorder::filePath(const QString &directory, const QString &robotName)
+{
+    QString name = robotName;
+    name.replace(QRegularExpression("[^A-Za-z0-9_-]"), "_");
+    return QDir(directory).filePath(name + '-' + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".robotcap");
+}
+
+uint8_t Recorder::channel(const QBluetoothUuid &characteristic)
+{
+    if (characteristic.isNull()) {
+        return 0;
+    }
+
+    const int index = m_channels.indexOf(characteristic);
+    if (index >= 0) {
+        return index + 1;
+    }
+
+    if (m_channels.count() >= UINT8_MAX) {
+        qCWarning(lcSessions) << " ! Too many characteristics to record, lumping" << characteristic << "in with the rest";
+        return 0;
+    }
+
+    m_channels.append(characteristic);
+    const uint8_t id = m_channels.count();
+
+    const quint128 uuid = characteristic.toUInt128();
+    writeRecord(capture::RecordHeader::Channel, 0, id, reinterpret_cast<const char*>(uuid.data), sizeof(uuid.data));
+
+    return id;
+}
+
+void Recorder::writeRecord(const uint8_t type, const uint8_t flags, const uint8_t channel, const char *data, const int size)
+{
+    capture::RecordHeader header;
+    header.timestamp = m_clock.nsecsElapsed() / 1000;
+    header.type = type;
+    header.flags = flags;
+    header.channel = channel;
+    header.size = size;
+
+    // Buffered by QFile, so it's not a syscall per packet
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.write(data, size);
+}
+
+} // namespace transport
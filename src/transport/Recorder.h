@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QObject>
+#include <QBluetoothUuid>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+
+namespace transport {
+
+// Writes everything a handler sends and receives to a file, so we can
+// replay it later with ReplayTransport.
+//
+// Lives in the same thread as the handler, and is owned by it.
+class Recorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Direction {
+        Received,
+        Sent
+    };
+
+    // If stream is true the data is part of what the handler parses (or
+    // writes), otherwise it is just recorded for reference.
+    Recorder(const QString &path, const QString &robotName, QObject *parent);
+    ~Recorder();
+
+    bool isOpen() const { return m_file.isOpen(); }
+    QString fileName() const { return m_file.fileName(); }
+
+    void record(const Direction direction, const QBluetoothUuid &characteristic, const QByteArray &data, const bool stream);
+
+    // Something like <directory>/BB-1234-20201231-235959.robotcap
+    static QString filePath(const QString &directory, const QString &robotName);
+
+private:
+    uint8_t channel(const QBluetoothUuid &characteristic);
+    void writeRecord(const uint8_t type, const uint8_t flags, const uint8_t channel, const char *data, const int size);
+
+    QFile m_file;
+    QElapsedTimer m_clock;
+
+    QVector<QBluetoothUuid> m_channels; // index + 1 is the channel id
+};
+
+} // namespace transport
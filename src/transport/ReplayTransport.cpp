@@ -0,0 +1,198 @@
+#include "ReplayTransport.h"
+
+#include "Capture.h"
+#include "logging.h"
+
+#include <cstring>
+
+namespace transport {
+
+namespace {
+// So we don't starve the event loop when replaying as fast as we can
+static constexpr int maxFramesPerBatch = 64;
+}
+
+ReplayTransport::ReplayTransport(const QString &path, QObject *parent) :
+    Transport(parent),
+    m_file(path)
+{
+    // So they follow along if we're moved to a worker thread
+    m_file.setParent(this);
+    m_timer.setParent(this);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &ReplayTransport::replayNext);
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCWarning(lcSessions) << " ! Failed to open recording" << path << m_file.errorString();
+        return;
+    }
+
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        qCWarning(lcSessions) << " ! Failed to map recording" << path << m_file.errorString();
+        return;
+    }
+
+    if (!index()) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = nullptr;
+        return;
+    }
+
+    qCDebug(lcSessions) << " + Replaying" << m_frames.count() << "frames," << m_byteCount << "bytes from" << m_name << "in" << path;
+}
+
+bool ReplayTransport::index()
+{
+    if (m_size < qint64(sizeof(capture::FileHeader))) {
+        qCWarning(lcSessions) << " ! Recording too short" << m_size;
+        return false;
+    }
+
+    capture::FileHeader header;
+    memcpy(&header, m_data, sizeof(header));
+    if (memcmp(header.magic, capture::magic, sizeof(header.magic)) != 0) {
+        qCWarning(lcSessions) << " ! Not a recording" << m_file.fileName();
+        return false;
+    }
+    if (header.version != capture::version) {
+        qCWarning(lcSessions) << " ! Unsupported recording version" << header.version;
+        return false;
+    }
+
+    qint64 offset = sizeof(header);
+    if (offset + header.nameLength > m_size) {
+        qCWarning(lcSessions) << " ! Recording header truncated";
+        return false;
+    }
+    m_name = QString::fromUtf8(reinterpret_cast<const char*>(m_data + offset), header.nameLength);
+    offset += header.nameLength;
+
+    while (offset + qint64(sizeof(capture::RecordHeader)) <= m_size) {
+        capture::RecordHeader record;
+        memcpy(&record, m_data + offset, sizeof(record));
+        offset += sizeof(record);
+
+        // Probably crashed while recording, everything up until now is fine
+        if (offset + record.size > m_size) {
+            qCWarning(lcSessions) << " ! Recording truncated, last record wants" << record.size << "bytes but only" << (m_size - offset) << "left";
+            break;
+        }
+
+        if (record.type == capture::RecordHeader::Received && (record.flags & capture::RecordHeader::Stream)) {
+            m_frames.append({qint64(record.timestamp), offset, record.size});
+            m_byteCount += record.size;
+        }
+
+        offset += record.size;
+    }
+
+    return true;
+}
+
+bool ReplayTransport::write(const QByteArray &data)
+{
+    Q_UNUSED(data);
+
+    if (!m_connected) {
+        qCWarning(lcSessions) << " ! Replay not connected, can't write";
+        return false;
+    }
+
+    m_sentCount++;
+    QTimer::singleShot(0, this, [this]() {
+        emit written();
+    });
+    return true;
+}
+
+void ReplayTransport::setSpeed(const double speed)
+{
+    m_speed = qMax(speed, 0.);
+}
+
+void ReplayTransport::connectToRobot()
+{
+    if (!isValid()) {
+        qCWarning(lcSessions) << " ! Nothing to replay";
+        return;
+    }
+    if (m_connected) {
+        return;
+    }
+
+    m_connected = true;
+    m_nextFrame = 0;
+    m_sentCount = 0;
+
+    QTimer::singleShot(0, this, [this]() {
+        emit connected();
+
+        m_clock.start();
+        scheduleNext();
+    });
+}
+
+void ReplayTransport::disconnectFromRobot()
+{
+    if (!m_connected) {
+        return;
+    }
+
+    m_connected = false;
+    m_timer.stop();
+
+    QTimer::singleShot(0, this, [this]() {
+        emit disconnected();
+    });
+}
+
+void ReplayTransport::replayNext()
+{
+    if (!m_connected) {
+        return;
+    }
+
+    const qint64 start = m_frames.first().timestamp;
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+
+    for (int i=0; i<maxFramesPerBatch && m_nextFrame < m_frames.count(); i++) {
+        const Frame &frame = m_frames[m_nextFrame];
+        if (m_speed > 0. && (frame.timestamp - start) / m_speed > now) {
+            break;
+        }
+        m_nextFrame++;
+
+        // Straight from the mapped file, no copying
+        emit received(QByteArray::fromRawData(reinterpret_cast<const char*>(m_data + frame.offset), frame.size));
+
+        // The handler might have given up
+        if (!m_connected) {
+            return;
+        }
+    }
+
+    scheduleNext();
+}
+
+void ReplayTransport::scheduleNext()
+{
+    if (m_nextFrame >= m_frames.count()) {
+        qCDebug(lcSessions) << " - Replay of" << m_name << "done after" << m_clock.elapsed() << "ms";
+        emit finished();
+        return;
+    }
+
+    if (m_speed <= 0.) {
+        m_timer.start(0);
+        return;
+    }
+
+    const qint64 due = (m_frames[m_nextFrame].timestamp - m_frames.first().timestamp) / m_speed;
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    m_timer.start(int(qMax<qint64>(due - now, 0) / 1000));
+}
+
+} // namespace transport
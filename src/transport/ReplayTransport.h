@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Transport.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
+#include <QVector>
+
+namespace transport {
+
+// Plays back a file written by Recorder, as if it was the robot.
+//
+// The file is memory mapped, and what we emit points straight into it, so
+// it's cheap enough to benchmark the parsers with. Writes are acked right
+// away and otherwise ignored, the robot isn't going to answer any
+// differently anyways.
+class ReplayTransport : public Transport
+{
+    Q_OBJECT
+
+public:
+    ReplayTransport(const QString &path, QObject *parent);
+
+    bool isValid() const { return m_data != nullptr; }
+
+    QString name() const override { return m_name; }
+    bool isConnected() const override { return m_connected; }
+    bool write(const QByteArray &data) override;
+
+    // 1 is real time, 100 is a hundred times as fast, 0 is as fast as we can
+    void setSpeed(const double speed);
+
+    int frameCount() const { return m_frames.count(); }
+    qint64 byteCount() const { return m_byteCount; }
+    int sentCount() const { return m_sentCount; }
+
+public slots:
+    void connectToRobot() override;
+    void disconnectFromRobot() override;
+
+signals:
+    void finished();
+
+private slots:
+    void replayNext();
+
+private:
+    struct Frame {
+        qint64 timestamp; // microseconds
+        qint64 offset; // of the data
+        int size;
+    };
+
+    bool index();
+    void scheduleNext();
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+
+    QString m_name;
+    QVector<Frame> m_frames; // only the ones the handler should get
+    qint64 m_byteCount = 0;
+
+    bool m_connected = false;
+    double m_speed = 1.;
+    int m_nextFrame = 0;
+    int m_sentCount = 0;
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
+
+} // namespace transport
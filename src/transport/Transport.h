@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+namespace transport {
+
+// The bytes on the wire, without any of the QLowEnergy* stuff. The handlers
+// talk to the BLE stack directly when they have a real device, and to one of
+// these when they don't (e.g. the simulators).
+//
+// Mirrors how the robots work over BLE: writes are acked one at a time, and
+// everything coming back is a notification on a single characteristic.
+class Transport : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Transport(QObject *parent) : QObject(parent) {}
+
+    virtual QString name() const = 0;
+    virtual bool isConnected() const = 0;
+
+    // Returns false if it can't be sent at all, otherwise written() is
+    // emitted when the other end has it.
+    virtual bool write(const QByteArray &data) = 0;
+
+public slots:
+    virtual void connectToRobot() = 0;
+    virtual void disconnectFromRobot() = 0;
+
+signals:
+    void connected();
+    void disconnected();
+
+    void received(const QByteArray &data);
+    void written();
+
+    // Maximum connection interval, like QLowEnergyConnectionParameters
+    void connectionIntervalChanged(const int milliseconds);
+};
+
+} // namespace transport
@@ -44,15 +44,21 @@ QByteArray packetToByteArray(const PACKET &packet)
 
 // data needs to have correct endinanness before calling this cuz im lazy
 template <typename PACKET>
-PACKET byteArrayToPacket(const QByteArray &data, bool *ok)
+PACKET bytesToPacket(const char *data, const int size, bool *ok)
 {
-    if (size_t(data.size()) < sizeof(PACKET)) {
-        qWarning() << "Invalid packet size, need" << sizeof(PACKET) << "but got" << data.size();
+    if (size_t(size) < sizeof(PACKET)) {
+        qWarning() << "Invalid packet size, need" << sizeof(PACKET) << "but got" << size;
         *ok = false;
         return {};
     }
     PACKET ret;
-    memcpy(&ret, data.data(), sizeof(PACKET));
+    memcpy(&ret, data, sizeof(PACKET));
     *ok = true;
     return ret;
 }
+
+template <typename PACKET>
+PACKET byteArrayToPacket(const QByteArray &data, bool *ok)
+{
+    return bytesToPacket<PACKET>(data.constData(), data.size(), ok);
+}
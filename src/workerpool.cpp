@@ -0,0 +1,75 @@
+#include "workerpool.h"
+
+#include "logging.h"
+
+#include <QDebug>
+
+WorkerPool::WorkerPool(QObject *parent) :
+    QObject(parent)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (QThread *thread : m_threads) {
+        thread->quit();
+    }
+
+    // Anything deleteLater'd in them gets deleted when they finish
+    for (QThread *thread : m_threads) {
+        if (!thread->wait(5000)) {
+            qCWarning(lcSessions) << " ! Worker thread" << thread->objectName() << "didn't stop in time";
+        }
+    }
+
+    qDeleteAll(m_contexts);
+    qDeleteAll(m_threads);
+}
+
+void WorkerPool::setThreadCount(const int count)
+{
+    m_threadCount = qMax(count, 0);
+    qCDebug(lcSessions) << "Using" << m_threadCount << "worker threads";
+}
+
+QThread *WorkerPool::assignThread()
+{
+    if (m_threadCount == 0) {
+        return nullptr;
+    }
+
+    if (m_threads.count() < m_threadCount) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("Robot worker %1").arg(m_threads.count() + 1));
+
+        QObject *context = new QObject;
+        context->moveToThread(thread);
+
+        thread->start();
+
+        m_threads.append(thread);
+        m_contexts.append(context);
+        m_nextThread = m_threads.count() - 1;
+
+        qCDebug(lcSessions) << " + Started" << thread->objectName();
+
+        return thread;
+    }
+
+    m_nextThread = (m_nextThread + 1) % m_threads.count();
+    return m_threads[m_nextThread];
+}
+
+QObject *WorkerPool::contextFor(QThread *thread) const
+{
+    if (!thread) {
+        return nullptr;
+    }
+
+    const int index = m_threads.indexOf(thread);
+    if (index < 0) {
+        qCWarning(lcSessions) << " ! Not one of our threads" << thread;
+        return nullptr;
+    }
+    return m_contexts[index];
+}
@@ -0,0 +1,57 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+// A handful of threads the robot handlers can live in, so parsing and
+// whatnot doesn't have to wait for QML to finish rendering (and the other
+// way around).
+//
+// The threads are started when needed, and robots are spread out over them
+// round robin.
+class WorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WorkerPool(QObject *parent);
+    ~WorkerPool();
+
+    // 0 means everything runs in the GUI thread like before.
+    // Only affects robots connected afterwards.
+    void setThreadCount(const int count);
+    int threadCount() const { return m_threadCount; }
+
+    // Returns nullptr if we don't use any worker threads
+    QThread *assignThread();
+
+    // Runs the factory in the thread, so everything it creates lives there
+    // from the start (QLowEnergyController doesn't like to be moved).
+    // Blocks until it is done.
+    template<typename T, typename FACTORY>
+    T *create(QThread *thread, FACTORY factory) {
+        QObject *context = contextFor(thread);
+        if (!context) {
+            return factory();
+        }
+
+        T *created = nullptr;
+        QMetaObject::invokeMethod(context, [&]() {
+            created = factory();
+        }, Qt::BlockingQueuedConnection);
+        return created;
+    }
+
+private:
+    QObject *contextFor(QThread *thread) const;
+
+    int m_threadCount = 0;
+    int m_nextThread = 0;
+
+    QVector<QThread*> m_threads;
+    QVector<QObject*> m_contexts; // one living in each thread, for invokeMethod
+};
+
+#endif // WORKERPOOL_H